@@ -45,6 +45,12 @@ class Stats(object):
             print(f'B/W: {wr.black_wins}/{wr.white_wins}. '
                   f'Black winrate: {win_rate:.2f} {wr.total_games}')
 
+            ts = batch.GC.getClient().getGameStats().getSearchTreeStats()
+            print(f'MCTS trees: {ts.total_nodes} nodes, '
+                  f'{ts.total_bytes / 2**20:.1f} MB. '
+                  f'Largest: {ts.max_tree_nodes} nodes. '
+                  f'Pruned: {ts.num_pruned_nodes}')
+
             self.total_sel_batchsize = 0
             self.total_batchsize = 0
             print('Actor count:', self.actor_count)
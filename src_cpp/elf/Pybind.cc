@@ -16,6 +16,7 @@
 
 #include <spdlog/spdlog.h>
 
+#include "elf/ai/tree_search/tree_search_eval_cache.h"
 #include "elf/ai/tree_search/tree_search_options.h"
 #include "elf/base/context.h"
 #include "elf/comm/comm.h"
@@ -29,6 +30,7 @@ void register_common_func(pybind11::module& m) {
 
   using comm::ReplyStatus;
   using elf::AnyP;
+  using elf::BatchStats;
   using elf::Context;
   using elf::FuncMapBase;
   using elf::SharedMem;
@@ -59,15 +61,32 @@ void register_common_func(pybind11::module& m) {
       .def("stop", &Context::stop)
       .def("version", &Context::version)
       .def("allocateSharedMem", &Context::allocateSharedMem, ref)
-      .def("createSharedMemOptions", &Context::createSharedMemOptions);
+      .def("createSharedMemOptions", &Context::createSharedMemOptions)
+      .def("getBatchStats", &Context::getBatchStats);
+
+  PYCLASS_WITH_FIELDS(m, BatchStats)
+      .def(py::init<>())
+      .def("meanBatchSize", &BatchStats::meanBatchSize)
+      .def("meanQueueDelayUsec", &BatchStats::meanQueueDelayUsec)
+      .def("info", &BatchStats::info);
 
   py::class_<Size>(m, "Size").def("vec", &Size::vec, ref);
 
-  py::class_<SharedMemOptions>(m, "SharedMemOptions")
+  py::class_<SharedMemOptions> smem_opts(m, "SharedMemOptions");
+  py::enum_<SharedMemOptions::TransferType>(smem_opts, "TransferType")
+      .value("SERVER", SharedMemOptions::SERVER)
+      .value("CLIENT", SharedMemOptions::CLIENT)
+      .value("DIRECT", SharedMemOptions::DIRECT)
+      .export_values();
+
+  smem_opts
       .def("idx", &SharedMemOptions::getIdx)
       .def("batchsize", &SharedMemOptions::getBatchSize)
       .def("label", &SharedMemOptions::getLabel, ref)
-      .def("setTimeout", &SharedMemOptions::setTimeout);
+      .def("setTimeout", &SharedMemOptions::setTimeout)
+      .def("setMinBatchSize", &SharedMemOptions::setMinBatchSize)
+      .def("setAdaptiveTimeout", &SharedMemOptions::setAdaptiveTimeout)
+      .def("setTransferType", &SharedMemOptions::setTransferType);
 
   py::class_<SharedMem>(m, "SharedMem")
       .def("__getitem__", &SharedMem::get, ref)
@@ -91,11 +110,16 @@ void register_common_func(pybind11::module& m) {
 void register_tree_search(pybind11::module& m) {
   namespace py = pybind11;
 
+  using elf::ai::tree_search::EvalCacheStats;
   using elf::ai::tree_search::SearchAlgoOptions;
   using elf::ai::tree_search::TSOptions;
 
   PYCLASS_WITH_FIELDS(m, SearchAlgoOptions).def(py::init<>());
   PYCLASS_WITH_FIELDS(m, TSOptions).def(py::init<>());
+  PYCLASS_WITH_FIELDS(m, EvalCacheStats)
+      .def(py::init<>())
+      .def("hitRate", &EvalCacheStats::hitRate)
+      .def("info", &EvalCacheStats::info);
 }
 
 } // namespace
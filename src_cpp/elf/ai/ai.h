@@ -8,14 +8,21 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 #include "elf/base/context.h"
 #include "elf/utils/utils.h"
 
+#include "batch_merger.h"
+
 namespace elf {
 namespace ai {
 
@@ -70,20 +77,16 @@ class AIClientT : public AI_T<S, A> {
   using State = S;
 
   AIClientT(elf::GameClient* client, const std::vector<std::string>& targets)
-      : client_(client), targets_(targets) {}
+      : client_(client),
+        targets_(targets),
+        binding_(client, targets),
+        batchBinding_(client, targets) {}
 
   // Given the current state, perform action and send the action to _a;
   // Return false if this procedure fails.
+  // The functions stay bound while s and a stay at the same addresses.
   bool act(const S& s, A* a) override {
-    elf::FuncsWithState funcs_s = client_->BindStateToFunctions(targets_, &s);
-    elf::FuncsWithState funcs_a = client_->BindStateToFunctions(targets_, a);
-    // elf::FuncsWithState funcs =
-    // elf::FuncsWithState::MergePkg(funcs_s, funcs_a);
-
-    funcs_s.add(funcs_a);
-
-    // return client_->sendWait(targets_, &funcs);
-    comm::ReplyStatus status = client_->sendWait(targets_, &funcs_s);
+    comm::ReplyStatus status = binding_.sendWait(&s, a);
     return status == comm::ReplyStatus::SUCCESS ||
         status == comm::ReplyStatus::UNKNOWN;
   }
@@ -91,28 +94,155 @@ class AIClientT : public AI_T<S, A> {
   bool act_batch(
       const std::vector<const S*>& batch_s,
       const std::vector<A*>& batch_a) override {
-    std::vector<elf::FuncsWithState> funcs_s =
-        client_->BindStateToFunctions(targets_, batch_s);
-    std::vector<elf::FuncsWithState> funcs_a =
-        client_->BindStateToFunctions(targets_, batch_a);
-    // elf::FuncsWithState funcs =
-    // elf::FuncsWithState::MergePkg(funcs_s, funcs_a);
-    //
-    std::vector<elf::FuncsWithState*> ptr_funcs_s;
-    for (size_t i = 0; i < funcs_s.size(); ++i) {
-      funcs_s[i].add(funcs_a[i]);
-      ptr_funcs_s.push_back(&funcs_s[i]);
-    }
-
-    // return client_->sendWait(targets_, &funcs);
-    comm::ReplyStatus status = client_->sendBatchWait(targets_, ptr_funcs_s);
+    comm::ReplyStatus status = batchBinding_.sendBatchWait(batch_s, batch_a);
     return status == comm::ReplyStatus::SUCCESS ||
         status == comm::ReplyStatus::UNKNOWN;
   }
 
+  // Same as act_batch, but return once the batch is sent. The result of
+  // act_batch is delivered by the returned future, which must be waited on;
+  // batch_s and batch_a must stay alive until then. Each batch in flight
+  // has a binding of its own, reused by the next batch at the same
+  // addresses.
+  //
+  // With a BatchMerger active on this thread, the batch is only added to
+  // the ones of the other AIs with the same client and targets, and sent
+  // with them by BatchMerger::flush().
+  std::future<bool> act_batch_async(
+      const std::vector<const S*>& batch_s,
+      const std::vector<A*>& batch_a) {
+    BatchMerger* merger = BatchMerger::current();
+    if (merger != nullptr) {
+      MergedBatch* group = merger->getGroup<MergedBatch>(
+          BatchMerger::Key(typeid(MergedBatch), client_, targets_),
+          [this]() { return new MergedBatch(client_, targets_); });
+      return group->add(batch_s, batch_a);
+    }
+
+    BatchBinding* binding = acquireAsyncBinding(batch_s, batch_a);
+    std::future<comm::ReplyStatus> sent =
+        binding->sendBatchAsync(batch_s, batch_a);
+    return std::async(
+        std::launch::deferred,
+        [this, binding, sent = std::move(sent)]() mutable {
+          comm::ReplyStatus status = sent.get();
+          releaseAsyncBinding(binding);
+          return status == comm::ReplyStatus::SUCCESS ||
+              status == comm::ReplyStatus::UNKNOWN;
+        });
+  }
+
  private:
+  using BatchBinding = elf::BatchStateBindingT<const S, A>;
+
   elf::GameClient* client_;
   std::vector<std::string> targets_;
+  elf::StateBindingT<const S, A> binding_;
+  BatchBinding batchBinding_;
+
+  std::mutex asyncMutex_;
+  std::vector<std::unique_ptr<BatchBinding>> asyncBindings_;
+  std::vector<BatchBinding*> freeAsyncBindings_;
+
+  // The batches of the AIs of a client and targets, merged by a
+  // BatchMerger. It is sent in chunks of the batch size of the targets,
+  // all in flight together.
+  class MergedBatch : public BatchMerger::Group {
+   public:
+    MergedBatch(
+        elf::GameClient* client,
+        const std::vector<std::string>& targets)
+        : client_(client),
+          targets_(targets),
+          chunkSize_(client->getBatchSize(targets)) {}
+
+    std::future<bool> add(
+        const std::vector<const S*>& batch_s,
+        const std::vector<A*>& batch_a) {
+      states_.insert(states_.end(), batch_s.begin(), batch_s.end());
+      replies_.insert(replies_.end(), batch_a.begin(), batch_a.end());
+      promises_.emplace_back();
+      return promises_.back().get_future();
+    }
+
+    void flush() override {
+      if (states_.empty()) {
+        return;
+      }
+      const size_t chunk_size = chunkSize_ > 0 ? chunkSize_ : states_.size();
+      const size_t num_chunks = (states_.size() + chunk_size - 1) / chunk_size;
+      while (chunks_.size() < num_chunks) {
+        chunks_.emplace_back(new Chunk(client_, targets_));
+      }
+      for (size_t i = 0; i < num_chunks; ++i) {
+        const size_t begin = i * chunk_size;
+        const size_t end = std::min(begin + chunk_size, states_.size());
+        Chunk& chunk = *chunks_[i];
+        chunk.states.assign(states_.begin() + begin, states_.begin() + end);
+        chunk.replies.assign(replies_.begin() + begin, replies_.begin() + end);
+        chunk.sent = chunk.binding.sendBatchAsync(chunk.states, chunk.replies);
+      }
+
+      bool success = true;
+      for (size_t i = 0; i < num_chunks; ++i) {
+        const comm::ReplyStatus status = chunks_[i]->sent.get();
+        success = success &&
+            (status == comm::ReplyStatus::SUCCESS ||
+             status == comm::ReplyStatus::UNKNOWN);
+      }
+      for (auto& promise : promises_) {
+        promise.set_value(success);
+      }
+      states_.clear();
+      replies_.clear();
+      promises_.clear();
+    }
+
+   private:
+    struct Chunk {
+      std::vector<const S*> states;
+      std::vector<A*> replies;
+      BatchBinding binding;
+      std::future<comm::ReplyStatus> sent;
+
+      Chunk(elf::GameClient* client, const std::vector<std::string>& targets)
+          : binding(client, targets) {}
+    };
+
+    elf::GameClient* client_;
+    std::vector<std::string> targets_;
+    const size_t chunkSize_;
+    std::vector<const S*> states_;
+    std::vector<A*> replies_;
+    std::vector<std::promise<bool>> promises_;
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+  };
+
+  // Prefer a free binding that is bound to this batch already.
+  BatchBinding* acquireAsyncBinding(
+      const std::vector<const S*>& batch_s,
+      const std::vector<A*>& batch_a) {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    if (freeAsyncBindings_.empty()) {
+      asyncBindings_.emplace_back(new BatchBinding(client_, targets_));
+      return asyncBindings_.back().get();
+    }
+    auto it = std::find_if(
+        freeAsyncBindings_.begin(),
+        freeAsyncBindings_.end(),
+        [&](const BatchBinding* b) { return b->isBoundTo(batch_s, batch_a); });
+    if (it == freeAsyncBindings_.end()) {
+      it = freeAsyncBindings_.end() - 1;
+    }
+    BatchBinding* binding = *it;
+    freeAsyncBindings_.erase(it);
+    return binding;
+  }
+
+  void releaseAsyncBinding(BatchBinding* binding) {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    freeAsyncBindings_.push_back(binding);
+  }
 };
 
 } // namespace ai
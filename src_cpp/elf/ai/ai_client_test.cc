@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ai.h"
+
+#include <dirent.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Heap allocations of the current thread. The server side runs on other
+// threads, and is not counted.
+thread_local int64_t numAllocs = 0;
+
+void* operator new(size_t size) {
+  numAllocs++;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// Not inlined, or the compiler sees free() paired with new.
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+struct Obs {
+  int64_t id = 0;
+};
+
+struct Reply {
+  int64_t a = -1;
+};
+
+void extractId(const Obs& s, int64_t* p) {
+  *p = s.id;
+}
+
+void replyA(Reply& r, const int64_t* p) {
+  r.a = *p;
+}
+
+void extractIdSlow(const Obs& s, int64_t* p) {
+  *p = s.id;
+}
+
+using AI = elf::ai::AIClientT<Obs, Reply>;
+
+int numThreads() {
+  int n = 0;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return -1;
+  }
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      n++;
+    }
+  }
+  closedir(dir);
+  return n;
+}
+
+const int kBatchSize = 2;
+
+class AIClientTest : public ::testing::Test {
+ protected:
+  elf::Context ctx_;
+  int64_t id_[kBatchSize];
+  int64_t a_[kBatchSize];
+  int64_t id2_[kBatchSize];
+
+  void SetUp() override {
+    elf::Extractor& e = ctx_.getExtractor();
+    e.addField<int64_t>({"id", "a", "id2"}).addExtent(kBatchSize);
+    e.addTypedClass<Obs>().addFunction<int64_t, extractId>("id");
+    e.addTypedClass<Reply>().addFunction<int64_t, replyA>("a");
+    // Not typed.
+    e.addClass<Obs>().addFunction<int64_t>("id2", extractIdSlow);
+
+    elf::SharedMemOptions options =
+        ctx_.createSharedMemOptions("actor", kBatchSize);
+    // Single requests do not wait for a full batch.
+    options.setTimeout(100);
+    elf::SharedMem& smem =
+        ctx_.allocateSharedMem(options, {"id", "a", "id2"});
+    smem["id"]->setAddress(reinterpret_cast<uint64_t>(id_), {8});
+    smem["a"]->setAddress(reinterpret_cast<uint64_t>(a_), {8});
+    smem["id2"]->setAddress(reinterpret_cast<uint64_t>(id2_), {8});
+  }
+
+  // Runs game on a game thread, and replies a = 2 * id to each of its
+  // requests, until it returns.
+  void run(std::function<void(elf::GameClient*)> game) {
+    std::atomic<bool> done(false);
+    ctx_.setStartCallback(1, [&](int, elf::GameClient* client) {
+      game(client);
+      done = true;
+      // Context::stop() expects the games to send until they are stopped.
+      AI ai(client, {"actor"});
+      Obs obs;
+      Reply reply;
+      while (!client->DoStopGames()) {
+        ai.act(obs, &reply);
+      }
+    });
+    ctx_.start();
+    while (!done) {
+      const elf::SharedMem* smem = ctx_.wait(100);
+      if (smem != nullptr) {
+        for (size_t i = 0; i < smem->getEffectiveBatchSize(); ++i) {
+          EXPECT_EQ(id_[i], id2_[i]);
+          a_[i] = 2 * id_[i];
+        }
+      }
+      ctx_.step();
+    }
+    ctx_.stop();
+  }
+};
+
+} // namespace
+
+TEST_F(AIClientTest, actDoesNotAllocate) {
+  std::vector<int64_t> allocs;
+  std::vector<int64_t> replies;
+  allocs.reserve(100);
+  replies.reserve(100);
+
+  run([&](elf::GameClient* client) {
+    AI ai(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < 100; ++i) {
+      obs.id = i;
+      const int64_t before = numAllocs;
+      EXPECT_TRUE(ai.act(obs, &reply));
+      allocs.push_back(numAllocs - before);
+      replies.push_back(reply.a);
+    }
+  });
+
+  ASSERT_EQ(replies.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(replies[i], 2 * i);
+  }
+  // The first calls bind, and grow the buffers of the comm.
+  EXPECT_GT(allocs[0], 0);
+  for (int i = 10; i < 100; ++i) {
+    EXPECT_EQ(allocs[i], 0) << "act #" << i;
+  }
+}
+
+TEST_F(AIClientTest, rebindsMovedState) {
+  std::vector<int64_t> replies;
+  run([&](elf::GameClient* client) {
+    AI ai(client, {"actor"});
+    std::vector<Obs> obs(3);
+    Reply reply;
+    for (int i = 0; i < 3; ++i) {
+      obs[i].id = 10 + i;
+      ai.act(obs[i], &reply);
+      replies.push_back(reply.a);
+    }
+    Reply other;
+    ai.act(obs[0], &other);
+    replies.push_back(other.a);
+  });
+
+  EXPECT_EQ(replies, std::vector<int64_t>({20, 22, 24, 20}));
+}
+
+TEST_F(AIClientTest, actBatch) {
+  std::vector<int64_t> replies;
+  run([&](elf::GameClient* client) {
+    AI ai(client, {"actor"});
+    std::vector<Obs> obs(2);
+    std::vector<Reply> reply(2);
+    const std::vector<const Obs*> batch_s = {&obs[0], &obs[1]};
+    const std::vector<Reply*> batch_a = {&reply[0], &reply[1]};
+    for (int i = 0; i < 2; ++i) {
+      obs[0].id = i;
+      obs[1].id = 5 + i;
+      EXPECT_TRUE(ai.act_batch(batch_s, batch_a));
+      replies.push_back(reply[0].a);
+      replies.push_back(reply[1].a);
+    }
+  });
+
+  EXPECT_EQ(replies, std::vector<int64_t>({0, 10, 2, 12}));
+}
+
+TEST_F(AIClientTest, actBatchAsync) {
+  const int kInFlight = 8;
+  std::vector<int64_t> replies;
+  std::vector<int> threads;
+  run([&](elf::GameClient* client) {
+    AI ai(client, {"actor"});
+    std::vector<Obs> obs(kInFlight);
+    std::vector<Reply> reply(kInFlight);
+    std::vector<std::vector<const Obs*>> batch_s(kInFlight);
+    std::vector<std::vector<Reply*>> batch_a(kInFlight);
+    for (int i = 0; i < kInFlight; ++i) {
+      batch_s[i] = {&obs[i]};
+      batch_a[i] = {&reply[i]};
+    }
+
+    for (int round = 0; round < 3; ++round) {
+      threads.push_back(numThreads());
+      std::vector<std::future<bool>> sent;
+      for (int i = 0; i < kInFlight; ++i) {
+        obs[i].id = round * 100 + i;
+        sent.push_back(ai.act_batch_async(batch_s[i], batch_a[i]));
+      }
+      // Requests in flight take no thread.
+      threads.push_back(numThreads());
+      for (int i = 0; i < kInFlight; ++i) {
+        EXPECT_TRUE(sent[i].get());
+        replies.push_back(reply[i].a);
+      }
+    }
+  });
+
+  ASSERT_EQ(replies.size(), 3u * kInFlight);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < kInFlight; ++i) {
+      EXPECT_EQ(replies[round * kInFlight + i], 2 * (round * 100 + i));
+    }
+  }
+  for (size_t i = 1; i < threads.size(); ++i) {
+    EXPECT_EQ(threads[i], threads[0]);
+  }
+}
+
+TEST_F(AIClientTest, mergedBatch) {
+  const int kNumAIs = 3;
+  std::vector<int64_t> replies;
+  std::vector<bool> readyBeforeFlush;
+  run([&](elf::GameClient* client) {
+    std::vector<std::unique_ptr<AI>> ais;
+    std::vector<Obs> obs(kNumAIs);
+    std::vector<Reply> reply(kNumAIs);
+    std::vector<std::vector<const Obs*>> batch_s(kNumAIs);
+    std::vector<std::vector<Reply*>> batch_a(kNumAIs);
+    for (int i = 0; i < kNumAIs; ++i) {
+      ais.emplace_back(new AI(client, {"actor"}));
+      obs[i].id = i + 1;
+      batch_s[i] = {&obs[i]};
+      batch_a[i] = {&reply[i]};
+    }
+
+    elf::ai::BatchMerger merger;
+    std::vector<std::future<bool>> sent;
+    {
+      elf::ai::BatchMerger::Scope scope(&merger);
+      for (int i = 0; i < kNumAIs; ++i) {
+        sent.push_back(ais[i]->act_batch_async(batch_s[i], batch_a[i]));
+      }
+    }
+    for (auto& f : sent) {
+      readyBeforeFlush.push_back(
+          f.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    }
+    merger.flush();
+    for (int i = 0; i < kNumAIs; ++i) {
+      EXPECT_TRUE(sent[i].get());
+      replies.push_back(reply[i].a);
+    }
+  });
+
+  EXPECT_EQ(readyBeforeFlush, std::vector<bool>(kNumAIs, false));
+  EXPECT_EQ(replies, std::vector<int64_t>({2, 4, 6}));
+  // Sent in chunks of the batch size: one full batch, and the rest.
+  const elf::BatchStats stats = ctx_.getBatchStats("actor");
+  EXPECT_EQ(stats.batch_sizes[kBatchSize], 1);
+}
+
+TEST_F(AIClientTest, batchStats) {
+  run([&](elf::GameClient* client) {
+    AI ai(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < 10; ++i) {
+      ai.act(obs, &reply);
+    }
+  });
+
+  const elf::BatchStats stats = ctx_.getBatchStats("actor");
+  // And the requests sent until the game was stopped.
+  EXPECT_GE(stats.num_requests, 10);
+  ASSERT_EQ(stats.batch_sizes.size(), kBatchSize + 1);
+  // A single game never fills a batch.
+  EXPECT_EQ(stats.batch_sizes[1], stats.num_batches);
+  int64_t delays = 0;
+  for (int64_t n : stats.queue_delay_usec) {
+    delays += n;
+  }
+  EXPECT_EQ(delays, stats.num_requests);
+  EXPECT_EQ(ctx_.getBatchStats("other").num_batches, 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * BatchMerger merges the asynchronous batches that a thread sends while the
+ * merger is active on it (see Scope), so that the leaves of many trees go out
+ * together instead of as one request per tree.
+ *
+ * The senders (e.g. AIClientT::act_batch_async) put their batches in a Group,
+ * one per destination, and get a future that flush() makes ready. So the
+ * futures must not be waited on before flush().
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <typeindex>
+#include <vector>
+
+namespace elf {
+namespace ai {
+
+class BatchMerger {
+ public:
+  class Group {
+   public:
+    virtual ~Group() = default;
+    // Send what was added since the last flush, and wait for the replies.
+    virtual void flush() = 0;
+  };
+
+  // The type of the group, the client and the targets it sends to.
+  using Key = std::tuple<std::type_index, const void*, std::vector<std::string>>;
+
+  // Makes merger the current one of this thread, until destroyed.
+  class Scope {
+   public:
+    explicit Scope(BatchMerger* merger) : prev_(current()) {
+      current() = merger;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+      current() = prev_;
+    }
+
+   private:
+    BatchMerger* prev_;
+  };
+
+  BatchMerger() {}
+
+  BatchMerger(const BatchMerger&) = delete;
+  BatchMerger& operator=(const BatchMerger&) = delete;
+
+  // Null unless a Scope is active on this thread.
+  static BatchMerger*& current() {
+    static thread_local BatchMerger* merger = nullptr;
+    return merger;
+  }
+
+  // The group of key, made by make() the first time.
+  template <typename G, typename Make>
+  G* getGroup(const Key& key, Make make) {
+    std::unique_ptr<Group>& group = groups_[key];
+    if (group == nullptr) {
+      group.reset(make());
+    }
+    return static_cast<G*>(group.get());
+  }
+
+  void flush() {
+    for (auto& p : groups_) {
+      p.second->flush();
+    }
+  }
+
+ private:
+  std::map<Key, std::unique_ptr<Group>> groups_;
+};
+
+} // namespace ai
+} // namespace elf
@@ -88,6 +88,21 @@ class MCTSAI_T : public AI_T<typename Actor::State, typename Actor::Action> {
     return true;
   }
 
+  // Search s in the background until the next act(), which then reuses
+  // the subtree of the move played. A no-op unless options().ponder and
+  // options().persistent_tree are set.
+  void startPondering(const State& s) {
+    if (!options_.ponder || !options_.persistent_tree) {
+      return;
+    }
+    align_state(s);
+    ts_->startPondering(s);
+  }
+
+  void stopPondering() {
+    ts_->stopPondering();
+  }
+
   bool endGame(const State&) override {
     resetTree();
     return true;
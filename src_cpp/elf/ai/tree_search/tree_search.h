@@ -8,14 +8,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
@@ -27,8 +34,12 @@
 #include "elf/logging/IndexedLoggerFactory.h"
 #include "elf/utils/member_check.h"
 
+#include "tree_search_batch_size.h"
+#include "tree_search_batched.h"
 #include "tree_search_node.h"
 #include "tree_search_options.h"
+#include "tree_search_pool.h"
+#include "tree_search_transposition.h"
 
 /*
  * Use the following function of S
@@ -66,10 +77,15 @@ class TreeSearchSingleThreadT {
  public:
   using Node = NodeT<State, Action>;
   using SearchTree = SearchTreeT<State, Action>;
+  using TranspositionTable = TranspositionTableT<Action>;
 
   TreeSearchSingleThreadT(int thread_id, const TSOptions& options)
       : threadId_(thread_id),
         options_(options),
+        batchSize_(
+            options.num_rollouts_per_batch,
+            options.min_rollouts_per_batch,
+            options.max_rollouts_per_batch),
         logger_(elf::logging::getIndexedLogger(
             "elf::ai::tree_search::TreeSearchSingleThreadT-",
             "")) {
@@ -84,14 +100,18 @@ class TreeSearchSingleThreadT {
     runInfoWhenStateReady_.push(num_rollout);
   }
 
+  // tt, if not nullptr, is shared with the other threads of the same tree.
   template <typename Actor>
   bool run(
       int run_id,
       const std::atomic_bool* stop_search,
       Actor& actor,
-      SearchTree& search_tree) {
+      SearchTree& search_tree,
+      TranspositionTable* tt = nullptr) {
     int num_rollout;
     runInfoWhenStateReady_.pop(&num_rollout);
+    stats_.reset();
+    batchSize_.restart();
 
     Node* root = search_tree.getRootNode();
     if (root == nullptr || root->getStatePtr() == nullptr) {
@@ -108,12 +128,33 @@ class TreeSearchSingleThreadT {
                << std::flush;
     }
 
-    for (int idx = 0;
-         idx < num_rollout && (stop_search == nullptr || !stop_search->load());
-         idx += options_.num_rollouts_per_batch) {
+    // Up to `depth` batches are being evaluated at any time. Their leaves
+    // carry virtual loss, so that the next batches pick other paths.
+    const size_t depth = getPipelineDepth<Actor>();
+    std::deque<std::unique_ptr<Batch>> in_flight;
+
+    int idx = 0;
+    while (idx < num_rollout &&
+           (stop_search == nullptr || !stop_search->load())) {
       // Start from the root and run one path
-      batch_rollouts<Actor>(
-          RunContext(run_id, idx, num_rollout), root, actor, search_tree);
+      in_flight.push_back(submit_batch<Actor>(
+          RunContext(run_id, idx, num_rollout),
+          root,
+          actor,
+          search_tree,
+          tt,
+          depth > 1));
+      idx += in_flight.back()->trajs.size();
+      while (in_flight.size() >= depth) {
+        complete_batch<Actor>(in_flight.front().get(), actor, tt);
+        in_flight.pop_front();
+      }
+    }
+    // Batches complete in submission order, so a leaf that an earlier batch
+    // of this thread locked is always evaluated before it is waited on.
+    while (!in_flight.empty()) {
+      complete_batch<Actor>(in_flight.front().get(), actor, tt);
+      in_flight.pop_front();
     }
 
     if (output_ != nullptr) {
@@ -121,18 +162,104 @@ class TreeSearchSingleThreadT {
                << "Done" << std::endl
                << std::flush;
     }
+    logBatchSize();
+    return true;
+  }
+
+  // Stepwise version of run(), for a driver that interleaves the rollouts
+  // of many trees on one thread (see BatchedSearchDriver). beginSteps()
+  // starts a run of num_rollout rollouts. Each startStep() selects a batch
+  // of leaves and sends it for evaluation, or returns false once the run is
+  // over; finishStep() waits for that batch and backpropagates it.
+  template <typename Actor>
+  bool beginSteps(
+      int run_id,
+      int num_rollout,
+      Actor& actor,
+      SearchTree& search_tree) {
+    stats_.reset();
+    batchSize_.restart();
+    stepRoot_ = search_tree.getRootNode();
+    if (stepRoot_ == nullptr || stepRoot_->getStatePtr() == nullptr) {
+      return false;
+    }
+    _set_ostream(actor);
+    stepRunId_ = run_id;
+    stepNumRollout_ = num_rollout;
+    stepIdx_ = 0;
+    return true;
+  }
+
+  template <typename Actor>
+  bool startStep(
+      const std::atomic_bool* stop_search,
+      Actor& actor,
+      SearchTree& search_tree,
+      TranspositionTable* tt = nullptr) {
+    if (stepIdx_ >= stepNumRollout_ ||
+        (stop_search != nullptr && stop_search->load())) {
+      logBatchSize();
+      return false;
+    }
+    stepBatch_ = submit_batch<Actor>(
+        RunContext(stepRunId_, stepIdx_, stepNumRollout_),
+        stepRoot_,
+        actor,
+        search_tree,
+        tt,
+        true);
+    stepIdx_ += stepBatch_->trajs.size();
     return true;
   }
 
+  template <typename Actor>
+  void finishStep(Actor& actor, TranspositionTable* tt = nullptr) {
+    complete_batch<Actor>(stepBatch_.get(), actor, tt);
+    stepBatch_.reset();
+  }
+
+  // Statistics of the last run. Only valid once the run has finished.
+  const SearchStats& getStats() const {
+    return stats_;
+  }
+
  private:
   int threadId_;
   const TSOptions& options_;
+  SearchStats stats_;
+  // Used if options_.adaptive_batch; kept across runs.
+  BatchSizeController batchSize_;
 
   struct Traj {
-    std::vector<std::pair<Node*, Action>> traj;
+    // Visited nodes and the index of the edge taken from each.
+    std::vector<std::pair<Node*, int>> traj;
     Node* leaf;
   };
 
+  // A batch of rollouts, from the selection of its leaves to backprop.
+  struct Batch {
+    RunContext ctx;
+    std::vector<Traj> trajs;
+    // Leaves this batch has to evaluate.
+    std::vector<Node*> locked_leaves;
+    std::vector<const State*> locked_states;
+    std::vector<uint64_t> locked_keys;
+    std::vector<NodeResponseT<Action>> resps;
+    // Valid while an asynchronous evaluation is in flight.
+    std::future<void> pending;
+    // Rollouts that ended on a leaf locked by another rollout.
+    int num_collisions = 0;
+
+    explicit Batch(const RunContext& ctx) : ctx(ctx) {}
+  };
+
+  // State of the stepwise run.
+  Node* stepRoot_ = nullptr;
+  int stepRunId_ = 0;
+  int stepNumRollout_ = 0;
+  int stepIdx_ = 0;
+  std::unique_ptr<Batch> stepBatch_;
+
   // TODO: The weird variable name below needs to change (ssengupta@fb)
   elf::concurrency::ConcurrentQueue<int> runInfoWhenStateReady_;
   std::unique_ptr<std::ostream> output_;
@@ -156,6 +283,40 @@ class TreeSearchSingleThreadT {
     return node->getValue();
   }
 
+  MEMBER_FUNC_CHECK(evaluate_async)
+  template <
+      typename Actor,
+      std::enable_if_t<has_func_evaluate_async<Actor>::value>* U = nullptr>
+  size_t getPipelineDepth() const {
+    return std::max(options_.pipeline_depth, 1);
+  }
+
+  template <
+      typename Actor,
+      std::enable_if_t<!has_func_evaluate_async<Actor>::value>* U = nullptr>
+  size_t getPipelineDepth() const {
+    return 1;
+  }
+
+  template <
+      typename Actor,
+      std::enable_if_t<has_func_evaluate_async<Actor>::value>* U = nullptr>
+  void startEvaluation(Actor& actor, Batch* batch, bool async) {
+    if (async) {
+      batch->pending =
+          actor.evaluate_async(batch->locked_states, &batch->resps);
+    } else {
+      actor.evaluate(batch->locked_states, &batch->resps);
+    }
+  }
+
+  template <
+      typename Actor,
+      std::enable_if_t<!has_func_evaluate_async<Actor>::value>* U = nullptr>
+  void startEvaluation(Actor& actor, Batch* batch, bool) {
+    actor.evaluate(batch->locked_states, &batch->resps);
+  }
+
   MEMBER_FUNC_CHECK(set_ostream)
   template <
       typename Actor,
@@ -197,49 +358,93 @@ class TreeSearchSingleThreadT {
     }
   }
 
+  // Expand the leaf from the transposition table if its state is there.
+  bool lookupTransposition(TranspositionTable* tt, uint64_t key, Node* leaf) {
+    if (tt == nullptr || key == 0) {
+      return false;
+    }
+    stats_.num_tt_lookups++;
+    auto entry = tt->lookup(key);
+    if (entry == nullptr) {
+      return false;
+    }
+    stats_.num_tt_hits++;
+    leaf->setEvaluation(*entry);
+    return true;
+  }
+
+  // Select the leaves of a batch and start evaluating the ones it locked.
+  // If async is false, the evaluation is done when this returns.
   template <typename Actor>
-  void batch_rollouts(
+  std::unique_ptr<Batch> submit_batch(
       const RunContext& ctx,
       Node* root,
       Actor& actor,
-      SearchTree& search_tree) {
-    // Start from the root and run one path
-    std::vector<Traj> trajs;
-    for (int j = 0; j < options_.num_rollouts_per_batch; ++j) {
-      trajs.push_back(single_rollout<Actor>(ctx, root, actor, search_tree));
+      SearchTree& search_tree,
+      TranspositionTable* tt,
+      bool async) {
+    std::unique_ptr<Batch> batch(new Batch(ctx));
+    const int batch_size = options_.adaptive_batch
+        ? batchSize_.size()
+        : options_.num_rollouts_per_batch;
+    for (int j = 0; j < batch_size; ++j) {
+      batch->trajs.push_back(
+          single_rollout<Actor>(ctx, root, actor, search_tree));
     }
 
-    // Now we want to batch create nodes.
-    std::vector<Node*> locked_leaves;
-    std::vector<const State*> locked_states;
-
-    std::unordered_map<Node*, std::pair<Traj*, int>> traj_counts;
-
     // For unlocked leaves, just let it go
     // Reason:
-    //   1. Other threads lock it
+    //   1. Other threads (or an earlier batch of ours) lock it
     //   2. Duplicated leaf.
-    for (Traj& traj : trajs) {
+    for (Traj& traj : batch->trajs) {
       if (traj.leaf->requestEvaluation()) {
-        locked_leaves.push_back(traj.leaf);
-        locked_states.push_back(traj.leaf->getStatePtr());
+        const State* state = traj.leaf->getStatePtr();
+        const uint64_t key =
+            tt != nullptr ? StateTrait<State, Action>::hash(*state) : 0;
+        if (!lookupTransposition(tt, key, traj.leaf)) {
+          batch->locked_leaves.push_back(traj.leaf);
+          batch->locked_states.push_back(state);
+          batch->locked_keys.push_back(key);
+        }
+      } else if (!traj.leaf->isVisited()) {
+        batch->num_collisions++;
       }
-
-      auto it = traj_counts.find(traj.leaf);
-      if (it == traj_counts.end())
-        traj_counts[traj.leaf] = std::make_pair(&traj, 1);
-      else
-        it->second.second++;
     }
 
+    stats_.num_collisions += batch->num_collisions;
+    stats_.num_rollouts += batch->trajs.size();
+    stats_.num_batches++;
+
     // Batch evaluate.
-    std::vector<NodeResponseT<Action>> resps;
-    actor.evaluate(locked_states, &resps);
+    startEvaluation(actor, batch.get(), async);
+    stats_.num_evaluations += batch->locked_states.size();
+    return batch;
+  }
 
-    for (size_t j = 0; j < locked_leaves.size(); ++j) {
+  // Wait for the evaluation of a batch, then expand its leaves and
+  // backpropagate.
+  template <typename Actor>
+  void complete_batch(Batch* batch, Actor& actor, TranspositionTable* tt) {
+    if (batch->pending.valid()) {
+      batch->pending.get();
+    }
+
+    for (size_t j = 0; j < batch->locked_leaves.size(); ++j) {
       // Now the node points to a recently created node.
       // Evaluate it and backpropagate.
-      locked_leaves[j]->setEvaluation(resps[j]);
+      batch->locked_leaves[j]->setEvaluation(batch->resps[j]);
+      if (batch->locked_keys[j] != 0) {
+        tt->insert(batch->locked_keys[j], batch->resps[j]);
+      }
+    }
+
+    std::unordered_map<Node*, std::pair<Traj*, int>> traj_counts;
+    for (Traj& traj : batch->trajs) {
+      auto it = traj_counts.find(traj.leaf);
+      if (it == traj_counts.end())
+        traj_counts[traj.leaf] = std::make_pair(&traj, 1);
+      else
+        it->second.second++;
     }
 
     for (auto& traj_pair : traj_counts) {
@@ -247,7 +452,15 @@ class TreeSearchSingleThreadT {
       Traj* traj = traj_pair.second.first;
       int count = traj_pair.second.second;
 
-      leaf->waitEvaluation();
+      if (!leaf->isVisited()) {
+        // Another thread is evaluating this leaf.
+        auto start = std::chrono::steady_clock::now();
+        leaf->waitEvaluation();
+        stats_.num_waits++;
+        stats_.wait_time_us += std::chrono::duration<double, std::micro>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+      }
       float reward = get_reward(actor, leaf);
       // PRINT_TS("Reward: " << reward << " Start backprop");
 
@@ -258,7 +471,23 @@ class TreeSearchSingleThreadT {
       }
     }
 
-    printHelper(ctx, "Done backprop");
+    if (options_.adaptive_batch) {
+      batchSize_.feed(
+          batch->trajs.size(), batch->trajs.size() - batch->num_collisions);
+    }
+
+    printHelper(batch->ctx, "Done backprop");
+  }
+
+  void logBatchSize() {
+    if (options_.adaptive_batch && options_.verbose_time) {
+      logger_->info(
+          "[{}] Batch size: {} (avg {:.1f}), {:.0f} useful leaves/s",
+          threadId_,
+          batchSize_.size(),
+          stats_.avgBatchSize(),
+          batchSize_.rate());
+    }
   }
 
   template <typename Actor>
@@ -272,24 +501,25 @@ class TreeSearchSingleThreadT {
     Traj traj;
     while (node->isVisited()) {
       // If there is no move available, skip.
-      Action action;
-      bool has_move =
-          node->findMove(options_.alg_opt, ctx.depth, &action, output_.get());
+      int edge_idx;
+      bool has_move = node->findMove(
+          options_.alg_opt, ctx.depth, &edge_idx, output_.get());
       if (!has_move) {
         printHelper(ctx, "No available action");
         break;
       }
+      const Action& action = node->getEdge(edge_idx).action;
 
       // PRINT_TS(" Action: " << action);
 
       // Add virtual loss if there is any.
       if (options_.virtual_loss > 0) {
-        node->addVirtualLoss(action, options_.virtual_loss);
+        node->addVirtualLoss(edge_idx, options_.virtual_loss);
       }
 
       // Save trajectory.
-      traj.traj.push_back(std::make_pair(node, action));
-      NodeId next = node->followEdge(action, search_tree);
+      traj.traj.push_back(std::make_pair(node, edge_idx));
+      NodeId next = node->followEdge(edge_idx, search_tree);
       // PRINT_TS(" Descent node id: " << next);
 
       assert(node->getStatePtr());
@@ -330,18 +560,49 @@ class TreeSearchT {
   using TreeSearchSingleThread = TreeSearchSingleThreadT<State, Action>;
   using SearchTree = SearchTreeT<State, Action>;
   using MCTSResult = MCTSResultT<Action>;
+  using TranspositionTable = TranspositionTableT<Action>;
 
   TreeSearchT(const TSOptions& options, std::function<Actor*(int)> actor_gen)
       : options_(options),
         stopSearch_(false),
+        stopRun_(false),
         logger_(elf::logging::getIndexedLogger(
             "elf::ai::tree_search::TreeSearchT-",
             "")) {
+    if (options.use_transposition_table) {
+      tt_.reset(new TranspositionTable());
+    }
+    // With a persistent tree, free the discarded subtrees off the game thread.
+    searchTree_.setBackgroundReclaim(options.persistent_tree);
+
+    if (options.use_batched_driver) {
+      // The driver steps the whole rollout budget on a single search slot.
+      treeSearches_.emplace_back(new TreeSearchSingleThread(0, options_));
+      actors_.emplace_back(actor_gen(0));
+      driver_ = &BatchedSearchDriver::getShared(options.batched_driver_workers);
+      driverWorker_ = driver_->assignWorker();
+      return;
+    }
+
     for (int i = 0; i < options.num_threads; ++i) {
       treeSearches_.emplace_back(new TreeSearchSingleThread(i, options_));
       actors_.emplace_back(actor_gen(i));
     }
 
+    if (options.use_shared_pool) {
+      // Rollouts are submitted to the shared pool in run().
+      pool_ = &SearchWorkerPool::getShared(
+          options.shared_pool_threads, options.eval_batchsize);
+      if (static_cast<int>(pool_->size()) < options.eval_batchsize) {
+        logger_->warn(
+            "Shared pool has {} threads, fewer than the eval batchsize {}; "
+            "batches will only be flushed by timeouts",
+            pool_->size(),
+            options.eval_batchsize);
+      }
+      return;
+    }
+
     for (int i = 0; i < options.num_threads; ++i) {
       TreeSearchSingleThread* th = treeSearches_[i].get();
       threadPool_.emplace_back(std::thread{[i, this, th]() {
@@ -350,9 +611,10 @@ class TreeSearchT {
           th->run(
               counter,
               // &this->done_.flag(),
-              &this->stopSearch_,
+              &this->stopRun_,
               *this->actors_[i],
-              this->searchTree_);
+              this->searchTree_,
+              this->tt_.get());
 
           // if (this->done_.get()) {
           if (this->stopSearch_.load()) {
@@ -408,7 +670,11 @@ class TreeSearchT {
   }
 
   MCTSResult run(const State& root_state) {
+    stopPondering();
+    const int ponder_rollouts = ponderRollouts_;
+    ponderRollouts_ = 0;
     setRootNodeState(root_state);
+    const int64_t num_pruned = enforceNodeBudgets();
 
     if (options_.root_epsilon > 0.0) {
       Node* root = searchTree_.getRootNode();
@@ -416,25 +682,98 @@ class TreeSearchT {
           options_.root_epsilon, options_.root_alpha, actors_[0]->rng());
     }
 
-    notifySearches(options_.num_rollouts_per_thread);
+    const auto start = std::chrono::steady_clock::now();
+    const int visits_at_start = searchTree_.getRootNode()->getNumVisits();
+    stopRun_ = false;
+
+    startRollouts(options_.num_rollouts_per_thread);
 
     // Wait until all tree searches are done.
-    treeReady_.waitUntilCount(threadPool_.size());
+    typename MCTSResult::StopReason stop_reason =
+        waitSearches(start, visits_at_start);
     treeReady_.reset();
 
-    return chooseAction();
+    MCTSResult result = chooseAction();
+    for (const auto& ts : treeSearches_) {
+      result.stats.add(ts->getStats());
+    }
+    result.memory = getMemoryStats();
+    result.memory.num_pruned_nodes = num_pruned;
+    result.stop_reason = stop_reason;
+    result.ponder_rollouts = ponder_rollouts;
+    result.search_time_ms = std::chrono::duration<float, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    const int num_rollouts = result.stats.num_rollouts;
+    const int num_skipped = getRolloutBudget() - num_rollouts;
+    if (stop_reason == MCTSResult::EARLY_STOP && num_rollouts > 0 &&
+        num_skipped > 0) {
+      result.time_saved_ms = result.search_time_ms * num_skipped / num_rollouts;
+    }
+    return result;
+  }
+
+  // Keep running rollouts on root_state in the background, e.g. while the
+  // opponent thinks, until the next call that changes the tree. Pondering
+  // stops at the node budgets (and options_.ponder_max_tree_nodes), and
+  // idles so that the search threads are busy options_.ponder_cpu_share of
+  // the time.
+  void startPondering(const State& root_state) {
+    stopPondering();
+    setRootNodeState(root_state);
+    if (!ponderHasRoom()) {
+      return;
+    }
+    stopRun_ = false;
+    ponderThread_ = std::thread([this]() { this->ponder(); });
+  }
+
+  // Cancel pondering; the rollouts in flight finish their batch.
+  void stopPondering() {
+    if (ponderThread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(ponderMutex_);
+        stopRun_ = true;
+      }
+      ponderCond_.notify_all();
+      ponderThread_.join();
+    }
   }
 
   void treeAdvance(const Action& action) {
+    stopPondering();
     searchTree_.treeAdvance(action);
   }
 
+  TreeMemoryStats getMemoryStats() const {
+    TreeMemoryStats stats;
+    stats.tree_nodes = searchTree_.getMemory().nodes();
+    stats.tree_bytes = searchTree_.getMemory().bytes();
+    stats.total_nodes = TreeMemory::global().nodes();
+    stats.total_bytes = TreeMemory::global().bytes();
+    return stats;
+  }
+
+  // The transposition table, if any, is kept across treeAdvance() since its
+  // entries do not depend on the tree, and is dropped with the tree here.
   void clear() {
+    stopPondering();
+    ponderRollouts_ = 0;
     searchTree_.clear();
+    if (tt_ != nullptr) {
+      tt_->clear();
+    }
   }
 
   void stop() {
+    stopPondering();
     stopSearch_ = true;
+    stopRun_ = true;
+
+    if (pool_ != nullptr || driver_ != nullptr) {
+      // No search is in flight outside of run().
+      return;
+    }
 
     notifySearches(0);
 
@@ -452,29 +791,249 @@ class TreeSearchT {
   }
 
  private:
-  // Multiple threads.
+  // Multiple threads (unused when running on the shared pool).
   std::vector<std::thread> threadPool_;
+  SearchWorkerPool* pool_ = nullptr;
+  BatchedSearchDriver* driver_ = nullptr;
+  int driverWorker_ = 0;
+  int runCounter_ = 0;
   std::vector<std::unique_ptr<TreeSearchSingleThread>> treeSearches_;
   std::vector<std::unique_ptr<Actor>> actors_;
 
   std::unique_ptr<std::ostream> output_;
 
   SearchTree searchTree_;
+  std::unique_ptr<TranspositionTable> tt_;
 
   TSOptions options_;
   std::atomic<bool> stopSearch_;
+  // Stops the rollouts of the current run() (set by stop() as well).
+  std::atomic<bool> stopRun_;
   // Notif done_;
   elf::concurrency::Counter<size_t> treeReady_;
   elf::concurrency::Counter<size_t> countStoppedThreads_;
 
+  // Runs the rollouts of pondering, one chunk at a time.
+  std::thread ponderThread_;
+  std::mutex ponderMutex_;
+  std::condition_variable ponderCond_;
+  // Rollouts pondered since the last run.
+  int ponderRollouts_ = 0;
+
   std::shared_ptr<spdlog::logger> logger_;
 
+  // Start num_rollouts_per_thread rollouts on each search; treeReady_
+  // counts the searches that are done.
+  void startRollouts(int num_rollouts_per_thread) {
+    if (driver_ != nullptr) {
+      submitBatchedSearch(num_rollouts_per_thread * options_.num_threads);
+    } else {
+      notifySearches(num_rollouts_per_thread);
+      if (pool_ != nullptr) {
+        submitSearches();
+      }
+    }
+  }
+
   void notifySearches(int num_rollout) {
     for (size_t i = 0; i < treeSearches_.size(); ++i) {
       treeSearches_[i]->notifyReady(num_rollout);
     }
   }
 
+  void submitSearches() {
+    const int run_id = runCounter_++;
+    for (size_t i = 0; i < treeSearches_.size(); ++i) {
+      pool_->submit([this, i, run_id]() {
+        this->treeSearches_[i]->run(
+            run_id,
+            &this->stopRun_,
+            *this->actors_[i],
+            this->searchTree_,
+            this->tt_.get());
+        this->treeReady_.increment();
+      });
+    }
+  }
+
+  void submitBatchedSearch(int num_rollout) {
+    TreeSearchSingleThread* th = treeSearches_[0].get();
+    Actor* actor = actors_[0].get();
+    if (!th->beginSteps(runCounter_++, num_rollout, *actor, searchTree_)) {
+      treeReady_.increment();
+      return;
+    }
+
+    BatchedSearchDriver::Job job;
+    job.start_step = [this, th, actor]() {
+      return th->startStep(
+          &this->stopRun_, *actor, this->searchTree_, this->tt_.get());
+    };
+    job.finish_step = [this, th, actor]() {
+      th->finishStep(*actor, this->tt_.get());
+    };
+    job.done = [this]() { this->treeReady_.increment(); };
+    driver_->submit(driverWorker_, std::move(job));
+  }
+
+  int getRolloutBudget() const {
+    return options_.num_threads * options_.num_rollouts_per_thread;
+  }
+
+  // Nodes to prune so that a run fits in the node budgets. A rollout adds
+  // at most one node.
+  int64_t getNodeExcess() const {
+    const int64_t headroom = getRolloutBudget();
+    int64_t excess = 0;
+    if (options_.max_tree_nodes > 0) {
+      excess = std::max(
+          excess,
+          searchTree_.getMemory().nodes() + headroom - options_.max_tree_nodes);
+    }
+    if (options_.max_total_tree_nodes > 0) {
+      excess = std::max(
+          excess,
+          TreeMemory::global().nodes() + headroom -
+              options_.max_total_tree_nodes);
+    }
+    return excess;
+  }
+
+  // Prune the tree before a run that could go over the node budgets.
+  // Return the number of nodes pruned.
+  int64_t enforceNodeBudgets() {
+    if (getNodeExcess() <= 0) {
+      return 0;
+    }
+    // Subtrees being reclaimed count as well; let them go first.
+    searchTree_.waitReclaim();
+    const int64_t excess = getNodeExcess();
+    if (excess <= 0) {
+      return 0;
+    }
+    // Prune an extra 1/8 of the tree, so that the next runs need not.
+    const int64_t num_nodes = searchTree_.getMemory().nodes();
+    const int64_t num_pruned =
+        searchTree_.prune(num_nodes - excess - num_nodes / 8);
+    if (options_.verbose) {
+      logger_->info(
+          "Pruned {} of {} nodes to fit the node budget",
+          num_pruned,
+          num_nodes);
+    }
+    return num_pruned;
+  }
+
+  // Whether a chunk of pondering fits in the node budgets.
+  bool ponderHasRoom() const {
+    if (options_.ponder_max_tree_nodes > 0 &&
+        searchTree_.getMemory().nodes() + getRolloutBudget() >
+            options_.ponder_max_tree_nodes) {
+      return false;
+    }
+    return getNodeExcess() <= 0;
+  }
+
+  // Body of ponderThread_: a move's worth of rollouts at a time, until
+  // stopPondering() or the tree is full. Never prunes, so that the run
+  // after it finds the pondered subtrees.
+  void ponder() {
+    const float share =
+        std::min(std::max(options_.ponder_cpu_share, 0.01f), 1.0f);
+    while (!stopRun_.load() && ponderHasRoom()) {
+      const auto start = std::chrono::steady_clock::now();
+      startRollouts(options_.num_rollouts_per_thread);
+      treeReady_.waitUntilCount(treeSearches_.size());
+      treeReady_.reset();
+      for (const auto& ts : treeSearches_) {
+        ponderRollouts_ += ts->getStats().num_rollouts;
+      }
+
+      if (share < 1.0f) {
+        const auto busy = std::chrono::steady_clock::now() - start;
+        std::unique_lock<std::mutex> lock(ponderMutex_);
+        ponderCond_.wait_for(lock, busy * ((1 - share) / share), [this]() {
+          return this->stopRun_.load();
+        });
+      }
+    }
+    if (options_.verbose) {
+      logger_->info(
+          "Pondered {} rollouts, {} tree nodes",
+          ponderRollouts_,
+          searchTree_.getMemory().nodes());
+    }
+  }
+
+  // Whether the most visited child of the root is settled: its lead over
+  // the runner-up is larger than the rollouts left.
+  bool bestMoveSettled(int visits_at_start) const {
+    const Node* root = searchTree_.getRootNode();
+    int best = 0;
+    int second = 0;
+    for (int i = 0; i < root->getNumEdges(); ++i) {
+      const int n = root->getEdgeInfo(i).num_visits;
+      if (n > best) {
+        second = best;
+        best = n;
+      } else if (n > second) {
+        second = n;
+      }
+    }
+    // Visits lost to collisions make this an overestimate, which is safe.
+    const int left =
+        getRolloutBudget() - (root->getNumVisits() - visits_at_start);
+    return best - second > left;
+  }
+
+  // Wait for the tree searches of a run. With a time budget or early stop,
+  // poll them and raise stopRun_ when the time is out or the best move is
+  // settled.
+  typename MCTSResult::StopReason waitSearches(
+      std::chrono::steady_clock::time_point start,
+      int visits_at_start) {
+    const size_t n = treeSearches_.size();
+    const bool early_stop =
+        options_.early_stop && options_.pick_method == "most_visited";
+    const bool timed = options_.time_budget_ms > 0;
+
+    if (!early_stop && !timed) {
+      treeReady_.waitUntilCount(n);
+      return MCTSResult::ALL_ROLLOUTS;
+    }
+
+    const auto poll_interval = std::chrono::milliseconds(1);
+    const auto deadline =
+        start + std::chrono::milliseconds(options_.time_budget_ms);
+    auto stop_reason = MCTSResult::ALL_ROLLOUTS;
+
+    while (true) {
+      auto timeout = poll_interval;
+      if (timed && stop_reason == MCTSResult::ALL_ROLLOUTS) {
+        auto until_deadline =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+        timeout = early_stop
+            ? std::min(poll_interval, until_deadline)
+            : until_deadline;
+      }
+      if (treeReady_.waitUntilCount(n, timeout) >= n) {
+        return stop_reason;
+      }
+      if (stop_reason != MCTSResult::ALL_ROLLOUTS) {
+        // Already stopped; the threads finish their batch in flight.
+        continue;
+      }
+      if (timed && std::chrono::steady_clock::now() >= deadline) {
+        stop_reason = MCTSResult::TIME_BUDGET;
+        stopRun_ = true;
+      } else if (early_stop && bestMoveSettled(visits_at_start)) {
+        stop_reason = MCTSResult::EARLY_STOP;
+        stopRun_ = true;
+      }
+    }
+  }
+
   void setRootNodeState(const State& root_state) {
     Node* root = searchTree_.getRootNode();
 
@@ -13,6 +13,8 @@
 #include <type_traits>
 #include <utility>
 
+#include "elf/utils/rng.h"
+
 #include "tree_search_base.h"
 
 namespace elf {
@@ -61,16 +63,9 @@ MCTSResultT<typename Map::key_type> UniformRandom(const Map& vals) {
       is_same<typename Map::mapped_type, EdgeInfo>::value,
       "key type must be EdgeInfo");
 
-  static std::mt19937 rng(time(NULL));
-  static std::mutex mu;
-
   MCTSResult res;
 
-  int idx = 0;
-  {
-    std::lock_guard<mutex> lock(mu);
-    idx = rng() % vals.size();
-  }
+  int idx = elf_utils::thread_rng().below(vals.size());
   auto it = vals.begin();
   while (--idx >= 0) {
     ++it;
@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * NodeArenaT<T> is a chunked object pool addressed by dense integer ids.
+ *
+ * Objects live in fixed-size pages that are never moved or released until the
+ * arena is destroyed. Pages are reached through a two-level table whose
+ * directories are also installed on demand, so an id maps to its object with
+ * three array lookups and no lock, and the arena can grow to every
+ * non-negative Id. Fresh ids come from an atomic bump index. Released ids are
+ * kept in a small set of striped free lists; each thread pushes to and pops
+ * from its own stripe first, so concurrent search threads rarely touch the
+ * same list.
+ *
+ * Construction and destruction of the pooled objects happen in place, in
+ * allocate() and release(). clear() destroys every live object but keeps the
+ * pages around for the next use.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <typename T, int PageBits = 10, int DirBits = 10>
+class NodeArenaT {
+ public:
+  using Id = int;
+
+  static constexpr Id kPageSize = Id(1) << PageBits;
+  static constexpr Id kDirSize = Id(1) << DirBits;
+  // Ids are in [0, kCapacity).
+  static constexpr Id kCapacity = std::numeric_limits<Id>::max();
+  static constexpr Id kNumDirs =
+      static_cast<Id>((int64_t(kCapacity) >> (PageBits + DirBits)) + 1);
+  static constexpr int kNumFreeLists = 16;
+
+  NodeArenaT()
+      : dirs_(new std::atomic<Dir*>[kNumDirs]), next_(0), numFree_(0) {
+    for (Id i = 0; i < kNumDirs; ++i) {
+      dirs_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  NodeArenaT(const NodeArenaT&) = delete;
+  NodeArenaT& operator=(const NodeArenaT&) = delete;
+
+  ~NodeArenaT() {
+    clear();
+    for (Id i = 0; i < kNumDirs; ++i) {
+      delete dirs_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  // Construct a new object in place and return its id.
+  template <typename... Args>
+  Id allocate(Args&&... args) {
+    Id id = popFree();
+    if (id < 0) {
+      id = next_.fetch_add(1, std::memory_order_relaxed);
+      // Only reachable with about 2^31 nodes alive at once.
+      if (id < 0 || id >= kCapacity) {
+        next_.fetch_sub(1, std::memory_order_relaxed);
+        throw std::range_error("NodeArena: out of capacity");
+      }
+    }
+
+    Page* page = ensurePage(id);
+    const Id slot = id & (kPageSize - 1);
+    new (page->ptr(slot)) T(std::forward<Args>(args)...);
+    page->live[slot].store(true, std::memory_order_release);
+    return id;
+  }
+
+  // Destroy the object and recycle its id. The caller guarantees that no
+  // other thread still uses it.
+  void release(Id id) {
+    Page* page = getPage(id);
+    if (page == nullptr) {
+      return;
+    }
+    const Id slot = id & (kPageSize - 1);
+    if (!page->live[slot].exchange(false, std::memory_order_acq_rel)) {
+      return;
+    }
+    page->ptr(slot)->~T();
+
+    FreeList& fl = freeLists_[threadStripe()];
+    std::lock_guard<std::mutex> lock(fl.mutex);
+    fl.ids.push_back(id);
+    numFree_++;
+  }
+
+  // Destroy all live objects. Not thread-safe w.r.t. allocate() / get().
+  void clear() {
+    const Id n = std::min(next_.load(), kCapacity);
+    for (Id id = 0; id < n; ++id) {
+      Page* page = getPage(id);
+      const Id slot = id & (kPageSize - 1);
+      if (page != nullptr && page->live[slot].load()) {
+        page->live[slot].store(false);
+        page->ptr(slot)->~T();
+      }
+    }
+    for (auto& fl : freeLists_) {
+      std::lock_guard<std::mutex> lock(fl.mutex);
+      fl.ids.clear();
+    }
+    numFree_ = 0;
+    next_ = 0;
+  }
+
+  // Lock-free lookup. Return nullptr if the id is not live.
+  T* get(Id id) {
+    Page* page = getPage(id);
+    if (page == nullptr) {
+      return nullptr;
+    }
+    const Id slot = id & (kPageSize - 1);
+    return page->live[slot].load(std::memory_order_acquire) ? page->ptr(slot)
+                                                            : nullptr;
+  }
+
+  const T* get(Id id) const {
+    return const_cast<NodeArenaT*>(this)->get(id);
+  }
+
+  // Number of ids handed out by the bump index so far (live or recycled).
+  Id highWater() const {
+    return std::min(next_.load(), kCapacity);
+  }
+
+  Id numFree() const {
+    return numFree_.load();
+  }
+
+  Id numLive() const {
+    return highWater() - numFree();
+  }
+
+ private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  struct Page {
+    Storage storage[kPageSize];
+    std::atomic<bool> live[kPageSize];
+
+    Page() {
+      for (Id i = 0; i < kPageSize; ++i) {
+        live[i].store(false, std::memory_order_relaxed);
+      }
+    }
+
+    T* ptr(Id slot) {
+      return reinterpret_cast<T*>(&storage[slot]);
+    }
+  };
+
+  struct FreeList {
+    std::mutex mutex;
+    std::vector<Id> ids;
+  };
+
+  struct Dir {
+    std::atomic<Page*> pages[kDirSize];
+
+    Dir() {
+      for (Id i = 0; i < kDirSize; ++i) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    ~Dir() {
+      for (Id i = 0; i < kDirSize; ++i) {
+        delete pages[i].load(std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::unique_ptr<std::atomic<Dir*>[]> dirs_;
+  std::atomic<Id> next_;
+  std::atomic<Id> numFree_;
+  FreeList freeLists_[kNumFreeLists];
+
+  static int threadStripe() {
+    static std::atomic<int> counter(0);
+    thread_local int stripe = counter++ % kNumFreeLists;
+    return stripe;
+  }
+
+  Page* getPage(Id id) const {
+    if (id < 0 || id >= kCapacity) {
+      return nullptr;
+    }
+    const Dir* dir =
+        dirs_[id >> (PageBits + DirBits)].load(std::memory_order_acquire);
+    if (dir == nullptr) {
+      return nullptr;
+    }
+    return dir->pages[(id >> PageBits) & (kDirSize - 1)].load(
+        std::memory_order_acquire);
+  }
+
+  // Install the slot pointed to by *slot if it is still null, and return
+  // whichever object ends up there.
+  template <typename U>
+  static U* ensure(std::atomic<U*>* slot) {
+    U* cur = slot->load(std::memory_order_acquire);
+    if (cur != nullptr) {
+      return cur;
+    }
+    U* fresh = new U();
+    if (slot->compare_exchange_strong(cur, fresh, std::memory_order_acq_rel)) {
+      return fresh;
+    }
+    // Someone else installed it first.
+    delete fresh;
+    return cur;
+  }
+
+  Page* ensurePage(Id id) {
+    Dir* dir = ensure(&dirs_[id >> (PageBits + DirBits)]);
+    return ensure(&dir->pages[(id >> PageBits) & (kDirSize - 1)]);
+  }
+
+  Id popFree() {
+    if (numFree_.load(std::memory_order_relaxed) == 0) {
+      return -1;
+    }
+    const int start = threadStripe();
+    for (int i = 0; i < kNumFreeLists; ++i) {
+      FreeList& fl = freeLists_[(start + i) % kNumFreeLists];
+      std::unique_lock<std::mutex> lock(fl.mutex, std::try_to_lock);
+      if (!lock.owns_lock() || fl.ids.empty()) {
+        continue;
+      }
+      Id id = fl.ids.back();
+      fl.ids.pop_back();
+      numFree_--;
+      return id;
+    }
+    return -1;
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Compares NodeArenaT with the mutex-guarded unordered_map that SearchTreeT
+// used to store its nodes. Each thread allocates nodes and performs several
+// lookups per allocation, which roughly mimics tree descent.
+//
+// Usage: bench_tree_search_arena [num_nodes_per_thread] [lookups_per_node]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "tree_search_arena.h"
+
+namespace {
+
+struct FakeNode {
+  float q;
+  std::atomic<int> visits;
+  char padding[120];
+
+  FakeNode(float q) : q(q), visits(0) {}
+};
+
+class MapStore {
+ public:
+  int allocate(float q) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_[count_].reset(new FakeNode(q));
+    return count_++;
+  }
+
+  FakeNode* get(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = nodes_.find(id);
+    return it == nodes_.end() ? nullptr : it->second.get();
+  }
+
+ private:
+  std::unordered_map<int, std::unique_ptr<FakeNode>> nodes_;
+  int count_ = 0;
+  std::mutex mutex_;
+};
+
+class ArenaStore {
+ public:
+  int allocate(float q) {
+    return arena_.allocate(q);
+  }
+
+  FakeNode* get(int id) {
+    return arena_.get(id);
+  }
+
+ private:
+  elf::ai::tree_search::NodeArenaT<FakeNode> arena_;
+};
+
+template <typename Store>
+double run(int num_threads, int nodes_per_thread, int lookups_per_node) {
+  Store store;
+  // Shared ids, so that threads look up each other's nodes as well.
+  int root = store.allocate(0.0);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<int> ids{root};
+      unsigned seed = t + 1;
+      for (int i = 0; i < nodes_per_thread; ++i) {
+        for (int j = 0; j < lookups_per_node; ++j) {
+          seed = seed * 1103515245 + 12345;
+          FakeNode* n = store.get(ids[seed % ids.size()]);
+          n->visits.fetch_add(1, std::memory_order_relaxed);
+        }
+        ids.push_back(store.allocate(i));
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const double total_ops =
+      double(num_threads) * nodes_per_thread * (lookups_per_node + 1);
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      total_ops;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const int nodes_per_thread = argc > 1 ? std::atoi(argv[1]) : 20000;
+  const int lookups_per_node = argc > 2 ? std::atoi(argv[2]) : 20;
+
+  std::cout << "#nodes/thread: " << nodes_per_thread
+            << ", #lookups/node: " << lookups_per_node << std::endl;
+  for (int num_threads : {1, 2, 4, 8, 16}) {
+    double map_ns =
+        run<MapStore>(num_threads, nodes_per_thread, lookups_per_node);
+    double arena_ns =
+        run<ArenaStore>(num_threads, nodes_per_thread, lookups_per_node);
+    std::cout << "#threads: " << num_threads << ", map: " << map_ns
+              << " ns/op, arena: " << arena_ns
+              << " ns/op, speedup: " << map_ns / arena_ns << "x" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search_arena.h"
+
+#include <atomic>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree_search_node.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+namespace {
+
+struct Payload {
+  static std::atomic<int> numAlive;
+
+  int id;
+  int checksum;
+
+  Payload(int id) : id(id), checksum(id * 7 + 3) {
+    numAlive++;
+  }
+
+  ~Payload() {
+    numAlive--;
+  }
+};
+
+std::atomic<int> Payload::numAlive(0);
+
+// Small pages and directories so that the stress test crosses many of both.
+using SmallArena = NodeArenaT<Payload, 4, 8>;
+
+} // namespace
+
+TEST(NodeArenaTest, allocateAndGet) {
+  SmallArena arena;
+  std::vector<int> ids;
+  for (int i = 0; i < 100; ++i) {
+    ids.push_back(arena.allocate(i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    Payload* p = arena.get(ids[i]);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(p->id, i);
+  }
+  EXPECT_EQ(arena.numLive(), 100);
+  EXPECT_EQ(arena.get(-1), nullptr);
+  EXPECT_EQ(arena.get(100), nullptr);
+  EXPECT_EQ(arena.get(SmallArena::kCapacity), nullptr);
+}
+
+TEST(NodeArenaTest, releaseAndReuse) {
+  Payload::numAlive = 0;
+  {
+    SmallArena arena;
+    for (int i = 0; i < 40; ++i) {
+      arena.allocate(i);
+    }
+    for (int i = 0; i < 40; i += 2) {
+      arena.release(i);
+      EXPECT_EQ(arena.get(i), nullptr);
+    }
+    EXPECT_EQ(Payload::numAlive.load(), 20);
+    EXPECT_EQ(arena.numFree(), 20);
+
+    // Released ids are recycled before the bump index moves.
+    std::set<int> reused;
+    for (int i = 0; i < 20; ++i) {
+      reused.insert(arena.allocate(1000 + i));
+    }
+    EXPECT_EQ(reused.size(), 20u);
+    EXPECT_EQ(*reused.rbegin(), 38);
+    EXPECT_EQ(arena.highWater(), 40);
+    EXPECT_EQ(arena.numFree(), 0);
+
+    arena.clear();
+    EXPECT_EQ(Payload::numAlive.load(), 0);
+    EXPECT_EQ(arena.numLive(), 0);
+
+    arena.allocate(0);
+  }
+  // The destructor destroys what is still alive.
+  EXPECT_EQ(Payload::numAlive.load(), 0);
+}
+
+TEST(NodeArenaTest, concurrentStress) {
+  const int kNumThreads = 16;
+  const int kPerThread = 5000;
+
+  Payload::numAlive = 0;
+  SmallArena arena;
+  std::atomic<bool> failed(false);
+  std::vector<std::vector<int>> allIds(kNumThreads);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<int>& ids = allIds[t];
+      for (int i = 0; i < kPerThread; ++i) {
+        int value = t * kPerThread + i;
+        int id = arena.allocate(value);
+        ids.push_back(id);
+
+        // Look up our own node plus a recent one.
+        const Payload* p = arena.get(id);
+        if (p == nullptr || p->id != value || p->checksum != value * 7 + 3) {
+          failed = true;
+        }
+        if (ids[i / 2] >= 0) {
+          const Payload* q = arena.get(ids[i / 2]);
+          if (q == nullptr || q->checksum != q->id * 7 + 3) {
+            failed = true;
+          }
+        }
+
+        // Recycle a fraction of the nodes while others allocate.
+        if (i % 4 == 3) {
+          arena.release(ids[i - 1]);
+          ids[i - 1] = -1;
+        }
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+
+  EXPECT_FALSE(failed.load());
+
+  std::set<int> unique;
+  int live = 0;
+  for (const auto& ids : allIds) {
+    for (int id : ids) {
+      if (id < 0) {
+        continue;
+      }
+      live++;
+      unique.insert(id);
+      EXPECT_NE(arena.get(id), nullptr);
+    }
+  }
+  EXPECT_EQ(static_cast<int>(unique.size()), live);
+  EXPECT_EQ(arena.numLive(), live);
+  EXPECT_EQ(Payload::numAlive.load(), live);
+}
+
+TEST(NodeArenaTest, searchTreeAdvance) {
+  using Tree = SearchTreeT<int, int>;
+  Tree tree;
+
+  // Expand the root with three children and one grand child each.
+  NodeResponseT<int> resp;
+  resp.pi = {{0, 0.5}, {1, 0.3}, {2, 0.2}};
+  resp.value = 0.0;
+
+  Tree::Node* root = tree.getRootNode();
+  ASSERT_NE(root, nullptr);
+  root->setEvaluation(resp);
+  std::vector<NodeId> children;
+  for (int a = 0; a < 3; ++a) {
+    NodeId child = root->followEdge(root->findEdge(a), tree);
+    children.push_back(child);
+    tree[child]->setEvaluation(resp);
+    tree[child]->followEdge(tree[child]->findEdge(0), tree);
+  }
+  EXPECT_EQ(tree.getNumNodes(), 7u);
+
+  tree.treeAdvance(1);
+  EXPECT_EQ(tree.getNumNodes(), 2u);
+  EXPECT_EQ(tree[children[0]], nullptr);
+  EXPECT_EQ(tree[children[2]], nullptr);
+  EXPECT_EQ(tree.getRootNode(), tree[children[1]]);
+
+  // Freed ids are reused.
+  tree.addNode(0.0);
+  EXPECT_EQ(tree.getNumNodes(), 3u);
+
+  tree.clear();
+  EXPECT_EQ(tree.getNumNodes(), 1u);
+}
+
+TEST(NodeArenaTest, backgroundReclaim) {
+  using Tree = SearchTreeT<Payload, int>;
+  const int num_alive = Payload::numAlive;
+  {
+    Tree tree;
+    tree.setBackgroundReclaim(true);
+
+    NodeResponseT<int> resp;
+    resp.pi = {{0, 0.25}, {1, 0.25}, {2, 0.25}, {3, 0.25}};
+    resp.value = 0.0;
+
+    // Full 4-ary tree of depth 5, with a state in every node.
+    std::function<void(Tree::Node*, int)> expand = [&](Tree::Node* node,
+                                                       int depth) {
+      node->setStateIfUnset([depth]() { return new Payload(depth); });
+      if (depth == 0) {
+        return;
+      }
+      node->setEvaluation(resp);
+      for (int a = 0; a < 4; ++a) {
+        NodeId child = node->followEdge(node->findEdge(a), tree);
+        expand(tree[child], depth - 1);
+      }
+    };
+    expand(tree.getRootNode(), 5);
+    EXPECT_EQ(tree.getNumNodes(), 1365u);
+    EXPECT_EQ(Payload::numAlive.load(), num_alive + 1365);
+
+    tree.treeAdvance(2);
+    tree.waitReclaim();
+    EXPECT_EQ(tree.getNumNodes(), 341u);
+    EXPECT_EQ(Payload::numAlive.load(), num_alive + 341);
+    EXPECT_EQ(tree.getRootNode()->getStatePtr()->id, 4);
+
+    // A second move, left in flight when the tree goes away.
+    tree.treeAdvance(0);
+  }
+  EXPECT_EQ(Payload::numAlive.load(), num_alive);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -9,8 +9,10 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -21,7 +23,7 @@
 
 #include <nlohmann/json.hpp>
 
-#include "elf/logging/IndexedLoggerFactory.h"
+#include "elf/utils/rng.h"
 #include "elf/utils/utils.h"
 
 using json = nlohmann::json;
@@ -62,6 +64,12 @@ struct StateTrait {
     return s1 == s2;
   }
 
+  // Key for the transposition table: states with the same key get the same
+  // evaluation. 0 means the state has no key and is never shared.
+  static uint64_t hash(const S& /*s*/) {
+    return 0;
+  }
+
   static bool moves_since(
       const S& /*s*/,
       size_t* /*next_move_number*/,
@@ -109,8 +117,6 @@ struct EdgeInfo {
   int num_visits;
   float virtual_loss;
 
-  std::shared_ptr<spdlog::logger> logger_;
-
   EdgeInfo(float probability)
       : prior_probability(probability),
         child_node(InvalidNodeId),
@@ -171,6 +177,27 @@ struct EdgeInfo {
   }
 };
 
+inline void atomicAdd(std::atomic<float>* target, float delta) {
+  float curr = target->load(std::memory_order_relaxed);
+  while (!target->compare_exchange_weak(
+      curr, curr + delta, std::memory_order_relaxed)) {
+  }
+}
+
+// One child edge of an expanded node. A node keeps all of its edges in one
+// contiguous array; their statistics live in the node's UCTEdgeStats, laid
+// out for the UCT kernels.
+template <typename Action>
+struct EdgeT {
+  Action action;
+  std::atomic<NodeId> child_node;
+
+  EdgeT() : child_node(InvalidNodeId) {}
+
+  EdgeT(const EdgeT&) = delete;
+  EdgeT& operator=(const EdgeT&) = delete;
+};
+
 template <typename Action>
 struct MCTSPolicy {
   std::vector<std::pair<Action, float>> policy;
@@ -203,15 +230,94 @@ struct MCTSPolicy {
   }
 
   // Sample from the distribution.
-  Action sampleAction(std::mt19937* gen) const {
+  template <typename Gen>
+  Action sampleAction(Gen* gen) const {
     size_t i = elf_utils::sample_multinomial(policy, gen);
     return policy[i].first;
   }
 };
 
+// Per-search statistics, accumulated by each search thread and summed up
+// into MCTSResultT after every run.
+struct SearchStats {
+  // Leaves whose evaluation was already requested by another rollout.
+  int num_collisions = 0;
+  // Collisions that had to block until the evaluation arrived.
+  int num_waits = 0;
+  double wait_time_us = 0.0;
+  // States sent to the actor for evaluation.
+  int num_evaluations = 0;
+  // Transposition table lookups, and hits that skipped an evaluation.
+  int num_tt_lookups = 0;
+  int num_tt_hits = 0;
+  // Rollouts started.
+  int num_rollouts = 0;
+  // Batches of rollouts.
+  int num_batches = 0;
+
+  void reset() {
+    *this = SearchStats();
+  }
+
+  void add(const SearchStats& other) {
+    num_collisions += other.num_collisions;
+    num_waits += other.num_waits;
+    wait_time_us += other.wait_time_us;
+    num_evaluations += other.num_evaluations;
+    num_tt_lookups += other.num_tt_lookups;
+    num_tt_hits += other.num_tt_hits;
+    num_rollouts += other.num_rollouts;
+    num_batches += other.num_batches;
+  }
+
+  float avgBatchSize() const {
+    return num_batches > 0 ? float(num_rollouts) / num_batches : 0.0;
+  }
+
+  float ttHitRate() const {
+    return num_tt_lookups > 0 ? float(num_tt_hits) / num_tt_lookups : 0.0;
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "[rollouts=" << num_rollouts << "][collisions=" << num_collisions
+       << "][waits=" << num_waits << "][wait_ms=" << wait_time_us / 1000
+       << "][evals=" << num_evaluations << "][avg_batch=" << avgBatchSize()
+       << "]";
+    if (num_tt_lookups > 0) {
+      ss << "[tt_hits=" << num_tt_hits << "/" << num_tt_lookups
+         << "][tt_hit_rate=" << ttHitRate() << "]";
+    }
+    return ss.str();
+  }
+};
+
+// Size of a search tree, and of all the trees of the process. Bytes cover
+// the nodes, their edges and their states.
+struct TreeMemoryStats {
+  int64_t tree_nodes = 0;
+  int64_t tree_bytes = 0;
+  int64_t total_nodes = 0;
+  int64_t total_bytes = 0;
+  // Nodes pruned to stay within the node budgets.
+  int64_t num_pruned_nodes = 0;
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "[nodes=" << tree_nodes << "][kb=" << tree_bytes / 1024
+       << "][all_nodes=" << total_nodes << "][all_kb=" << total_bytes / 1024
+       << "]";
+    if (num_pruned_nodes > 0) {
+      ss << "[pruned=" << num_pruned_nodes << "]";
+    }
+    return ss.str();
+  }
+};
+
 template <typename Action>
 struct MCTSResultT {
   enum RankCriterion { MOST_VISITED = 0, PRIOR = 1, UNIFORM_RANDOM };
+  enum StopReason { ALL_ROLLOUTS = 0, EARLY_STOP, TIME_BUDGET };
 
   Action best_action;
   float root_value;
@@ -221,6 +327,15 @@ struct MCTSResultT {
   std::vector<std::pair<Action, EdgeInfo>> action_edge_pairs;
   int total_visits;
   RankCriterion action_rank_method;
+  SearchStats stats;
+  TreeMemoryStats memory;
+  StopReason stop_reason;
+  float search_time_ms;
+  // Estimated time of the rollouts skipped by an early stop.
+  float time_saved_ms;
+  // Rollouts pondered since the previous search. The subtree of the move
+  // played keeps part of them.
+  int ponder_rollouts;
 
   // TODO: Constructor should set action_rank_methhohd and
   //       action_edges ssengupta@fb.com
@@ -230,18 +345,22 @@ struct MCTSResultT {
         max_score(std::numeric_limits<float>::lowest()),
         best_edge_info(0),
         total_visits(0),
-        action_rank_method(MOST_VISITED) {}
+        action_rank_method(MOST_VISITED),
+        stop_reason(ALL_ROLLOUTS),
+        search_time_ms(0),
+        time_saved_ms(0),
+        ponder_rollouts(0) {}
 
   // TODO: This function should be private and called from the constructor
   //       ssengupta@fb.com
-  void addActions(const std::unordered_map<Action, EdgeInfo>& action_edges) {
-    static std::mt19937 rng(time(NULL));
+  void addActions(
+      const std::vector<std::pair<Action, EdgeInfo>>& action_edges) {
     int random_idx = 0;
 
     assert(action_edges.size() > 0);
 
     if (action_rank_method == UNIFORM_RANDOM) {
-      random_idx = rng() % action_edges.size();
+      random_idx = elf_utils::thread_rng().below(action_edges.size());
     }
 
     int index = 0;
@@ -348,7 +467,21 @@ struct MCTSResultT {
   std::string info() const {
     std::stringstream ss;
     ss << "BestA: " << ActionTrait<Action>::to_string(best_action)
-       << ", MaxScore: " << max_score << ", Info: " << best_edge_info.info();
+       << ", MaxScore: " << max_score << ", Info: " << best_edge_info.info()
+       << ", Stats: " << stats.info() << ", Tree: " << memory.info()
+       << ", Time: " << search_time_ms << " ms";
+    if (search_time_ms > 0) {
+      ss << ", " << int(stats.num_evaluations * 1000 / search_time_ms)
+         << " leaves/s";
+    }
+    if (stop_reason == EARLY_STOP) {
+      ss << " (early stop, saved ~" << time_saved_ms << " ms)";
+    } else if (stop_reason == TIME_BUDGET) {
+      ss << " (time budget)";
+    }
+    if (ponder_rollouts > 0) {
+      ss << ", Pondered: " << ponder_rollouts;
+    }
     return ss.str();
   }
 };
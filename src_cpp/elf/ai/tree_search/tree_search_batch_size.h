@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * BatchSizeController picks the number of rollouts per batch of a search
+ * thread, to get the most useful leaves per second out of the evaluator.
+ *
+ * Larger batches amortize the latency of an evaluation over more leaves,
+ * until the leaves of a batch start to collide: with virtual loss, rollouts
+ * of the same batch pile onto the same few leaves of a small tree, and all
+ * but one of them are wasted. A leaf is useful unless it collided.
+ *
+ * The controller hill-climbs: every few batches it compares the useful
+ * leaves per second of the last window with the one before, and keeps
+ * moving the size in the same direction while that improves. A window with
+ * too many collisions shrinks the batch right away. The size carries over
+ * from one move to the next.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+class BatchSizeController {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Batches per decision.
+  static constexpr int kWindow = 4;
+  // Shrink at once above this fraction of wasted leaves.
+  static constexpr float kMaxCollisionRate = 0.25;
+  // Rate changes below this are noise.
+  static constexpr float kTolerance = 0.02;
+
+  BatchSizeController(int initial, int min_size, int max_size)
+      : minSize_(std::max(min_size, 1)),
+        maxSize_(std::max(max_size, minSize_)),
+        size_(std::min(std::max(initial, minSize_), maxSize_)) {}
+
+  int size() const {
+    return size_;
+  }
+
+  // Useful leaves per second of the last full window (0 before the first).
+  float rate() const {
+    return lastRate_;
+  }
+
+  // Start a new run: the time until now is not search time.
+  void restart(Clock::time_point now = Clock::now()) {
+    windowStart_ = now;
+    windowBatches_ = 0;
+    windowLeaves_ = 0;
+    windowUseful_ = 0;
+  }
+
+  // A batch of num_leaves rollouts, num_useful of which did not collide,
+  // completed at now.
+  void feed(
+      int num_leaves,
+      int num_useful,
+      Clock::time_point now = Clock::now()) {
+    windowBatches_++;
+    windowLeaves_ += num_leaves;
+    windowUseful_ += num_useful;
+    if (windowBatches_ < kWindow) {
+      return;
+    }
+
+    const float seconds =
+        std::chrono::duration<float>(now - windowStart_).count();
+    const float rate = seconds > 0 ? windowUseful_ / seconds : 0;
+    const float collision_rate = windowLeaves_ > 0
+        ? 1.0f - float(windowUseful_) / windowLeaves_
+        : 0.0f;
+
+    if (collision_rate > kMaxCollisionRate) {
+      direction_ = -1;
+      // The rate at another size is not comparable any more.
+      prevRate_ = 0;
+    } else {
+      if (rate < prevRate_ * (1 - kTolerance)) {
+        direction_ = -direction_;
+      }
+      prevRate_ = rate;
+    }
+    lastRate_ = rate;
+
+    const int step = std::max(size_ / 4, 1);
+    size_ = std::min(std::max(size_ + direction_ * step, minSize_), maxSize_);
+    restart(now);
+  }
+
+ private:
+  const int minSize_;
+  const int maxSize_;
+  int size_;
+  int direction_ = 1;
+  float prevRate_ = 0;
+  float lastRate_ = 0;
+
+  Clock::time_point windowStart_ = Clock::now();
+  int windowBatches_ = 0;
+  int windowLeaves_ = 0;
+  int windowUseful_ = 0;
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
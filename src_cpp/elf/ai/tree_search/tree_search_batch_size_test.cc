@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+namespace {
+
+using Clock = BatchSizeController::Clock;
+
+// Feed batches to the controller on a simulated clock. A batch costs
+// latency_us plus per_leaf_us for each leaf; useful(size) of its leaves do
+// not collide.
+int simulate(
+    BatchSizeController* c,
+    int num_batches,
+    int latency_us,
+    int per_leaf_us,
+    std::function<int(int)> useful) {
+  Clock::time_point now = Clock::time_point();
+  c->restart(now);
+  for (int i = 0; i < num_batches; ++i) {
+    const int size = c->size();
+    now += std::chrono::microseconds(latency_us + per_leaf_us * size);
+    c->feed(size, useful(size), now);
+  }
+  return c->size();
+}
+
+// Five moves per position.
+struct TinyState {
+  int depth = 0;
+  int path = 0;
+};
+
+class TinyActor {
+ public:
+  using State = TinyState;
+  using Action = int;
+  using NodeResponse = NodeResponseT<int>;
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const TinyState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const TinyState& s, NodeResponse* resp) {
+    resp->pi.clear();
+    for (int a = 0; a < 5; ++a) {
+      resp->pi.emplace_back(a, 0.2);
+    }
+    resp->value = (s.path % 3) - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(TinyState& s, int a) {
+    s.depth++;
+    s.path = s.path * 5 + a;
+    return true;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+} // namespace
+
+template <>
+struct StateTrait<TinyState, int> {
+  static std::string to_string(const TinyState&) {
+    return "";
+  }
+  static bool equals(const TinyState& s1, const TinyState& s2) {
+    return s1.depth == s2.depth && s1.path == s2.path;
+  }
+  static uint64_t hash(const TinyState&) {
+    return 0;
+  }
+};
+
+TEST(BatchSizeTest, bounds) {
+  EXPECT_EQ(BatchSizeController(8, 1, 64).size(), 8);
+  EXPECT_EQ(BatchSizeController(100, 1, 64).size(), 64);
+  EXPECT_EQ(BatchSizeController(0, 2, 64).size(), 2);
+  EXPECT_EQ(BatchSizeController(8, 16, 4).size(), 16);
+}
+
+TEST(BatchSizeTest, growsWhileLatencyDominates) {
+  // An evaluation is mostly latency and nothing collides: the largest
+  // batches win.
+  BatchSizeController c(4, 1, 64);
+  EXPECT_EQ(simulate(&c, 200, 2000, 10, [](int n) { return n; }), 64);
+  EXPECT_GT(c.rate(), 0);
+}
+
+TEST(BatchSizeTest, shrinksOnCollisions) {
+  // At most 6 useful leaves per batch, e.g. a small tree.
+  BatchSizeController c(32, 1, 64);
+  const int size =
+      simulate(&c, 200, 2000, 10, [](int n) { return std::min(n, 6); });
+  EXPECT_GE(size, 4);
+  EXPECT_LE(size, 8);
+}
+
+TEST(BatchSizeTest, stopsAtCollisionCap) {
+  // Latency favors large batches, but half of the leaves beyond 12 collide:
+  // the collision cap stops the growth at about 24.
+  BatchSizeController c(2, 1, 64);
+  const int size = simulate(&c, 400, 200, 10, [](int n) {
+    return n <= 12 ? n : 12 + (n - 12) / 2;
+  });
+  EXPECT_GE(size, 12);
+  EXPECT_LE(size, 30);
+}
+
+TEST(BatchSizeTest, adaptiveSearch) {
+  TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 200;
+  options.num_rollouts_per_batch = 4;
+  options.virtual_loss = 1;
+  options.adaptive_batch = true;
+  options.min_rollouts_per_batch = 2;
+  options.max_rollouts_per_batch = 16;
+
+  TreeSearchT<TinyState, int, TinyActor> ts(
+      options, [](int) { return new TinyActor(); });
+  for (int run = 0; run < 3; ++run) {
+    MCTSResultT<int> result = ts.run(TinyState());
+    // The last batch of a thread may go over its share.
+    EXPECT_GE(result.stats.num_rollouts, 400);
+    EXPECT_LT(result.stats.num_rollouts, 400 + 2 * 16);
+    EXPECT_GE(result.stats.avgBatchSize(), 2.0f);
+    EXPECT_LE(result.stats.avgBatchSize(), 16.0f);
+    ts.clear();
+  }
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * BatchedSearchDriver advances the searches of many trees from a few worker
+ * threads, in lockstep.
+ *
+ * A search run is submitted as a Job. Each step of a worker sends one batch
+ * of leaves of every tree it has for evaluation, and then backpropagates
+ * them all. So the evaluations of all the trees of a worker are in flight at
+ * the same time, while the trees need no thread of their own: this is leaf
+ * parallelism across games instead of within a game. The batches that the
+ * trees of a worker send with AIClientT::act_batch_async are merged by a
+ * BatchMerger, so that they go out as one act_batch per destination rather
+ * than one request per tree.
+ *
+ * Trees are pinned to a worker (assignWorker()), so a tree is only ever
+ * touched by one thread. The process-wide instance is created lazily by
+ * getShared(); its size is fixed by the first caller.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/batch_merger.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+class BatchedSearchDriver {
+ public:
+  // One search run on a tree. start_step() selects a batch of leaves and
+  // sends it for evaluation, or returns false once the run is over;
+  // finish_step() waits for that batch and backpropagates it. done() is
+  // called after the last step.
+  struct Job {
+    std::function<bool()> start_step;
+    std::function<void()> finish_step;
+    std::function<void()> done;
+  };
+
+  explicit BatchedSearchDriver(int num_workers) {
+    num_workers = std::max(num_workers, 1);
+    for (int i = 0; i < num_workers; ++i) {
+      workers_.emplace_back(new Worker);
+    }
+    for (auto& w : workers_) {
+      Worker* worker = w.get();
+      worker->thread = std::thread([worker]() { loop(worker); });
+    }
+  }
+
+  BatchedSearchDriver(const BatchedSearchDriver&) = delete;
+  BatchedSearchDriver& operator=(const BatchedSearchDriver&) = delete;
+
+  ~BatchedSearchDriver() {
+    for (auto& w : workers_) {
+      {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->done = true;
+      }
+      w->cv.notify_one();
+    }
+    for (auto& w : workers_) {
+      w->thread.join();
+    }
+  }
+
+  // Worker for a new tree, round-robin.
+  int assignWorker() {
+    return nextWorker_++ % workers_.size();
+  }
+
+  void submit(int worker, Job job) {
+    Worker* w = workers_[worker].get();
+    {
+      std::lock_guard<std::mutex> lock(w->mutex);
+      w->jobs.push_back(std::move(job));
+    }
+    w->cv.notify_one();
+  }
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  // Process-wide driver. Only the first call decides the number of workers.
+  static BatchedSearchDriver& getShared(int num_workers = 1) {
+    static BatchedSearchDriver driver(num_workers);
+    return driver;
+  }
+
+ private:
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool done = false;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<unsigned> nextWorker_{0};
+
+  static void loop(Worker* w) {
+    std::vector<Job> active;
+    std::vector<bool> started;
+    BatchMerger merger;
+
+    while (true) {
+      {
+        // Only block when there is nothing to step.
+        std::unique_lock<std::mutex> lock(w->mutex);
+        if (active.empty()) {
+          w->cv.wait(lock, [w]() { return w->done || !w->jobs.empty(); });
+          if (w->jobs.empty()) {
+            return;
+          }
+        }
+        while (!w->jobs.empty()) {
+          active.push_back(std::move(w->jobs.front()));
+          w->jobs.pop_front();
+        }
+      }
+
+      // Collect a batch of every tree first, send them all at once, then
+      // backpropagate.
+      started.assign(active.size(), false);
+      {
+        BatchMerger::Scope scope(&merger);
+        for (size_t i = 0; i < active.size(); ++i) {
+          started[i] = active[i].start_step();
+        }
+      }
+      merger.flush();
+      for (size_t i = 0; i < active.size(); ++i) {
+        if (started[i]) {
+          active[i].finish_step();
+        }
+      }
+
+      // Retire the runs that are over.
+      size_t k = 0;
+      for (size_t i = 0; i < active.size(); ++i) {
+        if (started[i]) {
+          if (k != i) {
+            active[k] = std::move(active[i]);
+          }
+          k++;
+        } else {
+          active[i].done();
+        }
+      }
+      active.resize(k);
+    }
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+#include "elf/ai/batch_merger.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 16 moves per position, for 3 plies.
+struct PathState {
+  int depth = 0;
+  int path = 0;
+};
+
+// Batches in flight over all the actors.
+std::atomic<int> g_in_flight(0);
+std::atomic<int> g_max_in_flight(0);
+
+// Evaluates on another thread, as a network server would.
+class PathActor {
+ public:
+  using State = PathState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  std::atomic<int> numEvaluated{0};
+  std::thread::id evalThread;
+  // Whether the batches were sent under a BatchMerger.
+  std::atomic<bool> merged{false};
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const PathState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  std::future<void> evaluate_async(
+      const std::vector<const PathState*>& states,
+      std::vector<NodeResponse>* resps) {
+    evalThread = std::this_thread::get_id();
+    merged = elf::ai::BatchMerger::current() != nullptr;
+    int n = ++g_in_flight;
+    int m = g_max_in_flight.load();
+    while (n > m && !g_max_in_flight.compare_exchange_weak(m, n)) {
+    }
+    return std::async(std::launch::async, [this, states, resps]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      evaluate(states, resps);
+      g_in_flight--;
+    });
+  }
+
+  void evaluate(const PathState& s, NodeResponse* resp) {
+    numEvaluated++;
+    resp->pi.clear();
+    if (s.depth < 3) {
+      for (int a = 0; a < 16; ++a) {
+        resp->pi.emplace_back(a, 1.0 / 16);
+      }
+    }
+    resp->value = (s.path % 5) / 2.0 - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(PathState& s, int a) {
+    s.depth++;
+    s.path = s.path * 16 + a;
+    return true;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+elf::ai::tree_search::TSOptions batchedOptions() {
+  elf::ai::tree_search::TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 32;
+  options.num_rollouts_per_batch = 4;
+  options.virtual_loss = 1;
+  options.use_batched_driver = true;
+  options.batched_driver_workers = 1;
+  return options;
+}
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<PathState, int> {
+  static std::string to_string(const PathState&) {
+    return "";
+  }
+  static bool equals(const PathState& s1, const PathState& s2) {
+    return s1.depth == s2.depth && s1.path == s2.path;
+  }
+  static uint64_t hash(const PathState&) {
+    return 0;
+  }
+};
+
+using Search = TreeSearchT<PathState, int, PathActor>;
+
+TEST(BatchedDriverTest, singleTree) {
+  PathActor* actor = nullptr;
+  Search ts(batchedOptions(), [&](int) {
+    actor = new PathActor();
+    return actor;
+  });
+  EXPECT_EQ(ts.getNumActors(), 1);
+
+  for (int run = 0; run < 2; ++run) {
+    MCTSResultT<int> result = ts.run(PathState());
+    EXPECT_EQ(result.stats.num_rollouts, 64);
+    EXPECT_EQ(result.stats.num_evaluations, actor->numEvaluated.load());
+    EXPECT_NE(actor->evalThread, std::this_thread::get_id());
+    ts.clear();
+    actor->numEvaluated = 0;
+  }
+}
+
+// The trees of several games, searched at the same time from their own
+// game threads, have their batches in flight together.
+TEST(BatchedDriverTest, treesInLockstep) {
+  const int num_games = 8;
+  std::vector<std::unique_ptr<Search>> searches;
+  std::vector<PathActor*> actors(num_games);
+  for (int i = 0; i < num_games; ++i) {
+    searches.emplace_back(new Search(batchedOptions(), [&, i](int) {
+      actors[i] = new PathActor();
+      return actors[i];
+    }));
+  }
+
+  g_max_in_flight = 0;
+  std::vector<MCTSResultT<int>> results(num_games);
+  std::vector<std::thread> games;
+  for (int i = 0; i < num_games; ++i) {
+    games.emplace_back([&, i]() { results[i] = searches[i]->run(PathState()); });
+  }
+  for (auto& g : games) {
+    g.join();
+  }
+
+  for (int i = 0; i < num_games; ++i) {
+    EXPECT_EQ(results[i].stats.num_rollouts, 64);
+    EXPECT_EQ(results[i].stats.num_evaluations, actors[i]->numEvaluated.load());
+    EXPECT_GT(results[i].total_visits, 0);
+    EXPECT_TRUE(actors[i]->merged.load());
+  }
+  // One worker, one batch per tree at a time.
+  EXPECT_GT(g_max_in_flight.load(), 1);
+  EXPECT_LE(g_max_in_flight.load(), num_games);
+  EXPECT_EQ(g_in_flight.load(), 0);
+}
+
+TEST(BatchedDriverTest, timeBudget) {
+  TSOptions options = batchedOptions();
+  options.num_rollouts_per_thread = 100000;
+  options.time_budget_ms = 20;
+  Search ts(options, [](int) { return new PathActor(); });
+
+  MCTSResultT<int> result = ts.run(PathState());
+  EXPECT_EQ(result.stop_reason, MCTSResultT<int>::TIME_BUDGET);
+  EXPECT_LT(result.stats.num_rollouts, 200000);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
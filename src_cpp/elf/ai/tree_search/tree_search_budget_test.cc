@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Five moves per position. Move 0 is clearly the best one.
+struct LineState {
+  int depth = 0;
+  int last = 0;
+};
+
+class SlowActor {
+ public:
+  using State = LineState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  explicit SlowActor(int delay_us) : delayUs_(delay_us) {}
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const LineState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const LineState& s, NodeResponse* resp) {
+    std::this_thread::sleep_for(std::chrono::microseconds(delayUs_));
+    resp->pi = {{0, 0.8}, {1, 0.05}, {2, 0.05}, {3, 0.05}, {4, 0.05}};
+    // Values are from the point of view of the player who just moved.
+    resp->value = s.last == 0 ? 0.5 : -0.5;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(LineState& s, int a) {
+    s.depth++;
+    s.last = a;
+    return true;
+  }
+
+ private:
+  int delayUs_;
+  std::mt19937 rng_;
+};
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<LineState, int> {
+  static std::string to_string(const LineState&) {
+    return "";
+  }
+  static bool equals(const LineState& s1, const LineState& s2) {
+    return s1.depth == s2.depth && s1.last == s2.last;
+  }
+  static uint64_t hash(const LineState&) {
+    return 0;
+  }
+};
+
+using TS = TreeSearchT<LineState, int, SlowActor>;
+
+TEST(BudgetTest, earlyStop) {
+  TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 500;
+  options.num_rollouts_per_batch = 1;
+
+  MCTSResultT<int> results[2];
+  for (int early_stop = 0; early_stop < 2; ++early_stop) {
+    options.early_stop = early_stop == 1;
+    TS ts(options, [](int) { return new SlowActor(50); });
+    results[early_stop] = ts.run(LineState());
+  }
+
+  const MCTSResultT<int>& full = results[0];
+  const MCTSResultT<int>& early = results[1];
+  EXPECT_EQ(full.stop_reason, MCTSResultT<int>::ALL_ROLLOUTS);
+  EXPECT_EQ(full.stats.num_rollouts, 1000);
+  EXPECT_EQ(full.time_saved_ms, 0.0f);
+
+  EXPECT_EQ(early.stop_reason, MCTSResultT<int>::EARLY_STOP);
+  EXPECT_LT(early.stats.num_rollouts, 1000);
+  EXPECT_GT(early.time_saved_ms, 0.0f);
+  EXPECT_EQ(early.best_action, full.best_action);
+  EXPECT_EQ(early.best_action, 0);
+
+  // The best move was settled: the runner-up cannot catch up any more.
+  int second = 0;
+  for (const auto& p : early.action_edge_pairs) {
+    if (p.first != early.best_action) {
+      second = std::max(second, p.second.num_visits);
+    }
+  }
+  EXPECT_GT(
+      early.best_edge_info.num_visits - second,
+      1000 - early.stats.num_rollouts);
+}
+
+TEST(BudgetTest, timeBudget) {
+  TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 100000;
+  options.num_rollouts_per_batch = 4;
+  options.time_budget_ms = 30;
+
+  TS ts(options, [](int) { return new SlowActor(1000); });
+  MCTSResultT<int> result = ts.run(LineState());
+  EXPECT_EQ(result.stop_reason, MCTSResultT<int>::TIME_BUDGET);
+  EXPECT_GE(result.search_time_ms, 30.0f);
+  EXPECT_LT(result.search_time_ms, 1000.0f);
+  EXPECT_LT(result.stats.num_rollouts, 200000);
+  EXPECT_EQ(result.time_saved_ms, 0.0f);
+
+  // The next move searches again.
+  result = ts.run(LineState());
+  EXPECT_EQ(result.stop_reason, MCTSResultT<int>::TIME_BUDGET);
+  EXPECT_GT(result.stats.num_rollouts, 0);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * EvalCacheT is a bounded, thread-safe LRU cache of network evaluations
+ * (NodeResponseT) shared by all the actors of a process, so that a position
+ * that another game has just evaluated (e.g. in the opening) is not sent to
+ * the network again.
+ *
+ * Entries are keyed by a position key and the model version that produced
+ * them, so actors that require different models (e.g. the two sides of an
+ * evaluation game) each get hits on their own entries. Entries of a model
+ * that is no longer used are not dropped, they just age out of the LRU
+ * lists. The cache is split into shards, each with its own lock and LRU list.
+ *
+ * The cache stores whatever response the actor inserts; actors that
+ * post-process the network output with per-actor settings should insert the
+ * raw output and post-process it after a hit.
+ *
+ * Hits, misses, insertions and evictions are counted per model version.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tree_search_base.h"
+
+#include "elf/legacy/pybind_helper.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+struct EvalCacheStats {
+  int64_t version = -1;
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int64_t insertions = 0;
+  int64_t evictions = 0;
+
+  float hitRate() const {
+    return hits + misses > 0 ? float(hits) / (hits + misses) : 0.0;
+  }
+
+  void add(const EvalCacheStats& other) {
+    hits += other.hits;
+    misses += other.misses;
+    insertions += other.insertions;
+    evictions += other.evictions;
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "[ver=" << version << "][hits=" << hits << "][misses=" << misses
+       << "][hit_rate=" << hitRate() << "][insertions=" << insertions
+       << "][evictions=" << evictions << "]";
+    return ss.str();
+  }
+
+  REGISTER_PYBIND_FIELDS(version, hits, misses, insertions, evictions);
+};
+
+template <typename Action>
+class EvalCacheT {
+ public:
+  using NodeResponse = NodeResponseT<Action>;
+
+  static constexpr size_t kNumShards = 32;
+
+  explicit EvalCacheT(size_t capacity)
+      : capacity_(capacity),
+        shardCapacity_(std::max<size_t>(1, capacity / kNumShards)),
+        latestVersion_(-1) {}
+
+  EvalCacheT(const EvalCacheT&) = delete;
+  EvalCacheT& operator=(const EvalCacheT&) = delete;
+
+  // version < 0 means the latest version seen so far.
+  bool lookup(uint64_t key, int64_t version, NodeResponse* resp) {
+    if (version < 0) {
+      version = latestVersion_.load();
+    }
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    EvalCacheStats& stats = shard.getStats(version);
+
+    auto it = shard.index.find(EntryKey{key, version});
+    if (it == shard.index.end()) {
+      stats.misses++;
+      return false;
+    }
+    // Move to the front of the LRU list.
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    *resp = it->second->resp;
+    stats.hits++;
+    return true;
+  }
+
+  void insert(uint64_t key, int64_t version, const NodeResponse& resp) {
+    updateVersion(version);
+
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    EvalCacheStats& stats = shard.getStats(version);
+
+    auto it = shard.index.find(EntryKey{key, version});
+    if (it != shard.index.end()) {
+      it->second->resp = resp;
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      return;
+    }
+
+    if (shard.lru.size() >= shardCapacity_) {
+      const Entry& victim = shard.lru.back();
+      shard.getStats(victim.key.version).evictions++;
+      shard.index.erase(victim.key);
+      shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{EntryKey{key, version}, resp});
+    shard.index[shard.lru.front().key] = shard.lru.begin();
+    stats.insertions++;
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      n += shard.lru.size();
+    }
+    return n;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  int64_t getLatestVersion() const {
+    return latestVersion_.load();
+  }
+
+  // One entry per model version, in increasing order of version.
+  std::vector<EvalCacheStats> getStats() const {
+    std::map<int64_t, EvalCacheStats> merged;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      for (const auto& p : shard.stats) {
+        EvalCacheStats& s = merged[p.first];
+        s.version = p.first;
+        s.add(p.second);
+      }
+    }
+    std::vector<EvalCacheStats> res;
+    for (const auto& p : merged) {
+      res.push_back(p.second);
+    }
+    return res;
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "EvalCache [size=" << size() << "/" << capacity_ << "]";
+    for (const auto& s : getStats()) {
+      ss << " " << s.info();
+    }
+    return ss.str();
+  }
+
+ private:
+  struct EntryKey {
+    uint64_t key;
+    int64_t version;
+
+    friend bool operator==(const EntryKey& k1, const EntryKey& k2) {
+      return k1.key == k2.key && k1.version == k2.version;
+    }
+  };
+
+  struct EntryKeyHash {
+    size_t operator()(const EntryKey& k) const {
+      // Position keys are already hashes.
+      return k.key ^ (uint64_t(k.version) * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  struct Entry {
+    EntryKey key;
+    NodeResponse resp;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<
+        EntryKey,
+        typename std::list<Entry>::iterator,
+        EntryKeyHash>
+        index;
+    std::map<int64_t, EvalCacheStats> stats;
+
+    EvalCacheStats& getStats(int64_t version) {
+      return stats[version];
+    }
+
+    void clear() {
+      for (const Entry& e : lru) {
+        getStats(e.key.version).evictions++;
+      }
+      lru.clear();
+      index.clear();
+    }
+  };
+
+  const size_t capacity_;
+  const size_t shardCapacity_;
+  std::atomic<int64_t> latestVersion_;
+  Shard shards_[kNumShards];
+
+  Shard& getShard(uint64_t key) {
+    return shards_[(key >> 59) % kNumShards];
+  }
+
+  // Keep track of the newest version, for lookups with version < 0.
+  void updateVersion(int64_t version) {
+    int64_t latest = latestVersion_.load();
+    while (version > latest &&
+           !latestVersion_.compare_exchange_weak(latest, version)) {
+    }
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
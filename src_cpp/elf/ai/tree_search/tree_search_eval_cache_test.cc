@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search_eval_cache.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+namespace {
+
+using Cache = EvalCacheT<int>;
+
+NodeResponseT<int> makeResponse(float value) {
+  NodeResponseT<int> resp;
+  resp.pi = {{1, 0.5}, {2, 0.5}};
+  resp.value = value;
+  return resp;
+}
+
+// Keys that land in the same shard, to exercise its LRU list.
+uint64_t sameShardKey(int i) {
+  return uint64_t(i) + 1;
+}
+
+} // namespace
+
+TEST(EvalCacheTest, lruEviction) {
+  // Two entries per shard.
+  Cache cache(2 * Cache::kNumShards);
+  NodeResponseT<int> resp;
+
+  cache.insert(sameShardKey(0), 1, makeResponse(0.0));
+  cache.insert(sameShardKey(1), 1, makeResponse(0.1));
+  // Touch key 0, so that key 1 is the least recently used.
+  EXPECT_TRUE(cache.lookup(sameShardKey(0), 1, &resp));
+  EXPECT_EQ(resp.value, 0.0f);
+  cache.insert(sameShardKey(2), 1, makeResponse(0.2));
+
+  EXPECT_FALSE(cache.lookup(sameShardKey(1), 1, &resp));
+  EXPECT_TRUE(cache.lookup(sameShardKey(0), 1, &resp));
+  EXPECT_TRUE(cache.lookup(sameShardKey(2), 1, &resp));
+  EXPECT_EQ(resp.value, 0.2f);
+  EXPECT_EQ(cache.size(), 2u);
+
+  auto stats = cache.getStats();
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].version, 1);
+  EXPECT_EQ(stats[0].hits, 3);
+  EXPECT_EQ(stats[0].misses, 1);
+  EXPECT_EQ(stats[0].insertions, 3);
+  EXPECT_EQ(stats[0].evictions, 1);
+}
+
+TEST(EvalCacheTest, versionChange) {
+  Cache cache(1024);
+  NodeResponseT<int> resp;
+
+  cache.insert(42, 3, makeResponse(0.3));
+  EXPECT_TRUE(cache.lookup(42, 3, &resp));
+  // A negative version means "whatever is latest".
+  EXPECT_TRUE(cache.lookup(42, -1, &resp));
+  EXPECT_FALSE(cache.lookup(42, 4, &resp));
+
+  // A newer model does not see the entries of the older one.
+  cache.insert(43, 4, makeResponse(0.4));
+  EXPECT_EQ(cache.getLatestVersion(), 4);
+  EXPECT_FALSE(cache.lookup(42, -1, &resp));
+  EXPECT_TRUE(cache.lookup(43, -1, &resp));
+
+  // But the older model keeps its own entries and can still add some, e.g.
+  // the other side of an evaluation game.
+  cache.insert(44, 3, makeResponse(0.3));
+  EXPECT_TRUE(cache.lookup(42, 3, &resp));
+  EXPECT_TRUE(cache.lookup(44, 3, &resp));
+  EXPECT_FALSE(cache.lookup(44, -1, &resp));
+  EXPECT_EQ(cache.getLatestVersion(), 4);
+
+  // The same position under both models.
+  cache.insert(42, 4, makeResponse(0.4));
+  EXPECT_TRUE(cache.lookup(42, 3, &resp));
+  EXPECT_EQ(resp.value, 0.3f);
+  EXPECT_TRUE(cache.lookup(42, 4, &resp));
+  EXPECT_EQ(resp.value, 0.4f);
+  EXPECT_EQ(cache.size(), 4u);
+
+  auto stats = cache.getStats();
+  ASSERT_EQ(stats.size(), 2u);
+  EXPECT_EQ(stats[0].version, 3);
+  EXPECT_EQ(stats[0].hits, 5);
+  EXPECT_EQ(stats[0].misses, 0);
+  EXPECT_EQ(stats[0].insertions, 2);
+  EXPECT_EQ(stats[0].evictions, 0);
+  EXPECT_EQ(stats[1].version, 4);
+  EXPECT_EQ(stats[1].hits, 2);
+  EXPECT_EQ(stats[1].misses, 3);
+  EXPECT_EQ(stats[1].insertions, 2);
+}
+
+TEST(EvalCacheTest, concurrentAccess) {
+  const int kNumThreads = 8;
+  const int kNumKeys = 500;
+  Cache cache(256);
+  std::atomic<bool> failed(false);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      NodeResponseT<int> resp;
+      for (int i = 0; i < 5000; ++i) {
+        const uint64_t key = ((i * 7 + t) % kNumKeys) * 0x9e3779b97f4a7c15ULL;
+        if (cache.lookup(key, 1, &resp)) {
+          if (resp.value != float(key % 100)) {
+            failed = true;
+          }
+        } else {
+          cache.insert(key, 1, makeResponse(key % 100));
+        }
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+
+  EXPECT_FALSE(failed.load());
+  EXPECT_LE(cache.size(), cache.capacity());
+  auto stats = cache.getStats();
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].hits + stats[0].misses, kNumThreads * 5000);
+  EXPECT_EQ(
+      stats[0].insertions - stats[0].evictions,
+      static_cast<int64_t>(cache.size()));
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
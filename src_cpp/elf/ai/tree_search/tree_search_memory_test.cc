@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Eight moves per position, no end. Move 0 is the best one.
+struct WideState {
+  int depth = 0;
+  uint64_t path = 0;
+  // Heap bytes owned by the state, reported by its StateTrait.
+  std::vector<int> payload;
+};
+
+class WideActor {
+ public:
+  using State = WideState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const WideState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const WideState& s, NodeResponse* resp) {
+    resp->pi.clear();
+    for (int a = 0; a < 8; ++a) {
+      resp->pi.emplace_back(a, a == 0 ? 0.65 : 0.05);
+    }
+    resp->value = (s.path & 7) == 0 ? 0.5 : -0.5;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(WideState& s, int a) {
+    s.depth++;
+    s.path = s.path * 8 + a;
+    s.payload.assign(16, a);
+    return true;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+elf::ai::tree_search::TSOptions memoryOptions() {
+  elf::ai::tree_search::TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 50;
+  options.num_rollouts_per_batch = 4;
+  options.virtual_loss = 1;
+  return options;
+}
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<WideState, int> {
+  static std::string to_string(const WideState&) {
+    return "";
+  }
+  static bool equals(const WideState& s1, const WideState& s2) {
+    return s1.depth == s2.depth && s1.path == s2.path;
+  }
+  static uint64_t hash(const WideState&) {
+    return 0;
+  }
+  static size_t bytes(const WideState& s) {
+    return sizeof(WideState) + s.payload.capacity() * sizeof(int);
+  }
+};
+
+using Search = TreeSearchT<WideState, int, WideActor>;
+using Tree = SearchTreeT<WideState, int>;
+
+int64_t sumBytes(const Tree& tree, const Tree::Node* node) {
+  int64_t n = node->bytes();
+  for (int i = 0; i < node->getNumEdges(); ++i) {
+    const NodeId child = node->getEdgeInfo(i).child_node;
+    if (child != InvalidNodeId) {
+      n += sumBytes(tree, tree[child]);
+    }
+  }
+  return n;
+}
+
+TEST(TreeMemoryTest, accounting) {
+  const int64_t nodes_before = TreeMemory::global().nodes();
+  const int64_t bytes_before = TreeMemory::global().bytes();
+  {
+    Tree tree;
+    Search ts(memoryOptions(), [](int) { return new WideActor(); });
+    MCTSResultT<int> result = ts.run(WideState());
+
+    EXPECT_GT(result.memory.tree_nodes, 1);
+    EXPECT_EQ(result.memory.tree_nodes, ts.getMemoryStats().tree_nodes);
+    EXPECT_EQ(
+        result.memory.total_nodes - nodes_before,
+        result.memory.tree_nodes + tree.getMemory().nodes());
+    EXPECT_EQ(result.memory.num_pruned_nodes, 0);
+    // Edges and states are charged on top of the nodes.
+    EXPECT_GT(
+        result.memory.tree_bytes,
+        result.memory.tree_nodes * int64_t(sizeof(Tree::Node)));
+
+    // Byte-accurate: the same as walking the tree.
+    tree.getRootNode()->setStateIfUnset([]() { return new WideState(); });
+    NodeResponseT<int> resp;
+    WideActor().evaluate(WideState(), &resp);
+    Tree::Node* root = tree.getRootNode();
+    root->setEvaluation(resp);
+    for (int a = 0; a < 3; ++a) {
+      Tree::Node* child = tree[root->followEdge(a, tree)];
+      child->setStateIfUnset([a]() {
+        WideState* s = new WideState();
+        WideActor().forward(*s, a);
+        return s;
+      });
+    }
+    EXPECT_EQ(tree.getMemory().nodes(), 4);
+    EXPECT_EQ(
+        tree.getMemory().bytes(), sumBytes(tree, tree.getRootNode()));
+
+    tree.clear();
+    EXPECT_EQ(tree.getMemory().nodes(), 1);
+    EXPECT_EQ(tree.getMemory().bytes(), int64_t(sizeof(Tree::Node)));
+  }
+  EXPECT_EQ(TreeMemory::global().nodes(), nodes_before);
+  EXPECT_EQ(TreeMemory::global().bytes(), bytes_before);
+}
+
+TEST(TreeMemoryTest, pruneKeepsPrincipalVariation) {
+  TSOptions options = memoryOptions();
+  Search unbounded(options, [](int) { return new WideActor(); });
+  options.max_tree_nodes = 150;
+  Search bounded(options, [](int) { return new WideActor(); });
+
+  int64_t num_pruned = 0;
+  for (int i = 1; i <= 6; ++i) {
+    MCTSResultT<int> full = unbounded.run(WideState());
+    MCTSResultT<int> result = bounded.run(WideState());
+    num_pruned += result.memory.num_pruned_nodes;
+    // Room is made before each run.
+    EXPECT_LE(result.memory.tree_nodes, options.max_tree_nodes);
+    EXPECT_EQ(result.best_action, full.best_action);
+    EXPECT_NE(result.best_edge_info.child_node, InvalidNodeId);
+    // Pruned edges keep their visits (some rollouts stop at the root).
+    EXPECT_GT(result.total_visits, (i - 1) * 100 + 50);
+  }
+  EXPECT_GT(num_pruned, 0);
+  EXPECT_GT(unbounded.getMemoryStats().tree_nodes, options.max_tree_nodes);
+}
+
+TEST(TreeMemoryTest, processBudget) {
+  TSOptions options = memoryOptions();
+  const int64_t nodes_before = TreeMemory::global().nodes();
+  options.max_total_tree_nodes = nodes_before + 400;
+
+  std::vector<std::unique_ptr<Search>> searches;
+  for (int i = 0; i < 3; ++i) {
+    searches.emplace_back(
+        new Search(options, [](int) { return new WideActor(); }));
+  }
+  // A tree can only prune itself, so the process may go over by the
+  // rollouts of a run when a small tree runs while the others are large.
+  int64_t num_pruned = 0;
+  for (int round = 0; round < 4; ++round) {
+    for (auto& ts : searches) {
+      MCTSResultT<int> result = ts->run(WideState());
+      num_pruned += result.memory.num_pruned_nodes;
+      EXPECT_LE(result.memory.total_nodes, options.max_total_tree_nodes + 100);
+    }
+  }
+  EXPECT_GT(num_pruned, 0);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,18 +8,29 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
-#include <thread>
-#include <unordered_map>
+#include <type_traits>
+#include <unordered_set>
 #include <vector>
 
+#include "elf/concurrency/Counter.h"
+#include "elf/utils/member_check.h"
+#include "elf/utils/rng.h"
+
+#include "tree_search_arena.h"
 #include "tree_search_base.h"
 #include "tree_search_options.h"
+#include "tree_search_pool.h"
+#include "tree_search_uct.h"
 
 namespace elf {
 namespace ai {
@@ -82,12 +93,89 @@ class NodeBaseT {
   StateType stateType_;
 };
 
+// Striped table of condition variables used to park threads that wait for
+// another thread to evaluate a node. Nodes hash to a stripe by address, so
+// a node needs no mutex or condition variable of its own.
+class EvalWaitTable {
+ public:
+  static constexpr size_t kNumStripes = 64;
+
+  struct Stripe {
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  static Stripe& get(const void* p) {
+    static Stripe stripes[kNumStripes];
+    // Drop the low bits, which are the same for all nodes.
+    return stripes[(reinterpret_cast<uintptr_t>(p) >> 6) % kNumStripes];
+  }
+};
+
+// Live nodes and bytes of a search tree. Every tree also adds to the
+// process-wide totals, global().
+class TreeMemory {
+ public:
+  TreeMemory() {}
+
+  TreeMemory(const TreeMemory&) = delete;
+  TreeMemory& operator=(const TreeMemory&) = delete;
+
+  void add(int64_t nodes, int64_t bytes) {
+    nodes_.fetch_add(nodes, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    if (this != &global()) {
+      global().add(nodes, bytes);
+    }
+  }
+
+  int64_t nodes() const {
+    return nodes_.load(std::memory_order_relaxed);
+  }
+
+  int64_t bytes() const {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+  static TreeMemory& global() {
+    static TreeMemory memory;
+    return memory;
+  }
+
+ private:
+  std::atomic<int64_t> nodes_{0};
+  std::atomic<int64_t> bytes_{0};
+};
+
+// A StateTrait may tell the bytes of a state, including what it owns on the
+// heap, with a static bytes(const State&). Otherwise it is sizeof(State).
+MEMBER_FUNC_CHECK(bytes)
+
+template <
+    typename State,
+    typename Action,
+    std::enable_if_t<has_func_bytes<StateTrait<State, Action>>::value>* U =
+        nullptr>
+int64_t stateBytes(const State& s) {
+  return StateTrait<State, Action>::bytes(s);
+}
+
+template <
+    typename State,
+    typename Action,
+    std::enable_if_t<!has_func_bytes<StateTrait<State, Action>>::value>* U =
+        nullptr>
+int64_t stateBytes(const State&) {
+  return sizeof(State);
+}
+
 // Tree node.
 template <typename State, typename Action>
 class NodeT : public NodeBaseT<State> {
  public:
   using Node = NodeT<State, Action>;
   using SearchTree = SearchTreeT<State, Action>;
+  using Edge = EdgeT<Action>;
 
   enum VisitType {
     NOT_VISITED = 0,
@@ -95,18 +183,110 @@ class NodeT : public NodeBaseT<State> {
     VISITED,
   };
 
-  NodeT(float unsigned_parent_q)
+  // Range over the child edges, for range-based for loops.
+  class EdgeRange {
+   public:
+    EdgeRange(const Edge* begin, const Edge* end) : begin_(begin), end_(end) {}
+
+    const Edge* begin() const {
+      return begin_;
+    }
+
+    const Edge* end() const {
+      return end_;
+    }
+
+    size_t size() const {
+      return end_ - begin_;
+    }
+
+   private:
+    const Edge* begin_;
+    const Edge* end_;
+  };
+
+  // memory, if not nullptr, is charged for the node, its edges and state.
+  NodeT(float unsigned_parent_q, TreeMemory* memory = nullptr)
       : status_(NOT_VISITED),
+        numWaiters_(0),
         numVisits_(0),
-        unsignedParentQ_(unsigned_parent_q) {
-    unsignedMeanQ_ = unsignedParentQ_;
+        unsignedMeanQ_(unsigned_parent_q),
+        unsignedParentQ_(unsigned_parent_q),
+        memory_(memory) {
+    if (memory_ != nullptr) {
+      memory_->add(1, sizeof(Node));
+    }
   }
 
   NodeT(const Node&) = delete;
   Node& operator=(const Node&) = delete;
 
-  const std::unordered_map<Action, EdgeInfo>& getStateActions() const {
-    return stateActions_;
+  ~NodeT() {
+    if (memory_ != nullptr) {
+      memory_->add(-1, -bytes());
+    }
+  }
+
+  // Same as NodeBaseT::setStateIfUnset(), and charges the new state.
+  bool setStateIfUnset(std::function<State*()> func) {
+    if (func == nullptr || memory_ == nullptr) {
+      return NodeBaseT<State>::setStateIfUnset(func);
+    }
+    return NodeBaseT<State>::setStateIfUnset([&]() {
+      State* state = func();
+      if (state != nullptr) {
+        memory_->add(0, stateBytes<State, Action>(*state));
+      }
+      return state;
+    });
+  }
+
+  // Bytes of the node, its edges and its state.
+  int64_t bytes() const {
+    int64_t n = sizeof(Node) + edgeBytes();
+    if (this->state_ != nullptr) {
+      n += stateBytes<State, Action>(*this->state_);
+    }
+    return n;
+  }
+
+  EdgeRange getEdges() const {
+    return EdgeRange(edges_.get(), edges_.get() + numEdges_);
+  }
+
+  const Edge& getEdge(int edge_idx) const {
+    return edges_[edge_idx];
+  }
+
+  int getNumEdges() const {
+    return numEdges_;
+  }
+
+  EdgeInfo getEdgeInfo(int edge_idx) const {
+    EdgeInfo info = stats_.snapshot(edge_idx);
+    info.child_node =
+        edges_[edge_idx].child_node.load(std::memory_order_relaxed);
+    return info;
+  }
+
+  // Index of the edge for the given action, or -1 if there is none.
+  int findEdge(const Action& action) const {
+    for (int i = 0; i < numEdges_; ++i) {
+      if (edges_[i].action == action) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Snapshot of all edges, used to summarize the search result.
+  std::vector<std::pair<Action, EdgeInfo>> getStateActions() const {
+    std::vector<std::pair<Action, EdgeInfo>> res;
+    res.reserve(numEdges_);
+    for (int i = 0; i < numEdges_; ++i) {
+      res.emplace_back(edges_[i].action, getEdgeInfo(i));
+    }
+    return res;
   }
 
   int getNumVisits() const {
@@ -129,28 +309,20 @@ class NodeT : public NodeBaseT<State> {
     return status_ == VISITED;
   }
 
-  void enhanceExploration(float epsilon, float alpha, std::mt19937* rng) {
+  template <typename Rng>
+  void enhanceExploration(float epsilon, float alpha, Rng* rng) {
     // Note that this is not thread-safe.
     // It should be called once and only once for each node.
     if (epsilon == 0.0) {
       return;
     }
 
-    std::gamma_distribution<> dis(alpha);
-
     // Draw distribution.
-    std::vector<float> etas(stateActions_.size());
-    float Z = 1e-10;
-    for (size_t i = 0; i < stateActions_.size(); ++i) {
-      etas[i] = dis(*rng);
-      Z += etas[i];
-    }
+    std::vector<float> etas(numEdges_);
+    elf_utils::sample_dirichlet(alpha, etas.size(), rng, etas.data());
 
-    int i = 0;
-    for (auto& p : stateActions_) {
-      p.second.prior_probability =
-          (1 - epsilon) * p.second.prior_probability + epsilon * etas[i] / Z;
-      i++;
+    for (int i = 0; i < numEdges_; ++i) {
+      stats_.setPrior(i, (1 - epsilon) * stats_.prior(i) + epsilon * etas[i]);
     }
   }
 
@@ -166,11 +338,20 @@ class NodeT : public NodeBaseT<State> {
     return true;
   }
 
+  // Block until another thread has called setEvaluation on this node.
   void waitEvaluation() {
-    // Simple busy wait here.
-    while (status_ != VISITED) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (status_ == VISITED) {
+      return;
     }
+    // setEvaluation only notifies when it sees a waiter, so register first
+    // and then check the status again under the stripe lock.
+    numWaiters_++;
+    auto& stripe = EvalWaitTable::get(this);
+    {
+      std::unique_lock<std::mutex> lock(stripe.mutex);
+      stripe.cv.wait(lock, [this]() { return status_ == VISITED; });
+    }
+    numWaiters_--;
   }
 
   bool setEvaluation(const NodeResponseT<Action>& resp) {
@@ -182,38 +363,47 @@ class NodeT : public NodeBaseT<State> {
     if (status_ == VISITED)
       return false;
 
-    // Then we need to allocate sa_val_
-    for (const std::pair<Action, float>& action_pair : resp.pi) {
-      stateActions_.insert(
-          std::make_pair(action_pair.first, EdgeInfo(action_pair.second)));
-      lockStateActions_[action_pair.first].reset(new std::mutex());
-
-      // Compute v here.
-      // Node *child = alloc[res.first->second.next];
-      // child->V_ = V_ + log(action_pair.second + 1e-6);
+    // Allocate all edges at once. The array never changes afterwards.
+    numEdges_ = resp.pi.size();
+    edges_.reset(numEdges_ > 0 ? new Edge[numEdges_] : nullptr);
+    stats_.reset(numEdges_);
+    for (int i = 0; i < numEdges_; ++i) {
+      edges_[i].action = resp.pi[i].first;
+      stats_.setPrior(i, resp.pi[i].second);
+    }
+    if (memory_ != nullptr) {
+      memory_->add(0, edgeBytes());
     }
 
     // value
     V_ = resp.value;
     flipQSign_ = resp.q_flip;
 
-    // Once sa_ is allocated, its structure won't change.
+    // Once edges_ is allocated, its structure won't change.
     status_ = VISITED;
+
+    if (numWaiters_ > 0) {
+      auto& stripe = EvalWaitTable::get(this);
+      // Taking the lock orders us with a waiter that is about to sleep.
+      {
+        std::lock_guard<std::mutex> stripe_lock(stripe.mutex);
+      }
+      stripe.cv.notify_all();
+    }
     return true;
   }
 
+  // Pick the child with the highest UCT score. Lock-free: concurrent callers
+  // see each other's statistics with relaxed ordering.
   bool findMove(
       const SearchAlgoOptions& alg_opt,
       int node_depth,
-      // const NodeDynInfo& node_info,
-      Action* action,
+      int* edge_idx,
       std::ostream* oo = nullptr) {
     if (status_ != VISITED)
       return false;
 
-    std::lock_guard<std::mutex> lock(lockNode_);
-
-    if (stateActions_.empty()) {
+    if (numEdges_ == 0) {
       return false;
     }
 
@@ -223,82 +413,55 @@ class NodeT : public NodeBaseT<State> {
     }
 
     BestAction best_action = UCT(alg_opt, oo);
-    *action = best_action.action_with_max_score;
+    *edge_idx = best_action.edge_idx;
     unsignedMeanQ_ = (unsignedParentQ_ + best_action.total_unsigned_q) /
         (best_action.total_visits + 1);
 
     return true;
   }
 
-  bool addVirtualLoss(const Action& action, float virtual_loss) {
-    if (status_ != VISITED)
+  bool addVirtualLoss(int edge_idx, float virtual_loss) {
+    if (status_ != VISITED || edge_idx < 0 || edge_idx >= numEdges_)
       return false;
 
-    auto it = stateActions_.find(action);
-
-    if (it == stateActions_.end()) {
-      return false;
-    }
-
-    EdgeInfo& info = it->second;
-
-    auto lock_it = lockStateActions_.find(action);
-    assert(lock_it != lockStateActions_.end());
-    std::lock_guard<std::mutex> lock(*(lock_it->second.get()));
-
-    info.virtual_loss += virtual_loss;
+    stats_.addVirtualLoss(edge_idx, virtual_loss);
     return true;
   }
 
-  bool updateEdgeStats(const Action& action, float reward, float virtual_loss) {
-    if (status_ != VISITED)
+  bool updateEdgeStats(int edge_idx, float reward, float virtual_loss) {
+    if (status_ != VISITED || edge_idx < 0 || edge_idx >= numEdges_)
       return false;
 
-    auto it = stateActions_.find(action);
-    if (it == stateActions_.end()) {
-      return false;
-    }
-
-    EdgeInfo& edge = it->second;
-
     numVisits_++;
-
-    // Async modification (we probably need to add a locker in the future, or
-    // not for speed).
-
-    auto lock_it = lockStateActions_.find(action);
-    assert(lock_it != lockStateActions_.end());
-    std::lock_guard<std::mutex> lock(*(lock_it->second.get()));
-
-    edge.reward += reward;
-    edge.num_visits++;
-    // Reduce virtual loss.
-    edge.virtual_loss -= virtual_loss;
+    stats_.update(edge_idx, reward, virtual_loss);
     return true;
   }
 
-  NodeId followEdge(const Action& action, SearchTree& tree) {
-    if (status_ != VISITED)
+  NodeId followEdge(int edge_idx, SearchTree& tree) {
+    if (status_ != VISITED || edge_idx < 0 || edge_idx >= numEdges_)
       return InvalidNodeId;
 
-    auto it = stateActions_.find(action);
-    if (it == stateActions_.end()) {
-      return InvalidNodeId;
-    }
+    Edge& edge = edges_[edge_idx];
 
-    EdgeInfo& edge = it->second;
-
-    if (edge.child_node == InvalidNodeId) {
-      auto lock_it = lockStateActions_.find(action);
-      assert(lock_it != lockStateActions_.end());
-      std::lock_guard<std::mutex> lock(*(lock_it->second.get()));
+    NodeId child = edge.child_node.load();
+    if (child != InvalidNodeId) {
+      return child;
+    }
 
-      // Need to check twice.
-      if (edge.child_node == InvalidNodeId) {
-        edge.child_node = tree.addNode(unsignedMeanQ_);
-      }
+    // Several threads may race here; the loser returns its node to the tree.
+    NodeId fresh = tree.addNode(unsignedMeanQ_);
+    if (edge.child_node.compare_exchange_strong(child, fresh)) {
+      return fresh;
     }
-    return edge.child_node;
+    tree.freeNode(fresh);
+    return child;
+  }
+
+  // Unlink the child of an edge and return it. The statistics of the edge
+  // are kept, and the next rollout through it creates a fresh child. Only
+  // when no search is in flight.
+  NodeId detachChild(int edge_idx) {
+    return edges_[edge_idx].child_node.exchange(InvalidNodeId);
   }
 
  private:
@@ -306,46 +469,39 @@ class NodeT : public NodeBaseT<State> {
   friend class NodeTest;
 
   std::atomic<VisitType> status_;
+  std::atomic<int> numWaiters_;
   std::mutex lockNode_;
-  std::unordered_map<Action, EdgeInfo> stateActions_;
-  std::unordered_map<Action, std::unique_ptr<std::mutex>> lockStateActions_;
+  std::unique_ptr<Edge[]> edges_;
+  UCTEdgeStats stats_;
+  int numEdges_ = 0;
 
   std::atomic<int> numVisits_;
   float V_ = 0.0;
-  float unsignedMeanQ_ = 0.0;
+  std::atomic<float> unsignedMeanQ_;
 
   // TODO Poor choice of variable name - fix later (ssengupta@fb)
   const float unsignedParentQ_;
   bool flipQSign_ = false;
+  TreeMemory* memory_;
+
+  int64_t edgeBytes() const {
+    return numEdges_ * sizeof(Edge) + stats_.bytes();
+  }
 
   struct BestAction {
+    int edge_idx;
     Action action_with_max_score;
     float max_score;
     float total_unsigned_q;
     int total_visits;
 
     BestAction()
-        : action_with_max_score(ActionTrait<Action>::default_value()),
+        : edge_idx(-1),
+          action_with_max_score(ActionTrait<Action>::default_value()),
           max_score(std::numeric_limits<float>::lowest()),
           total_unsigned_q(0),
           total_visits(0) {}
 
-    void addAction(
-        const Action& action,
-        float score,
-        float unsigned_q,
-        bool first_visit) {
-      if (score > max_score) {
-        max_score = score;
-        action_with_max_score = action;
-      }
-
-      if (!first_visit) {
-        total_unsigned_q += unsigned_q;
-        total_visits++;
-      }
-    }
-
     std::string info() const {
       std::stringstream ss;
       ss << " max_score: " << max_score << ", best_action: "
@@ -360,35 +516,42 @@ class NodeT : public NodeBaseT<State> {
   // Algorithms.
   BestAction UCT(const SearchAlgoOptions& alg_opt, std::ostream* oo = nullptr)
       const {
-    BestAction best_action;
-
-    if (oo) {
-      *oo << "uct prior = " << std::string(alg_opt.use_prior ? "True" : "False")
-          << ", parent_cnt: " << (numVisits_.load() + 1) << std::endl;
-    }
-
-    for (const auto& action_pair : stateActions_) {
-      const Action& action = action_pair.first;
-      const EdgeInfo& edge = action_pair.second;
+    // num_visits_ + 1 is sum of all visits to all other actions from
+    // this node
+    const int all_visits = numVisits_.load() + 1;
 
-      // num_visits_ + 1 is sum of all visits to all other actions from
-      // this node
-      const int all_visits = numVisits_.load() + 1;
-      auto prior_score = edge.getScore(flipQSign_, all_visits, unsignedMeanQ_);
+    UCTInput in = stats_.input();
+    in.flip_q_sign = flipQSign_;
+    in.use_prior = alg_opt.use_prior;
+    in.c_puct = alg_opt.c_puct;
+    in.sqrt_parent_visits = std::sqrt(static_cast<float>(all_visits));
+    in.unsigned_default_q = unsignedMeanQ_.load();
 
-      float score = alg_opt.use_prior
-          ? (prior_score.prior_probability * alg_opt.c_puct + prior_score.q)
-          : prior_score.q;
+    // The debug path scores one edge at a time, so it can print them.
+    const UCTOutput out = oo ? uctScalar(in) : uctSelect(in);
 
-      best_action.addAction(
-          action, score, prior_score.unsigned_q, prior_score.first_visit);
+    BestAction best_action;
+    best_action.edge_idx = out.edge_idx;
+    if (out.edge_idx >= 0) {
+      best_action.action_with_max_score = edges_[out.edge_idx].action;
+    }
+    best_action.max_score = out.max_score;
+    best_action.total_unsigned_q = out.total_unsigned_q;
+    best_action.total_visits = out.total_visits;
 
-      if (oo) {
-        *oo << "UCT [a=" << ActionTrait<Action>::to_string(action)
+    if (oo) {
+      *oo << "uct prior = " << std::string(alg_opt.use_prior ? "True" : "False")
+          << ", parent_cnt: " << all_visits << std::endl;
+      for (int i = 0; i < numEdges_; ++i) {
+        const EdgeInfo edge = getEdgeInfo(i);
+        auto prior_score =
+            edge.getScore(flipQSign_, all_visits, in.unsigned_default_q);
+        float score = alg_opt.use_prior
+            ? (prior_score.prior_probability * alg_opt.c_puct + prior_score.q)
+            : prior_score.q;
+        *oo << "UCT [a=" << ActionTrait<Action>::to_string(edges_[i].action)
             << "][score=" << score << "] " << edge.info(true) << std::endl;
       }
-    }
-    if (oo) {
       *oo << "Get best action. uct prior = "
           << std::string(alg_opt.use_prior ? "True" : "False")
           << best_action.info() << std::endl;
@@ -410,9 +573,19 @@ class SearchTreeT {
   SearchTreeT(const SearchTree&) = delete;
   SearchTree& operator=(const SearchTree&) = delete;
 
+  ~SearchTreeT() {
+    waitReclaim();
+  }
+
+  // If set, treeAdvance() leaves the discarded subtrees to the background
+  // pool instead of freeing them on the calling thread.
+  void setBackgroundReclaim(bool background) {
+    backgroundReclaim_ = background;
+  }
+
   void clear() {
-    allocatedNodes_.clear();
-    allocatedNodeCount_ = 0;
+    waitReclaim();
+    nodes_.clear();
     rootId_ = InvalidNodeId;
     allocateRoot();
   }
@@ -420,12 +593,13 @@ class SearchTreeT {
   void treeAdvance(const Action& action) {
     NodeId next_root = InvalidNodeId;
     Node* r = getRootNode();
+    std::vector<NodeId> discarded;
 
-    for (const auto& p : r->getStateActions()) {
-      if (p.first == action) {
-        next_root = p.second.child_node;
-      } else {
-        recursiveFree(p.second.child_node);
+    for (const auto& edge : r->getEdges()) {
+      if (edge.action == action) {
+        next_root = edge.child_node;
+      } else if (edge.child_node != InvalidNodeId) {
+        discarded.push_back(edge.child_node);
       }
     }
 
@@ -433,6 +607,27 @@ class SearchTreeT {
     freeNode(rootId_);
     rootId_ = next_root;
     allocateRoot();
+
+    // The discarded subtrees are unreachable from the new root, so the
+    // search may run while they are being freed.
+    if (backgroundReclaim_ && !discarded.empty()) {
+      pendingReclaims_.increment();
+      SearchWorkerPool::getBackground().submit([this, discarded]() {
+        for (NodeId id : discarded) {
+          recursiveFree(id);
+        }
+        pendingReclaims_.increment(-1);
+      });
+    } else {
+      for (NodeId id : discarded) {
+        recursiveFree(id);
+      }
+    }
+  }
+
+  // Block until the subtrees handed to the background pool are freed.
+  void waitReclaim() {
+    pendingReclaims_.wait([](int n) { return n == 0; });
   }
 
   Node* getRootNode() {
@@ -445,35 +640,101 @@ class SearchTreeT {
 
   // Low level functions.
   NodeId addNode(float unsigned_parent_q) {
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    allocatedNodes_[allocatedNodeCount_].reset(new Node(unsigned_parent_q));
-    return allocatedNodeCount_++;
+    return nodes_.allocate(unsigned_parent_q, &memory_);
   }
 
+  // Freed ids go back to the arena's free lists and are reused by addNode.
   void freeNode(NodeId id) {
-    allocatedNodes_.erase(id);
+    nodes_.release(id);
   }
 
-  void recursiveFree(NodeId id) {
+  // Return the number of nodes freed.
+  int64_t recursiveFree(NodeId id) {
     if (id == InvalidNodeId) {
-      return;
+      return 0;
     }
     Node* root = (*this)[id];
-    for (const auto& p : root->getStateActions()) {
-      p.second.checkValid();
-      recursiveFree(p.second.child_node);
+    int64_t n = 1;
+    for (int i = 0; i < root->getNumEdges(); ++i) {
+      const EdgeInfo edge = root->getEdgeInfo(i);
+      edge.checkValid();
+      n += recursiveFree(edge.child_node);
     }
     freeNode(id);
+    return n;
   }
 
   Node* operator[](NodeId i) {
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    return getNode(i);
+    return nodes_.get(i);
   }
 
   const Node* operator[](NodeId i) const {
-    std::lock_guard<std::mutex> lock(allocMutex_);
-    return getNode(i);
+    return nodes_.get(i);
+  }
+
+  size_t getNumNodes() const {
+    return nodes_.numLive();
+  }
+
+  // Nodes and bytes of the tree, including subtrees still being reclaimed.
+  const TreeMemory& getMemory() const {
+    return memory_;
+  }
+
+  // Free subtrees until the tree has at most max_nodes nodes, or only the
+  // principal variation is left. The subtrees with the fewest visits go
+  // first; the principal variation, i.e. the most visited path from the
+  // root, is kept. Their edges keep the statistics, so the search can grow
+  // them back. Only when no search is in flight. Return the number of nodes
+  // freed.
+  int64_t prune(int64_t max_nodes) {
+    const int64_t num_nodes = memory_.nodes();
+    if (num_nodes <= max_nodes || getRootNode() == nullptr) {
+      return 0;
+    }
+
+    std::unordered_set<NodeId> pv;
+    for (NodeId id = rootId_; id != InvalidNodeId;) {
+      pv.insert(id);
+      const Node* node = (*this)[id];
+      int best_visits = 0;
+      NodeId next = InvalidNodeId;
+      for (int i = 0; i < node->getNumEdges(); ++i) {
+        const EdgeInfo edge = node->getEdgeInfo(i);
+        if (edge.child_node != InvalidNodeId && edge.num_visits > best_visits) {
+          best_visits = edge.num_visits;
+          next = edge.child_node;
+        }
+      }
+      id = next;
+    }
+
+    std::vector<PruneCandidate> candidates;
+    collectPruneCandidates(rootId_, pv, &candidates);
+    // Fewest visits first, then the largest subtrees.
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [](const PruneCandidate& c1, const PruneCandidate& c2) {
+          if (c1.num_visits != c2.num_visits) {
+            return c1.num_visits < c2.num_visits;
+          }
+          return c1.size > c2.size;
+        });
+
+    int64_t freed = 0;
+    for (const PruneCandidate& c : candidates) {
+      if (num_nodes - freed <= max_nodes) {
+        break;
+      }
+      // Nothing is allocated meanwhile, so a freed parent stays null.
+      Node* parent = (*this)[c.parent];
+      if (parent == nullptr) {
+        continue;
+      }
+      freed += recursiveFree(parent->detachChild(c.edge_idx));
+    }
+    return freed;
   }
 
   std::string printTree() const {
@@ -492,8 +753,9 @@ class SearchTreeT {
 
     for (const auto& p : node->getStateActions()) {
       if (p.second.num_visits > 0) {
-        const Node* n = getNode(p.second.child_node);
-        if (n->isVisited()) {
+        const Node* n = nodes_.get(p.second.child_node);
+        // Pruned subtrees have visits but no child.
+        if (n != nullptr && n->isVisited()) {
           ss << indent_str << ActionTrait<Action>::to_string(p.first) << " "
              << p.second.info();
           ss << ", V: " << n->getValue();
@@ -528,28 +790,41 @@ class SearchTreeT {
   }
 
  private:
-  // TODO: We might just allocate one chunk at a time.
-  std::unordered_map<NodeId, std::unique_ptr<Node>> allocatedNodes_;
-  NodeId allocatedNodeCount_;
-  NodeId rootId_;
-  mutable std::mutex allocMutex_;
-
-  const Node* getNode(NodeId i) const {
-    auto it = allocatedNodes_.find(i);
-    if (it == allocatedNodes_.end()) {
-      return nullptr;
-    } else {
-      return it->second.get();
-    }
-  }
+  struct PruneCandidate {
+    NodeId parent;
+    int edge_idx;
+    int num_visits;
+    int64_t size;
+  };
 
-  Node* getNode(NodeId i) {
-    auto it = allocatedNodes_.find(i);
-    if (it == allocatedNodes_.end()) {
-      return nullptr;
-    } else {
-      return it->second.get();
+  // Declared before nodes_, which charges it until destroyed.
+  TreeMemory memory_;
+  NodeArenaT<Node> nodes_;
+  NodeId rootId_;
+  bool backgroundReclaim_ = false;
+  elf::concurrency::Counter<int> pendingReclaims_;
+
+  // Add the child subtrees of id that are off the principal variation to
+  // candidates, and return the size of the subtree of id.
+  int64_t collectPruneCandidates(
+      NodeId id,
+      const std::unordered_set<NodeId>& pv,
+      std::vector<PruneCandidate>* candidates) const {
+    const Node* node = (*this)[id];
+    int64_t size = 1;
+    for (int i = 0; i < node->getNumEdges(); ++i) {
+      const EdgeInfo edge = node->getEdgeInfo(i);
+      if (edge.child_node == InvalidNodeId) {
+        continue;
+      }
+      const int64_t child_size =
+          collectPruneCandidates(edge.child_node, pv, candidates);
+      if (pv.count(edge.child_node) == 0) {
+        candidates->push_back({id, i, edge.num_visits, child_size});
+      }
+      size += child_size;
     }
+    return size;
   }
 
   bool allocateRoot() {
@@ -79,10 +79,55 @@ struct TSOptions {
   int num_threads = 16;
   int num_rollouts_per_thread = 100;
   int num_rollouts_per_batch = 8;
+  // Adapt the rollouts per batch of each thread, starting from
+  // num_rollouts_per_batch, to the most useful leaves per second (see
+  // BatchSizeController).
+  bool adaptive_batch = false;
+  int min_rollouts_per_batch = 1;
+  int max_rollouts_per_batch = 64;
   bool verbose = false;
   bool verbose_time = false;
   int seed = 0;
   bool persistent_tree = false;
+  // Node budget of the tree (0 = unlimited). Before a run that could go
+  // over it, low-visit subtrees off the principal variation are pruned.
+  int max_tree_nodes = 0;
+  // Node budget of all the trees of the process (0 = unlimited). A tree
+  // that starts a run while the process is over it sheds the excess, as far
+  // as it can: it may only prune itself.
+  int max_total_tree_nodes = 0;
+  // Keep searching in the background between moves (see
+  // TreeSearchT::startPondering). Needs a persistent tree.
+  bool ponder = false;
+  // Stop pondering at this many tree nodes (0 = only the node budgets).
+  int ponder_max_tree_nodes = 0;
+  // Fraction of the wall-clock time the search threads ponder, in (0, 1].
+  float ponder_cpu_share = 1.0;
+  // Run rollouts on the process-wide SearchWorkerPool instead of
+  // num_threads dedicated threads per tree.
+  bool use_shared_pool = false;
+  // Size of the shared pool (0 = #hardware threads, but at least
+  // eval_batchsize). First tree wins.
+  int shared_pool_threads = 0;
+  // Batch size of the evaluations the rollouts wait for (0 = unknown). A
+  // shared pool with fewer threads only gets batches flushed by timeouts.
+  int eval_batchsize = 0;
+  // Step the searches of all trees in lockstep on the process-wide
+  // BatchedSearchDriver, so that no tree needs a thread of its own. The
+  // rollout budget is still num_threads * num_rollouts_per_thread.
+  bool use_batched_driver = false;
+  // Number of driver workers (trees are spread over them). First tree wins.
+  int batched_driver_workers = 1;
+  // Share node evaluations between transposed positions.
+  bool use_transposition_table = false;
+  // Number of batches a thread keeps in flight (> 1 needs an actor with
+  // evaluate_async()).
+  int pipeline_depth = 1;
+  // Wall-clock budget of a move in ms (0 = no limit).
+  int time_budget_ms = 0;
+  // With most_visited, stop once the rollouts left cannot change the best
+  // move.
+  bool early_stop = false;
   float root_epsilon = 0.0;
   float root_alpha = 0.0;
   std::string log_prefix = "";
@@ -107,11 +152,31 @@ struct TSOptions {
       ss << "#Threads: " << num_threads << std::endl;
       ss << "#Rollout per thread: " << num_rollouts_per_thread
          << ", #rollouts per batch: " << num_rollouts_per_batch << std::endl;
+      if (adaptive_batch) {
+        ss << "Adaptive batch: [" << min_rollouts_per_batch << ", "
+           << max_rollouts_per_batch << "]" << std::endl;
+      }
       ss << "Verbose: " << elf_utils::print_bool(verbose)
          << ", Verbose_time: " << elf_utils::print_bool(verbose_time)
          << std::endl;
       ss << "Persistent tree: " << elf_utils::print_bool(persistent_tree)
          << std::endl;
+      ss << "Max #tree nodes (0 = no limit): " << max_tree_nodes
+         << ", of all trees: " << max_total_tree_nodes << std::endl;
+      if (ponder) {
+        ss << "Ponder: max #tree nodes: " << ponder_max_tree_nodes
+           << ", cpu share: " << ponder_cpu_share << std::endl;
+      }
+      ss << "Shared pool: " << elf_utils::print_bool(use_shared_pool)
+         << ", #pool threads: " << shared_pool_threads
+         << ", eval batchsize: " << eval_batchsize << std::endl;
+      ss << "Batched driver: " << elf_utils::print_bool(use_batched_driver)
+         << ", #driver workers: " << batched_driver_workers << std::endl;
+      ss << "Transposition table: "
+         << elf_utils::print_bool(use_transposition_table) << std::endl;
+      ss << "Pipeline depth: " << pipeline_depth << std::endl;
+      ss << "Time budget (ms, 0 = none): " << time_budget_ms
+         << ", early stop: " << elf_utils::print_bool(early_stop) << std::endl;
       ss << "#Virtual loss: " << virtual_loss << std::endl;
       ss << "Pick method: " << pick_method << std::endl;
 
@@ -143,6 +208,15 @@ struct TSOptions {
     if (t1.num_rollouts_per_batch != t2.num_rollouts_per_batch) {
       return false;
     }
+    if (t1.adaptive_batch != t2.adaptive_batch) {
+      return false;
+    }
+    if (t1.min_rollouts_per_batch != t2.min_rollouts_per_batch) {
+      return false;
+    }
+    if (t1.max_rollouts_per_batch != t2.max_rollouts_per_batch) {
+      return false;
+    }
     if (t1.verbose != t2.verbose) {
       return false;
     }
@@ -155,6 +229,48 @@ struct TSOptions {
     if (t1.persistent_tree != t2.persistent_tree) {
       return false;
     }
+    if (t1.max_tree_nodes != t2.max_tree_nodes) {
+      return false;
+    }
+    if (t1.max_total_tree_nodes != t2.max_total_tree_nodes) {
+      return false;
+    }
+    if (t1.ponder != t2.ponder) {
+      return false;
+    }
+    if (t1.ponder_max_tree_nodes != t2.ponder_max_tree_nodes) {
+      return false;
+    }
+    if (t1.ponder_cpu_share != t2.ponder_cpu_share) {
+      return false;
+    }
+    if (t1.use_shared_pool != t2.use_shared_pool) {
+      return false;
+    }
+    if (t1.shared_pool_threads != t2.shared_pool_threads) {
+      return false;
+    }
+    if (t1.eval_batchsize != t2.eval_batchsize) {
+      return false;
+    }
+    if (t1.use_batched_driver != t2.use_batched_driver) {
+      return false;
+    }
+    if (t1.batched_driver_workers != t2.batched_driver_workers) {
+      return false;
+    }
+    if (t1.use_transposition_table != t2.use_transposition_table) {
+      return false;
+    }
+    if (t1.pipeline_depth != t2.pipeline_depth) {
+      return false;
+    }
+    if (t1.time_budget_ms != t2.time_budget_ms) {
+      return false;
+    }
+    if (t1.early_stop != t2.early_stop) {
+      return false;
+    }
     if (t1.pick_method != t2.pick_method) {
       return false;
     }
@@ -181,10 +297,27 @@ struct TSOptions {
     JSON_SAVE(j, num_threads);
     JSON_SAVE(j, num_rollouts_per_thread);
     JSON_SAVE(j, num_rollouts_per_batch);
+    JSON_SAVE(j, adaptive_batch);
+    JSON_SAVE(j, min_rollouts_per_batch);
+    JSON_SAVE(j, max_rollouts_per_batch);
     JSON_SAVE(j, verbose);
     JSON_SAVE(j, verbose_time);
     JSON_SAVE(j, seed);
     JSON_SAVE(j, persistent_tree);
+    JSON_SAVE(j, max_tree_nodes);
+    JSON_SAVE(j, max_total_tree_nodes);
+    JSON_SAVE(j, ponder);
+    JSON_SAVE(j, ponder_max_tree_nodes);
+    JSON_SAVE(j, ponder_cpu_share);
+    JSON_SAVE(j, use_shared_pool);
+    JSON_SAVE(j, shared_pool_threads);
+    JSON_SAVE(j, eval_batchsize);
+    JSON_SAVE(j, use_batched_driver);
+    JSON_SAVE(j, batched_driver_workers);
+    JSON_SAVE(j, use_transposition_table);
+    JSON_SAVE(j, pipeline_depth);
+    JSON_SAVE(j, time_budget_ms);
+    JSON_SAVE(j, early_stop);
     JSON_SAVE(j, pick_method);
     JSON_SAVE(j, log_prefix);
     JSON_SAVE(j, root_epsilon);
@@ -199,10 +332,27 @@ struct TSOptions {
     JSON_LOAD(opt, j, num_threads);
     JSON_LOAD(opt, j, num_rollouts_per_thread);
     JSON_LOAD(opt, j, num_rollouts_per_batch);
+    JSON_LOAD_OPTIONAL(opt, j, adaptive_batch);
+    JSON_LOAD_OPTIONAL(opt, j, min_rollouts_per_batch);
+    JSON_LOAD_OPTIONAL(opt, j, max_rollouts_per_batch);
     JSON_LOAD(opt, j, verbose);
     JSON_LOAD(opt, j, verbose_time);
     JSON_LOAD(opt, j, seed);
     JSON_LOAD(opt, j, persistent_tree);
+    JSON_LOAD_OPTIONAL(opt, j, max_tree_nodes);
+    JSON_LOAD_OPTIONAL(opt, j, max_total_tree_nodes);
+    JSON_LOAD_OPTIONAL(opt, j, ponder);
+    JSON_LOAD_OPTIONAL(opt, j, ponder_max_tree_nodes);
+    JSON_LOAD_OPTIONAL(opt, j, ponder_cpu_share);
+    JSON_LOAD_OPTIONAL(opt, j, use_shared_pool);
+    JSON_LOAD_OPTIONAL(opt, j, shared_pool_threads);
+    JSON_LOAD_OPTIONAL(opt, j, eval_batchsize);
+    JSON_LOAD_OPTIONAL(opt, j, use_batched_driver);
+    JSON_LOAD_OPTIONAL(opt, j, batched_driver_workers);
+    JSON_LOAD_OPTIONAL(opt, j, use_transposition_table);
+    JSON_LOAD_OPTIONAL(opt, j, pipeline_depth);
+    JSON_LOAD_OPTIONAL(opt, j, time_budget_ms);
+    JSON_LOAD_OPTIONAL(opt, j, early_stop);
     JSON_LOAD(opt, j, pick_method);
     JSON_LOAD(opt, j, log_prefix);
     JSON_LOAD(opt, j, root_epsilon);
@@ -217,8 +367,25 @@ struct TSOptions {
       num_threads,
       num_rollouts_per_thread,
       num_rollouts_per_batch,
+      adaptive_batch,
+      min_rollouts_per_batch,
+      max_rollouts_per_batch,
       verbose,
       persistent_tree,
+      max_tree_nodes,
+      max_total_tree_nodes,
+      ponder,
+      ponder_max_tree_nodes,
+      ponder_cpu_share,
+      use_shared_pool,
+      shared_pool_threads,
+      eval_batchsize,
+      use_batched_driver,
+      batched_driver_workers,
+      use_transposition_table,
+      pipeline_depth,
+      time_budget_ms,
+      early_stop,
       pick_method,
       log_prefix,
       virtual_loss,
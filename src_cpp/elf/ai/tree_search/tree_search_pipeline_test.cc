@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 16 moves per position, for 3 plies.
+struct PathState {
+  int depth = 0;
+  int path = 0;
+};
+
+class PathActor {
+ public:
+  using State = PathState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  std::atomic<int> numEvaluated{0};
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const PathState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const PathState& s, NodeResponse* resp) {
+    numEvaluated++;
+    resp->pi.clear();
+    if (s.depth < 3) {
+      for (int a = 0; a < 16; ++a) {
+        resp->pi.emplace_back(a, 1.0 / 16);
+      }
+    }
+    resp->value = (s.path % 5) / 2.0 - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(PathState& s, int a) {
+    s.depth++;
+    s.path = s.path * 16 + a;
+    return true;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+// Evaluates on another thread, as a network server would.
+class AsyncPathActor : public PathActor {
+ public:
+  std::atomic<int> numInFlight{0};
+  std::atomic<int> maxInFlight{0};
+
+  std::future<void> evaluate_async(
+      const std::vector<const PathState*>& states,
+      std::vector<NodeResponse>* resps) {
+    int n = ++numInFlight;
+    int m = maxInFlight.load();
+    while (n > m && !maxInFlight.compare_exchange_weak(m, n)) {
+    }
+    return std::async(std::launch::async, [this, states, resps]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      evaluate(states, resps);
+      numInFlight--;
+    });
+  }
+};
+
+elf::ai::tree_search::TSOptions pipelineOptions(int depth) {
+  elf::ai::tree_search::TSOptions options;
+  options.num_threads = 1;
+  options.num_rollouts_per_thread = 64;
+  options.num_rollouts_per_batch = 4;
+  options.virtual_loss = 1;
+  options.pipeline_depth = depth;
+  return options;
+}
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<PathState, int> {
+  static std::string to_string(const PathState&) {
+    return "";
+  }
+  static bool equals(const PathState& s1, const PathState& s2) {
+    return s1.depth == s2.depth && s1.path == s2.path;
+  }
+  static uint64_t hash(const PathState&) {
+    return 0;
+  }
+};
+
+TEST(PipelineTest, batchesInFlight) {
+  for (int depth : {1, 4}) {
+    AsyncPathActor* actor = nullptr;
+    TreeSearchT<PathState, int, AsyncPathActor> ts(
+        pipelineOptions(depth), [&](int) {
+          actor = new AsyncPathActor();
+          return actor;
+        });
+
+    MCTSResultT<int> result = ts.run(PathState());
+    // With a depth of 1, evaluate() is used.
+    EXPECT_EQ(actor->maxInFlight.load(), depth > 1 ? depth : 0);
+    EXPECT_EQ(actor->numInFlight.load(), 0);
+    EXPECT_EQ(result.stats.num_evaluations, actor->numEvaluated.load());
+    // Only the batches submitted before the root is expanded are lost.
+    EXPECT_EQ(result.total_visits, 64 - 4 * depth);
+  }
+}
+
+TEST(PipelineTest, syncActorIgnoresDepth) {
+  PathActor* actor = nullptr;
+  TreeSearchT<PathState, int, PathActor> ts(pipelineOptions(4), [&](int) {
+    actor = new PathActor();
+    return actor;
+  });
+
+  MCTSResultT<int> result = ts.run(PathState());
+  EXPECT_EQ(result.stats.num_evaluations, actor->numEvaluated.load());
+  EXPECT_EQ(result.total_visits, 60);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Four moves per position, no end.
+struct PathState {
+  int depth = 0;
+  int path = 0;
+};
+
+class PathActor {
+ public:
+  using State = PathState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  explicit PathActor(int delay_us) : delayUs_(delay_us) {}
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const PathState*>& states,
+      std::vector<NodeResponse>* resps) {
+    std::this_thread::sleep_for(std::chrono::microseconds(delayUs_));
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const PathState& s, NodeResponse* resp) {
+    resp->pi = {{0, 0.4}, {1, 0.3}, {2, 0.2}, {3, 0.1}};
+    resp->value = (s.path % 3) - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(PathState& s, int a) {
+    s.depth++;
+    s.path = s.path * 4 + a;
+    return true;
+  }
+
+ private:
+  int delayUs_;
+  std::mt19937 rng_;
+};
+
+elf::ai::tree_search::TSOptions ponderOptions() {
+  elf::ai::tree_search::TSOptions options;
+  options.num_threads = 2;
+  options.num_rollouts_per_thread = 50;
+  options.num_rollouts_per_batch = 4;
+  options.virtual_loss = 1;
+  options.persistent_tree = true;
+  options.ponder = true;
+  return options;
+}
+
+PathState after(PathState s, int a) {
+  PathActor(0).forward(s, a);
+  return s;
+}
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<PathState, int> {
+  static std::string to_string(const PathState&) {
+    return "";
+  }
+  static bool equals(const PathState& s1, const PathState& s2) {
+    return s1.depth == s2.depth && s1.path == s2.path;
+  }
+  static uint64_t hash(const PathState&) {
+    return 0;
+  }
+};
+
+using Search = TreeSearchT<PathState, int, PathActor>;
+
+TEST(PonderTest, reusesSubtree) {
+  Search ts(ponderOptions(), [](int) { return new PathActor(100); });
+  MCTSResultT<int> first = ts.run(PathState());
+  EXPECT_EQ(first.ponder_rollouts, 0);
+
+  // Our move is played, then we ponder while the opponent thinks.
+  const PathState ours = after(PathState(), first.best_action);
+  ts.treeAdvance(first.best_action);
+  ts.startPondering(ours);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+  ts.treeAdvance(1);
+  MCTSResultT<int> second = ts.run(after(ours, 1));
+  EXPECT_GT(second.ponder_rollouts, 0);
+  EXPECT_GE(second.stats.num_rollouts, 100);
+  // The visits pondered below move 1 are kept.
+  EXPECT_GT(second.total_visits, second.stats.num_rollouts);
+}
+
+TEST(PonderTest, nodeBudget) {
+  TSOptions options = ponderOptions();
+  options.ponder_max_tree_nodes = 400;
+  Search ts(options, [](int) { return new PathActor(0); });
+
+  ts.startPondering(PathState());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // A chunk is only started if it fits.
+  EXPECT_LE(ts.getMemoryStats().tree_nodes, 400);
+  EXPECT_GT(ts.getMemoryStats().tree_nodes, 400 - 2 * 100);
+  ts.stopPondering();
+
+  MCTSResultT<int> result = ts.run(PathState());
+  EXPECT_GT(result.ponder_rollouts, 0);
+}
+
+TEST(PonderTest, stopsQuickly) {
+  TSOptions options = ponderOptions();
+  options.num_rollouts_per_thread = 100000;
+  Search ts(options, [](int) { return new PathActor(1000); });
+
+  ts.startPondering(PathState());
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto start = std::chrono::steady_clock::now();
+  ts.stopPondering();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  // Only the batches in flight finish.
+  EXPECT_LT(elapsed, std::chrono::milliseconds(50));
+}
+
+TEST(PonderTest, cpuShare) {
+  TSOptions options = ponderOptions();
+  options.ponder_cpu_share = 0.25;
+  Search idle(options, [](int) { return new PathActor(200); });
+  options.ponder_cpu_share = 1.0;
+  Search busy(options, [](int) { return new PathActor(200); });
+
+  idle.startPondering(PathState());
+  busy.startPondering(PathState());
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  idle.stopPondering();
+  busy.stopPondering();
+
+  const int idle_rollouts = idle.run(PathState()).ponder_rollouts;
+  const int busy_rollouts = busy.run(PathState()).ponder_rollouts;
+  EXPECT_GT(idle_rollouts, 0);
+  EXPECT_LT(idle_rollouts, busy_rollouts / 2);
+}
+
+TEST(PonderTest, clearStops) {
+  Search ts(ponderOptions(), [](int) { return new PathActor(100); });
+  ts.startPondering(PathState());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ts.clear();
+  EXPECT_EQ(ts.getMemoryStats().tree_nodes, 1);
+
+  MCTSResultT<int> result = ts.run(PathState());
+  EXPECT_EQ(result.ponder_rollouts, 0);
+  EXPECT_GE(result.stats.num_rollouts, 100);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
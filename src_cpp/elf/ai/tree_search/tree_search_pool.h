@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * SearchWorkerPool is a fixed-size pool of threads that run tree search
+ * tasks for many TreeSearchT instances.
+ *
+ * With the pool, a search tree is per-game data: TreeSearchT::run submits one
+ * rollout task per search slot and waits for them, instead of owning
+ * num_threads dedicated threads. The process-wide instance is created lazily
+ * by getShared(); its size is fixed by the first caller.
+ *
+ * Note that rollout tasks block while their leaves are being evaluated, so the
+ * pool should have at least as many threads as the inference batch size,
+ * otherwise batches are only flushed by timeouts. getShared() therefore
+ * never picks a default size below the batch size it is given.
+ *
+ * getBackground() is a separate single-thread pool at a lower priority, for
+ * housekeeping that should stay off the game threads (e.g. freeing the
+ * subtrees discarded by SearchTreeT::treeAdvance).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+class SearchWorkerPool {
+ public:
+  using Task = std::function<void()>;
+
+  // nice > 0 lowers the priority of the pool threads (Linux only).
+  explicit SearchWorkerPool(int num_threads, int nice = 0) {
+    if (num_threads <= 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this, nice]() {
+        setNice(nice);
+        this->loop();
+      });
+    }
+  }
+
+  SearchWorkerPool(const SearchWorkerPool&) = delete;
+  SearchWorkerPool& operator=(const SearchWorkerPool&) = delete;
+
+  ~SearchWorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_all();
+    for (auto& th : threads_) {
+      th.join();
+    }
+  }
+
+  void submit(Task task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  size_t size() const {
+    return threads_.size();
+  }
+
+  // Process-wide pool. num_threads <= 0 means one thread per hardware
+  // thread, but at least min_threads. Only the first call decides the size.
+  static SearchWorkerPool& getShared(int num_threads = 0, int min_threads = 0) {
+    static SearchWorkerPool pool(defaultSize(num_threads, min_threads));
+    return pool;
+  }
+
+  static int defaultSize(int num_threads, int min_threads) {
+    if (num_threads > 0) {
+      return num_threads;
+    }
+    return std::max(
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency())),
+        min_threads);
+  }
+
+  // Process-wide low-priority thread for background work.
+  static SearchWorkerPool& getBackground() {
+    static SearchWorkerPool pool(1, 10);
+    return pool;
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+  std::deque<Task> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+
+  static void setNice(int nice) {
+#ifdef __linux__
+    // On Linux, the niceness is per thread.
+    if (nice != 0) {
+      setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice);
+    }
+#else
+    (void)nice;
+#endif
+  }
+
+  void loop() {
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return done_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Time of SearchTreeT::treeAdvance versus tree size, with the discarded
+// subtrees freed on the calling thread or on the background pool. The trees
+// are full 8-ary trees; every node owns a state with some heap memory.
+// Times are medians over a few runs.
+//
+// Usage: bench_tree_search_reclaim [state_bytes] [num_runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "tree_search_node.h"
+
+namespace {
+
+using elf::ai::tree_search::NodeId;
+using elf::ai::tree_search::NodeResponseT;
+
+struct FakeState {
+  std::vector<char> data;
+
+  explicit FakeState(size_t bytes) : data(bytes) {}
+};
+
+using Tree = elf::ai::tree_search::SearchTreeT<FakeState, int>;
+
+const int kBranching = 8;
+
+void build(Tree& tree, int depth, size_t state_bytes) {
+  NodeResponseT<int> resp;
+  for (int a = 0; a < kBranching; ++a) {
+    resp.pi.emplace_back(a, 1.0 / kBranching);
+  }
+  resp.value = 0.0;
+
+  std::function<void(Tree::Node*, int)> expand = [&](Tree::Node* node,
+                                                     int d) {
+    node->setStateIfUnset([=]() { return new FakeState(state_bytes); });
+    if (d == 0) {
+      return;
+    }
+    node->setEvaluation(resp);
+    for (int a = 0; a < kBranching; ++a) {
+      NodeId child = node->followEdge(node->findEdge(a), tree);
+      expand(tree[child], d - 1);
+    }
+  };
+  expand(tree.getRootNode(), depth);
+}
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const size_t state_bytes = argc > 1 ? std::atoi(argv[1]) : 256;
+  const int num_runs = argc > 2 ? std::atoi(argv[2]) : 5;
+
+  std::cout << "State bytes: " << state_bytes << ", #runs: " << num_runs
+            << std::endl;
+  for (int depth = 2; depth <= 6; ++depth) {
+    std::vector<double> advance_us[2];
+    std::vector<double> reclaim_us;
+    size_t num_nodes = 0;
+
+    for (int run = 0; run < num_runs; ++run) {
+      for (int background = 0; background < 2; ++background) {
+        Tree tree;
+        tree.setBackgroundReclaim(background == 1);
+        build(tree, depth, state_bytes);
+        num_nodes = tree.getNumNodes();
+
+        auto start = std::chrono::steady_clock::now();
+        tree.treeAdvance(0);
+        advance_us[background].push_back(elapsedUs(start));
+
+        if (background == 1) {
+          tree.waitReclaim();
+          reclaim_us.push_back(elapsedUs(start));
+        }
+      }
+    }
+
+    std::cout << "#nodes: " << num_nodes
+              << ", treeAdvance inline: " << median(advance_us[0])
+              << " us, background: " << median(advance_us[1])
+              << " us (freed after " << median(reclaim_us) << " us)"
+              << std::endl;
+  }
+  return 0;
+}
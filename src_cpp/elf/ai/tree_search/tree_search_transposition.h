@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * TranspositionTableT caches node evaluations (priors and value) by state key,
+ * so that a position reached through another move order is expanded without
+ * asking the actor again.
+ *
+ * Only the evaluation is shared: each transposed node still owns its edges,
+ * so visit counts and rewards stay per path. Keys come from
+ * StateTrait<State, Action>::hash(); a key of 0 means the state must not be
+ * shared.
+ *
+ * The table is split into shards with their own lock. A shard that reaches
+ * its capacity is simply emptied.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "tree_search_base.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <typename Action>
+class TranspositionTableT {
+ public:
+  using NodeResponse = NodeResponseT<Action>;
+  using Entry = std::shared_ptr<const NodeResponse>;
+
+  static constexpr size_t kNumShards = 64;
+
+  explicit TranspositionTableT(size_t max_entries = 1 << 20)
+      : maxEntriesPerShard_(std::max<size_t>(1, max_entries / kNumShards)) {}
+
+  TranspositionTableT(const TranspositionTableT&) = delete;
+  TranspositionTableT& operator=(const TranspositionTableT&) = delete;
+
+  // Return nullptr if the key is not in the table.
+  Entry lookup(uint64_t key) const {
+    const Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    return it == shard.entries.end() ? nullptr : it->second;
+  }
+
+  void insert(uint64_t key, const NodeResponse& resp) {
+    Entry entry = std::make_shared<const NodeResponse>(resp);
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.entries.size() >= maxEntriesPerShard_) {
+      shard.entries.clear();
+    }
+    shard.entries[key] = std::move(entry);
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.entries.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      n += shard.entries.size();
+    }
+    return n;
+  }
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+  };
+
+  Shard shards_[kNumShards];
+  const size_t maxEntriesPerShard_;
+
+  // Keys are hashes already; use the high bits, since unordered_map buckets
+  // on the low ones.
+  Shard& getShard(uint64_t key) {
+    return shards_[(key >> 58) % kNumShards];
+  }
+
+  const Shard& getShard(uint64_t key) const {
+    return shards_[(key >> 58) % kNumShards];
+  }
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
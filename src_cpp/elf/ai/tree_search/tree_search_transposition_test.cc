@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search_transposition.h"
+
+#include <atomic>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree_search.h"
+
+namespace {
+
+// Picks a subset of 6 items, one per move. The same subset is reached by
+// every order of its items, so the tree is full of transpositions.
+struct SubsetState {
+  int depth = 0;
+  int mask = 0;
+
+  bool operator==(const SubsetState& other) const {
+    return depth == other.depth && mask == other.mask;
+  }
+};
+
+class SubsetActor {
+ public:
+  using State = SubsetState;
+  using Action = int;
+  using NodeResponse = elf::ai::tree_search::NodeResponseT<int>;
+
+  static std::atomic<int> numEvaluated;
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const SubsetState*>& states,
+      std::vector<NodeResponse>* resps) {
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const SubsetState& s, NodeResponse* resp) {
+    numEvaluated++;
+    resp->pi.clear();
+    if (s.depth < 4) {
+      for (int a = 0; a < 6; ++a) {
+        if (!(s.mask & (1 << a))) {
+          resp->pi.emplace_back(a, 1.0 / (6 - s.depth));
+        }
+      }
+    }
+    resp->value = (s.mask % 7) / 3.0 - 1.0;
+    resp->q_flip = s.depth % 2 == 1;
+  }
+
+  bool forward(SubsetState& s, int a) {
+    s.depth++;
+    s.mask |= 1 << a;
+    return true;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+std::atomic<int> SubsetActor::numEvaluated(0);
+
+} // namespace
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+template <>
+struct StateTrait<SubsetState, int> {
+  static std::string to_string(const SubsetState&) {
+    return "";
+  }
+  static bool equals(const SubsetState& s1, const SubsetState& s2) {
+    return s1 == s2;
+  }
+  static uint64_t hash(const SubsetState& s) {
+    return (uint64_t(s.depth) << 32 | s.mask) + 1;
+  }
+};
+
+TEST(TranspositionTableTest, lookupAndEvict) {
+  TranspositionTableT<int> tt(TranspositionTableT<int>::kNumShards);
+  NodeResponseT<int> resp;
+  resp.pi = {{3, 0.25}, {4, 0.75}};
+  resp.value = 0.5;
+
+  EXPECT_EQ(tt.lookup(42), nullptr);
+  tt.insert(42, resp);
+  auto entry = tt.lookup(42);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->pi, resp.pi);
+  EXPECT_EQ(entry->value, 0.5);
+
+  // One entry per shard: another key in the same shard replaces it, but the
+  // entry already handed out stays valid.
+  tt.insert(43, resp);
+  EXPECT_EQ(tt.lookup(42), nullptr);
+  EXPECT_NE(tt.lookup(43), nullptr);
+  EXPECT_EQ(entry->value, 0.5);
+
+  tt.clear();
+  EXPECT_EQ(tt.size(), 0u);
+}
+
+TEST(TranspositionTableTest, fewerEvaluations) {
+  TSOptions options;
+  options.num_threads = 1;
+  options.num_rollouts_per_thread = 400;
+  options.num_rollouts_per_batch = 1;
+
+  MCTSResultT<int> results[2];
+  int num_evaluated[2];
+  for (int use_tt = 0; use_tt < 2; ++use_tt) {
+    options.use_transposition_table = use_tt == 1;
+    TreeSearchT<SubsetState, int, SubsetActor> ts(
+        options, [](int) { return new SubsetActor(); });
+
+    SubsetActor::numEvaluated = 0;
+    results[use_tt] = ts.run(SubsetState());
+    num_evaluated[use_tt] = SubsetActor::numEvaluated;
+  }
+
+  // 1 + 6 + 30 + 120 + 360 nodes for 400 rollouts; there are only
+  // 1 + 6 + 15 + 20 + 15 distinct positions.
+  const SearchStats& plain = results[0].stats;
+  const SearchStats& shared = results[1].stats;
+  EXPECT_EQ(plain.num_tt_lookups, 0);
+  EXPECT_EQ(plain.num_evaluations, num_evaluated[0]);
+  EXPECT_EQ(shared.num_evaluations, num_evaluated[1]);
+  EXPECT_LE(num_evaluated[1], 57);
+  EXPECT_LT(num_evaluated[1] * 4, num_evaluated[0]);
+  EXPECT_EQ(
+      shared.num_evaluations + shared.num_tt_hits, plain.num_evaluations);
+  EXPECT_GT(shared.ttHitRate(), 0.5);
+
+  // Visit counts are still per path.
+  EXPECT_EQ(results[0].total_visits, results[1].total_visits);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
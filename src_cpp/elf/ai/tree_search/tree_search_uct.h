@@ -0,0 +1,360 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * UCT child selection over a structure-of-arrays edge layout.
+ *
+ * UCTEdgeStats keeps the priors, rewards, visit counts and virtual losses of
+ * a node's edges in separate arrays, zero-padded to a multiple of
+ * kUCTPadding entries. uctSelect() scores all children and returns the
+ * argmax with an AVX2 or SSE4.1 kernel when the build targets them (the repo
+ * builds with -march=native), and with uctScalar() otherwise.
+ *
+ * uctScalar() is the reference: it scores each edge as EdgeInfo::getScore()
+ * does, one at a time. The vector kernels follow the same arithmetic lane by
+ * lane; ties go to the lowest index.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "tree_search_base.h"
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+constexpr int kUCTPadding = 8;
+
+struct UCTInput {
+  // Padded arrays, readable up to a multiple of kUCTPadding entries.
+  const float* prior;
+  const float* reward;
+  const int* num_visits;
+  const float* virtual_loss;
+  int num_edges;
+
+  bool flip_q_sign;
+  bool use_prior;
+  float c_puct;
+  // sqrt of the total parent visits (+1).
+  float sqrt_parent_visits;
+  float unsigned_default_q;
+};
+
+struct UCTOutput {
+  int edge_idx = -1;
+  float max_score = std::numeric_limits<float>::lowest();
+  // Over the edges with visits (or virtual loss).
+  float total_unsigned_q = 0;
+  int total_visits = 0;
+};
+
+inline UCTOutput uctScalar(const UCTInput& in) {
+  UCTOutput out;
+  for (int i = 0; i < in.num_edges; ++i) {
+    const int n = in.num_visits[i];
+    const float vl = in.virtual_loss[i];
+
+    // Same as EdgeInfo::getScore().
+    float r = in.flip_q_sign ? -in.reward[i] : in.reward[i];
+    r -= vl;
+    const int n_vl = n + vl;
+    const float q = n_vl > 0
+        ? r / n_vl
+        : (in.flip_q_sign ? -in.unsigned_default_q : in.unsigned_default_q);
+    const float unsigned_q = n > 0 ? in.reward[i] / n : in.unsigned_default_q;
+    const float prior = in.prior[i] / (1 + n) * in.sqrt_parent_visits;
+
+    const float score = in.use_prior ? prior * in.c_puct + q : q;
+    if (score > out.max_score) {
+      out.max_score = score;
+      out.edge_idx = i;
+    }
+    if (n_vl != 0) {
+      out.total_unsigned_q += unsigned_q;
+      out.total_visits++;
+    }
+  }
+  return out;
+}
+
+#ifdef __AVX2__
+inline UCTOutput uctAVX2(const UCTInput& in) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 sign = _mm256_set1_ps(in.flip_q_sign ? -1.0f : 1.0f);
+  const __m256 default_q = _mm256_set1_ps(
+      in.flip_q_sign ? -in.unsigned_default_q : in.unsigned_default_q);
+  const __m256 unsigned_default_q = _mm256_set1_ps(in.unsigned_default_q);
+  const __m256 sqrt_parent = _mm256_set1_ps(in.sqrt_parent_visits);
+  const __m256 c_puct = _mm256_set1_ps(in.use_prior ? in.c_puct : 0.0f);
+  const __m256i one_i = _mm256_set1_epi32(1);
+  const __m256i zero_i = _mm256_setzero_si256();
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i num_edges = _mm256_set1_epi32(in.num_edges);
+
+  __m256 best = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+  __m256i best_idx = _mm256_set1_epi32(-1);
+  __m256 total_q = zero;
+  __m256i total_visits = zero_i;
+
+  for (int i = 0; i < in.num_edges; i += 8) {
+    const __m256i idx = _mm256_add_epi32(lane, _mm256_set1_epi32(i));
+    const __m256 prior = _mm256_loadu_ps(in.prior + i);
+    const __m256 reward = _mm256_loadu_ps(in.reward + i);
+    const __m256i n = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(in.num_visits + i));
+    const __m256 vl = _mm256_loadu_ps(in.virtual_loss + i);
+    const __m256 n_f = _mm256_cvtepi32_ps(n);
+
+    // q, with virtual loss; num_visits + virtual_loss is truncated to int.
+    const __m256 r = _mm256_sub_ps(_mm256_mul_ps(reward, sign), vl);
+    const __m256i n_vl = _mm256_cvttps_epi32(_mm256_add_ps(n_f, vl));
+    const __m256i has_n_vl = _mm256_cmpgt_epi32(n_vl, zero_i);
+    const __m256 q = _mm256_blendv_ps(
+        default_q,
+        _mm256_div_ps(r, _mm256_cvtepi32_ps(n_vl)),
+        _mm256_castsi256_ps(has_n_vl));
+
+    const __m256 prior_term = _mm256_mul_ps(
+        _mm256_div_ps(
+            prior, _mm256_cvtepi32_ps(_mm256_add_epi32(n, one_i))),
+        sqrt_parent);
+    const __m256 score = _mm256_add_ps(_mm256_mul_ps(prior_term, c_puct), q);
+
+    // Padding lanes never win.
+    const __m256 valid =
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(num_edges, idx));
+    const __m256 better =
+        _mm256_and_ps(valid, _mm256_cmp_ps(score, best, _CMP_GT_OQ));
+    best = _mm256_blendv_ps(best, score, better);
+    best_idx = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(best_idx), _mm256_castsi256_ps(idx), better));
+
+    // Padding lanes have no visits, so they drop out here.
+    const __m256i has_n = _mm256_cmpgt_epi32(n, zero_i);
+    const __m256 unsigned_q = _mm256_blendv_ps(
+        unsigned_default_q,
+        _mm256_div_ps(reward, n_f),
+        _mm256_castsi256_ps(has_n));
+    total_q = _mm256_add_ps(
+        total_q, _mm256_and_ps(unsigned_q, _mm256_castsi256_ps(has_n_vl)));
+    total_visits = _mm256_sub_epi32(total_visits, has_n_vl);
+  }
+
+  alignas(32) float best_lanes[8];
+  alignas(32) int idx_lanes[8];
+  alignas(32) float q_lanes[8];
+  alignas(32) int visit_lanes[8];
+  _mm256_store_ps(best_lanes, best);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(idx_lanes), best_idx);
+  _mm256_store_ps(q_lanes, total_q);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(visit_lanes), total_visits);
+
+  UCTOutput out;
+  for (int k = 0; k < 8; ++k) {
+    if (idx_lanes[k] >= 0 &&
+        (best_lanes[k] > out.max_score ||
+         (best_lanes[k] == out.max_score && idx_lanes[k] < out.edge_idx))) {
+      out.max_score = best_lanes[k];
+      out.edge_idx = idx_lanes[k];
+    }
+    out.total_unsigned_q += q_lanes[k];
+    out.total_visits += visit_lanes[k];
+  }
+  return out;
+}
+#endif
+
+#ifdef __SSE4_1__
+inline UCTOutput uctSSE(const UCTInput& in) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(in.flip_q_sign ? -1.0f : 1.0f);
+  const __m128 default_q = _mm_set1_ps(
+      in.flip_q_sign ? -in.unsigned_default_q : in.unsigned_default_q);
+  const __m128 unsigned_default_q = _mm_set1_ps(in.unsigned_default_q);
+  const __m128 sqrt_parent = _mm_set1_ps(in.sqrt_parent_visits);
+  const __m128 c_puct = _mm_set1_ps(in.use_prior ? in.c_puct : 0.0f);
+  const __m128i one_i = _mm_set1_epi32(1);
+  const __m128i zero_i = _mm_setzero_si128();
+  const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i num_edges = _mm_set1_epi32(in.num_edges);
+
+  __m128 best = _mm_set1_ps(std::numeric_limits<float>::lowest());
+  __m128i best_idx = _mm_set1_epi32(-1);
+  __m128 total_q = zero;
+  __m128i total_visits = zero_i;
+
+  for (int i = 0; i < in.num_edges; i += 4) {
+    const __m128i idx = _mm_add_epi32(lane, _mm_set1_epi32(i));
+    const __m128 prior = _mm_loadu_ps(in.prior + i);
+    const __m128 reward = _mm_loadu_ps(in.reward + i);
+    const __m128i n =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.num_visits + i));
+    const __m128 vl = _mm_loadu_ps(in.virtual_loss + i);
+    const __m128 n_f = _mm_cvtepi32_ps(n);
+
+    const __m128 r = _mm_sub_ps(_mm_mul_ps(reward, sign), vl);
+    const __m128i n_vl = _mm_cvttps_epi32(_mm_add_ps(n_f, vl));
+    const __m128i has_n_vl = _mm_cmpgt_epi32(n_vl, zero_i);
+    const __m128 q = _mm_blendv_ps(
+        default_q,
+        _mm_div_ps(r, _mm_cvtepi32_ps(n_vl)),
+        _mm_castsi128_ps(has_n_vl));
+
+    const __m128 prior_term = _mm_mul_ps(
+        _mm_div_ps(prior, _mm_cvtepi32_ps(_mm_add_epi32(n, one_i))),
+        sqrt_parent);
+    const __m128 score = _mm_add_ps(_mm_mul_ps(prior_term, c_puct), q);
+
+    const __m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(num_edges, idx));
+    const __m128 better = _mm_and_ps(valid, _mm_cmpgt_ps(score, best));
+    best = _mm_blendv_ps(best, score, better);
+    best_idx = _mm_castps_si128(_mm_blendv_ps(
+        _mm_castsi128_ps(best_idx), _mm_castsi128_ps(idx), better));
+
+    const __m128i has_n = _mm_cmpgt_epi32(n, zero_i);
+    const __m128 unsigned_q = _mm_blendv_ps(
+        unsigned_default_q, _mm_div_ps(reward, n_f), _mm_castsi128_ps(has_n));
+    total_q =
+        _mm_add_ps(total_q, _mm_and_ps(unsigned_q, _mm_castsi128_ps(has_n_vl)));
+    total_visits = _mm_sub_epi32(total_visits, has_n_vl);
+  }
+
+  alignas(16) float best_lanes[4];
+  alignas(16) int idx_lanes[4];
+  alignas(16) float q_lanes[4];
+  alignas(16) int visit_lanes[4];
+  _mm_store_ps(best_lanes, best);
+  _mm_store_si128(reinterpret_cast<__m128i*>(idx_lanes), best_idx);
+  _mm_store_ps(q_lanes, total_q);
+  _mm_store_si128(reinterpret_cast<__m128i*>(visit_lanes), total_visits);
+
+  UCTOutput out;
+  for (int k = 0; k < 4; ++k) {
+    if (idx_lanes[k] >= 0 &&
+        (best_lanes[k] > out.max_score ||
+         (best_lanes[k] == out.max_score && idx_lanes[k] < out.edge_idx))) {
+      out.max_score = best_lanes[k];
+      out.edge_idx = idx_lanes[k];
+    }
+    out.total_unsigned_q += q_lanes[k];
+    out.total_visits += visit_lanes[k];
+  }
+  return out;
+}
+#endif
+
+inline UCTOutput uctSelect(const UCTInput& in) {
+#if defined(__AVX2__)
+  return uctAVX2(in);
+#elif defined(__SSE4_1__)
+  return uctSSE(in);
+#else
+  return uctScalar(in);
+#endif
+}
+
+// Edge statistics of a node, in the layout the kernels read. Updates are
+// relaxed atomics. Lock-free atomics have the size and layout of the plain
+// types, so the kernels load them as plain arrays; like the per-edge loads
+// they replace, a score may mix values from concurrent updates.
+class UCTEdgeStats {
+ public:
+  static_assert(
+      sizeof(std::atomic<float>) == sizeof(float) &&
+          sizeof(std::atomic<int>) == sizeof(int),
+      "UCTEdgeStats needs plain-sized atomics");
+
+  UCTEdgeStats() {}
+
+  UCTEdgeStats(const UCTEdgeStats&) = delete;
+  UCTEdgeStats& operator=(const UCTEdgeStats&) = delete;
+
+  // Not thread-safe. All entries start at zero.
+  void reset(int num_edges) {
+    numEdges_ = num_edges;
+    padded_ = (num_edges + kUCTPadding - 1) / kUCTPadding * kUCTPadding;
+    if (padded_ == 0) {
+      floats_.reset();
+      visits_.reset();
+      return;
+    }
+    // Value-initialized, i.e. zero.
+    floats_.reset(new std::atomic<float>[3 * padded_]());
+    visits_.reset(new std::atomic<int>[padded_]());
+  }
+
+  int size() const {
+    return numEdges_;
+  }
+
+  // Heap bytes of the arrays.
+  size_t bytes() const {
+    return padded_ *
+        (3 * sizeof(std::atomic<float>) + sizeof(std::atomic<int>));
+  }
+
+  float prior(int i) const {
+    return floats_[i].load(std::memory_order_relaxed);
+  }
+
+  void setPrior(int i, float p) {
+    floats_[i].store(p, std::memory_order_relaxed);
+  }
+
+  void addVirtualLoss(int i, float virtual_loss) {
+    atomicAdd(&floats_[2 * padded_ + i], virtual_loss);
+  }
+
+  // Count a visit with its reward, and take back its virtual loss.
+  void update(int i, float reward, float virtual_loss) {
+    atomicAdd(&floats_[padded_ + i], reward);
+    visits_[i].fetch_add(1, std::memory_order_relaxed);
+    atomicAdd(&floats_[2 * padded_ + i], -virtual_loss);
+  }
+
+  EdgeInfo snapshot(int i) const {
+    EdgeInfo info(prior(i));
+    info.reward = floats_[padded_ + i].load(std::memory_order_relaxed);
+    info.num_visits = visits_[i].load(std::memory_order_relaxed);
+    info.virtual_loss =
+        floats_[2 * padded_ + i].load(std::memory_order_relaxed);
+    return info;
+  }
+
+  // Kernel input; the caller fills in the search parameters.
+  UCTInput input() const {
+    UCTInput in;
+    const float* floats = reinterpret_cast<const float*>(floats_.get());
+    in.prior = floats;
+    in.reward = floats + padded_;
+    in.virtual_loss = floats + 2 * padded_;
+    in.num_visits = reinterpret_cast<const int*>(visits_.get());
+    in.num_edges = numEdges_;
+    return in;
+  }
+
+ private:
+  int numEdges_ = 0;
+  int padded_ = 0;
+  // prior | reward | virtual loss, padded_ entries each.
+  std::unique_ptr<std::atomic<float>[]> floats_;
+  std::unique_ptr<std::atomic<int>[]> visits_;
+};
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tree_search_uct.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace elf {
+namespace ai {
+namespace tree_search {
+
+namespace {
+
+// Random edge statistics, padded as UCTEdgeStats pads them.
+struct RandomEdges {
+  std::vector<float> prior;
+  std::vector<float> reward;
+  std::vector<int> num_visits;
+  std::vector<float> virtual_loss;
+  UCTInput in;
+
+  RandomEdges(std::mt19937* rng, int n) {
+    const int padded = (n + kUCTPadding - 1) / kUCTPadding * kUCTPadding;
+    prior.resize(padded, 0.0f);
+    reward.resize(padded, 0.0f);
+    num_visits.resize(padded, 0);
+    virtual_loss.resize(padded, 0.0f);
+
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> visits(0, 50);
+    std::uniform_int_distribution<int> vl(0, 3);
+    for (int i = 0; i < n; ++i) {
+      prior[i] = unit(*rng);
+      // Many unvisited edges.
+      num_visits[i] = unit(*rng) < 0.4f ? 0 : visits(*rng);
+      reward[i] = num_visits[i] * (2 * unit(*rng) - 1);
+      virtual_loss[i] = unit(*rng) < 0.3f ? vl(*rng) : 0;
+    }
+
+    in.prior = prior.data();
+    in.reward = reward.data();
+    in.num_visits = num_visits.data();
+    in.virtual_loss = virtual_loss.data();
+    in.num_edges = n;
+    in.flip_q_sign = unit(*rng) < 0.5f;
+    in.use_prior = unit(*rng) < 0.8f;
+    in.c_puct = 0.5f + 4 * unit(*rng);
+    in.sqrt_parent_visits = std::sqrt(1.0f + visits(*rng) * n);
+    // unexplored_q_zero sets the default q to 0.
+    in.unsigned_default_q = unit(*rng) < 0.3f ? 0.0f : 2 * unit(*rng) - 1;
+  }
+
+  float score(int i) const {
+    EdgeInfo edge(prior[i]);
+    edge.reward = reward[i];
+    edge.num_visits = num_visits[i];
+    edge.virtual_loss = virtual_loss[i];
+    // sqrt_parent_visits is sqrt(total_parent_visits).
+    Score s = edge.getScore(in.flip_q_sign, 1, in.unsigned_default_q);
+    s.prior_probability *= in.sqrt_parent_visits;
+    return in.use_prior ? s.prior_probability * in.c_puct + s.q : s.q;
+  }
+};
+
+// Kernels may round (or contract into FMAs) differently.
+float tolerance(float score) {
+  return 1e-5f * std::max(1.0f, std::abs(score));
+}
+
+void expectSame(
+    const RandomEdges& edges,
+    const UCTOutput& expected,
+    const UCTOutput& actual,
+    const std::string& name) {
+  SCOPED_TRACE(name + ", #edges: " + std::to_string(edges.in.num_edges));
+  ASSERT_GE(actual.edge_idx, 0);
+  ASSERT_LT(actual.edge_idx, edges.in.num_edges);
+  EXPECT_EQ(actual.total_visits, expected.total_visits);
+  EXPECT_NEAR(actual.total_unsigned_q, expected.total_unsigned_q, 1e-3);
+  EXPECT_NEAR(
+      actual.max_score, expected.max_score, tolerance(expected.max_score));
+  // Rounding may break a near tie the other way.
+  if (actual.edge_idx != expected.edge_idx) {
+    EXPECT_NEAR(
+        edges.score(actual.edge_idx),
+        expected.max_score,
+        tolerance(expected.max_score));
+  }
+}
+
+} // namespace
+
+TEST(UCTTest, scalarMatchesEdgeInfo) {
+  std::mt19937 rng(1);
+  for (int trial = 0; trial < 200; ++trial) {
+    RandomEdges edges(&rng, 1 + trial % 40);
+    const UCTOutput out = uctScalar(edges.in);
+
+    int best = -1;
+    float best_score = std::numeric_limits<float>::lowest();
+    for (int i = 0; i < edges.in.num_edges; ++i) {
+      const float s = edges.score(i);
+      if (s > best_score) {
+        best_score = s;
+        best = i;
+      }
+    }
+    EXPECT_NEAR(out.max_score, best_score, tolerance(best_score));
+    if (out.edge_idx != best) {
+      EXPECT_NEAR(
+          edges.score(out.edge_idx), best_score, tolerance(best_score));
+    }
+  }
+}
+
+TEST(UCTTest, kernelsMatchScalar) {
+  using Kernel = std::function<UCTOutput(const UCTInput&)>;
+  std::vector<std::pair<std::string, Kernel>> kernels = {
+      {"uctSelect", uctSelect}};
+#ifdef __AVX2__
+  kernels.emplace_back("uctAVX2", uctAVX2);
+#endif
+#ifdef __SSE4_1__
+  kernels.emplace_back("uctSSE", uctSSE);
+#endif
+
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> size(1, 400);
+  for (int trial = 0; trial < 2000; ++trial) {
+    // All sizes around the vector widths, then random ones.
+    RandomEdges edges(&rng, trial < 40 ? trial + 1 : size(rng));
+    const UCTOutput expected = uctScalar(edges.in);
+    for (const auto& kernel : kernels) {
+      expectSame(edges, expected, kernel.second(edges.in), kernel.first);
+    }
+  }
+}
+
+TEST(UCTTest, tiesGoToLowestIndex) {
+  std::mt19937 rng(3);
+  for (int n : {1, 3, 8, 13, 64}) {
+    RandomEdges edges(&rng, n);
+    for (int i = 0; i < n; ++i) {
+      edges.prior[i] = 0.5f;
+      edges.reward[i] = 0.0f;
+      edges.num_visits[i] = 0;
+      edges.virtual_loss[i] = 0.0f;
+    }
+    EXPECT_EQ(uctScalar(edges.in).edge_idx, 0);
+    EXPECT_EQ(uctSelect(edges.in).edge_idx, 0);
+    EXPECT_EQ(uctSelect(edges.in).total_visits, 0);
+  }
+}
+
+TEST(UCTTest, edgeStats) {
+  UCTEdgeStats stats;
+  stats.reset(5);
+  EXPECT_EQ(stats.size(), 5);
+  for (int i = 0; i < 5; ++i) {
+    stats.setPrior(i, 0.2f);
+  }
+  stats.addVirtualLoss(3, 1.0f);
+  stats.update(3, 0.5f, 1.0f);
+  stats.update(3, -1.0f, 0.0f);
+  stats.addVirtualLoss(1, 2.0f);
+
+  EdgeInfo edge = stats.snapshot(3);
+  EXPECT_EQ(edge.prior_probability, 0.2f);
+  EXPECT_EQ(edge.reward, -0.5f);
+  EXPECT_EQ(edge.num_visits, 2);
+  EXPECT_EQ(edge.virtual_loss, 0.0f);
+  EXPECT_EQ(stats.snapshot(1).virtual_loss, 2.0f);
+
+  UCTInput in = stats.input();
+  EXPECT_EQ(in.num_edges, 5);
+  EXPECT_EQ(in.num_visits[3], 2);
+  EXPECT_EQ(in.virtual_loss[1], 2.0f);
+  // Padding reads as zero.
+  for (int i = 5; i < kUCTPadding; ++i) {
+    EXPECT_EQ(in.prior[i], 0.0f);
+    EXPECT_EQ(in.num_visits[i], 0);
+  }
+
+  in.flip_q_sign = false;
+  in.use_prior = true;
+  in.c_puct = 1.0f;
+  in.sqrt_parent_visits = std::sqrt(3.0f);
+  in.unsigned_default_q = 0.0f;
+  const UCTOutput out = uctSelect(in);
+  // Edges 1 and 3 have (virtual) visits.
+  EXPECT_EQ(out.total_visits, 2);
+  EXPECT_EQ(out.edge_idx, 0);
+}
+
+} // namespace tree_search
+} // namespace ai
+} // namespace elf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
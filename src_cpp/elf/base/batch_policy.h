@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "elf/legacy/pybind_helper.h"
+
+namespace elf {
+
+// Tunes the deadline of a batch to the arrival rate of the requests, so that
+// batches are about target_fill full when the deadline passes. Off if
+// target_fill is 0.
+struct AdaptiveTimeoutOptions {
+  float target_fill = 0;
+  int min_timeout_usec = 0;
+  int max_timeout_usec = 0;
+  // Weight of the latest batch in the rate estimate.
+  float smoothing = 0.1;
+
+  bool enabled() const {
+    return target_fill > 0;
+  }
+};
+
+class AdaptiveTimeout {
+ public:
+  AdaptiveTimeout(const AdaptiveTimeoutOptions& options, int batchsize)
+      : options_(options), batchsize_(batchsize) {}
+
+  bool enabled() const {
+    return options_.enabled();
+  }
+
+  void disable() {
+    options_.target_fill = 0;
+  }
+
+  int timeoutUsec() const {
+    // Expected wait for the rest of the batch after its first request.
+    const double wanted = options_.target_fill * batchsize_ - 1;
+    double timeout = options_.max_timeout_usec;
+    if (ratePerUsec_ > 0) {
+      timeout = std::min(timeout, wanted / ratePerUsec_);
+    }
+    // 0 would wait for a full batch.
+    return std::max<int>(std::max(options_.min_timeout_usec, 1), timeout);
+  }
+
+  // A batch of n requests, during which the server saw the requests that
+  // arrived for window_usec after the first one.
+  void update(int n, int64_t window_usec) {
+    if (n <= 0 || (n == 1 && window_usec <= 0)) {
+      return;
+    }
+    const double rate = (n - 1) / std::max<double>(window_usec, 1);
+    if (ratePerUsec_ < 0) {
+      ratePerUsec_ = rate;
+    } else {
+      ratePerUsec_ += options_.smoothing * (rate - ratePerUsec_);
+    }
+  }
+
+  double ratePerUsec() const {
+    return ratePerUsec_;
+  }
+
+ private:
+  AdaptiveTimeoutOptions options_;
+  int batchsize_;
+  // < 0 before the first batch.
+  double ratePerUsec_ = -1;
+};
+
+// How the batches of a label were formed.
+struct BatchStats {
+  static constexpr int kNumDelayBuckets = 32;
+
+  int64_t num_batches = 0;
+  int64_t num_requests = 0;
+  // batch_sizes[n]: number of batches of n requests.
+  std::vector<int64_t> batch_sizes;
+  // Time from the arrival of a request to the forming of its batch.
+  // queue_delay_usec[0] counts the requests that waited less than 1 usec,
+  // and queue_delay_usec[i] those that waited in [2^(i-1), 2^i) usec.
+  std::vector<int64_t> queue_delay_usec =
+      std::vector<int64_t>(kNumDelayBuckets);
+  int64_t total_queue_delay_usec = 0;
+  // Largest current deadline among the servers of the label.
+  int timeout_usec = 0;
+
+  explicit BatchStats(int batchsize = 0) : batch_sizes(batchsize + 1) {}
+
+  float meanBatchSize() const {
+    return num_batches > 0 ? float(num_requests) / num_batches : 0.0;
+  }
+
+  float meanQueueDelayUsec() const {
+    return num_requests > 0 ? float(total_queue_delay_usec) / num_requests
+                            : 0.0;
+  }
+
+  void addBatch(int n) {
+    if (n >= (int)batch_sizes.size()) {
+      batch_sizes.resize(n + 1);
+    }
+    num_batches++;
+    num_requests += n;
+    batch_sizes[n]++;
+  }
+
+  void addQueueDelay(int64_t delay_usec, int n) {
+    delay_usec = std::max<int64_t>(delay_usec, 0);
+    int bucket = 0;
+    while (bucket < kNumDelayBuckets - 1 && (delay_usec >> bucket) > 0) {
+      bucket++;
+    }
+    queue_delay_usec[bucket] += n;
+    total_queue_delay_usec += delay_usec * n;
+  }
+
+  void add(const BatchStats& other) {
+    num_batches += other.num_batches;
+    num_requests += other.num_requests;
+    if (other.batch_sizes.size() > batch_sizes.size()) {
+      batch_sizes.resize(other.batch_sizes.size());
+    }
+    for (size_t i = 0; i < other.batch_sizes.size(); ++i) {
+      batch_sizes[i] += other.batch_sizes[i];
+    }
+    for (int i = 0; i < kNumDelayBuckets; ++i) {
+      queue_delay_usec[i] += other.queue_delay_usec[i];
+    }
+    total_queue_delay_usec += other.total_queue_delay_usec;
+    timeout_usec = std::max(timeout_usec, other.timeout_usec);
+  }
+
+  std::string info() const {
+    std::stringstream ss;
+    ss << "[batches=" << num_batches << "][requests=" << num_requests
+       << "][mean_bs=" << meanBatchSize()
+       << "][mean_delay_usec=" << meanQueueDelayUsec()
+       << "][timeout_usec=" << timeout_usec << "]";
+    return ss.str();
+  }
+
+  REGISTER_PYBIND_FIELDS(
+      num_batches,
+      num_requests,
+      batch_sizes,
+      queue_delay_usec,
+      total_queue_delay_usec,
+      timeout_usec);
+};
+
+} // namespace elf
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "batch_policy.h"
+
+#include <chrono>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "elf/comm/comm.h"
+#include "elf/concurrency/ConcurrentQueue.h"
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+namespace {
+
+using Comm = comm::CommT<
+    int,
+    false,
+    elf::concurrency::ConcurrentQueue,
+    elf::concurrency::ConcurrentQueueMPMC>;
+
+// Sends one request to "actor" after each delay, each from its own thread.
+class Senders {
+ public:
+  Senders(Comm* comm, const std::vector<milliseconds>& delays) {
+    const auto start = Clock::now();
+    for (size_t i = 0; i < delays.size(); ++i) {
+      threads_.emplace_back([comm, start, delay = delays[i], i]() {
+        auto client = comm->getClient();
+        std::this_thread::sleep_until(start + delay);
+        client->sendWait(i, {"actor"});
+      });
+    }
+  }
+
+  ~Senders() {
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+};
+
+class BatchPolicyTest : public ::testing::Test {
+ protected:
+  Comm comm_;
+  std::unique_ptr<Comm::Server> server_ = comm_.getServer();
+  std::vector<Comm::Message> batch_;
+
+  void SetUp() override {
+    server_->RegServer("actor");
+  }
+
+  int wait(const comm::RecvOptions& options) {
+    server_->waitBatch(options, &batch_);
+    int n = 0;
+    for (const auto& m : batch_) {
+      n += m.data.size();
+    }
+    return n;
+  }
+
+  void release() {
+    server_->ReleaseBatch(batch_, comm::SUCCESS);
+  }
+};
+
+} // namespace
+
+TEST_F(BatchPolicyTest, minBatchSize) {
+  Senders senders(
+      &comm_, {milliseconds(0), milliseconds(20), milliseconds(40)});
+  // The deadline passes long before the third request.
+  EXPECT_EQ(wait(comm::RecvOptions("actor", 4, 1000, 3)), 3);
+  release();
+}
+
+TEST_F(BatchPolicyTest, deadlineFromFirstArrival) {
+  std::vector<milliseconds> delays;
+  for (int i = 0; i < 8; ++i) {
+    delays.push_back(milliseconds(10 * i));
+  }
+  Senders senders(&comm_, delays);
+
+  // Requests come every 10ms, more often than the timeout.
+  const int n = wait(comm::RecvOptions("actor", 8, 35000, 1));
+  const auto elapsed = Clock::now() - batch_[0].sent;
+  EXPECT_GE(elapsed, milliseconds(35));
+  EXPECT_LT(elapsed, milliseconds(60));
+  EXPECT_GE(n, 3);
+  EXPECT_LE(n, 5);
+  release();
+
+  EXPECT_EQ(wait(comm::RecvOptions("actor", 8 - n)), 8 - n);
+  release();
+}
+
+TEST_F(BatchPolicyTest, emptyBatch) {
+  const auto start = Clock::now();
+  EXPECT_EQ(wait(comm::RecvOptions("actor", 4, 10000, 0)), 0);
+  EXPECT_GE(Clock::now() - start, milliseconds(10));
+  EXPECT_TRUE(batch_.empty());
+}
+
+TEST(AdaptiveTimeoutTest, followsArrivalRate) {
+  elf::AdaptiveTimeoutOptions options;
+  options.target_fill = 0.5;
+  options.min_timeout_usec = 10;
+  options.max_timeout_usec = 10000;
+  options.smoothing = 0.5;
+  elf::AdaptiveTimeout timeout(options, 34);
+  // Nothing known yet.
+  EXPECT_EQ(timeout.timeoutUsec(), 10000);
+
+  // 16 more requests take 1600 usec at one request per 100 usec.
+  timeout.update(34, 3300);
+  EXPECT_NEAR(timeout.timeoutUsec(), 1600, 1);
+  for (int i = 0; i < 20; ++i) {
+    timeout.update(5, 400);
+  }
+  EXPECT_NEAR(timeout.timeoutUsec(), 1600, 1);
+
+  // Faster, down to the minimum.
+  for (int i = 0; i < 20; ++i) {
+    timeout.update(34, 33);
+  }
+  EXPECT_EQ(timeout.timeoutUsec(), 16);
+  timeout.update(34, 1);
+  timeout.update(34, 1);
+  EXPECT_EQ(timeout.timeoutUsec(), 10);
+
+  // Nothing came after the first request, up to the maximum.
+  for (int i = 0; i < 20; ++i) {
+    timeout.update(1, 10000);
+  }
+  EXPECT_EQ(timeout.timeoutUsec(), 10000);
+}
+
+TEST(BatchStatsTest, histograms) {
+  elf::BatchStats stats(4);
+  stats.addBatch(4);
+  stats.addQueueDelay(0, 1);
+  stats.addQueueDelay(1, 1);
+  stats.addQueueDelay(3, 1);
+  stats.addQueueDelay(1000, 1);
+  stats.addBatch(2);
+  stats.addQueueDelay(4, 2);
+
+  EXPECT_EQ(stats.batch_sizes, std::vector<int64_t>({0, 0, 1, 0, 1}));
+  EXPECT_EQ(stats.meanBatchSize(), 3);
+  EXPECT_EQ(stats.queue_delay_usec[0], 1);
+  EXPECT_EQ(stats.queue_delay_usec[1], 1);
+  EXPECT_EQ(stats.queue_delay_usec[2], 1);
+  EXPECT_EQ(stats.queue_delay_usec[3], 2);
+  // 1000 is in [512, 1024).
+  EXPECT_EQ(stats.queue_delay_usec[10], 1);
+  EXPECT_EQ(stats.total_queue_delay_usec, 1012);
+
+  elf::BatchStats total;
+  total.add(stats);
+  total.add(stats);
+  EXPECT_EQ(total.num_batches, 4);
+  EXPECT_EQ(total.batch_sizes[4], 2);
+  EXPECT_EQ(
+      std::accumulate(
+          total.queue_delay_usec.begin(), total.queue_delay_usec.end(), 0),
+      total.num_requests);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -13,11 +13,14 @@
 
 #include <atomic>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <set>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 
@@ -25,6 +28,7 @@
 #include "elf/concurrency/ConcurrentQueue.h"
 #include "elf/concurrency/Counter.h"
 #include "elf/logging/IndexedLoggerFactory.h"
+#include "direct_batch.h"
 #include "extractor.h"
 #include "sharedmem.h"
 
@@ -73,15 +77,21 @@ class GameClient {
 
   comm::ReplyStatus sendWait(
       const std::vector<std::string>& targets,
-      FuncsWithState* funcs) {
-    return client_->sendWait(funcs, targets);
-  }
+      FuncsWithState* funcs);
 
   comm::ReplyStatus sendBatchWait(
       const std::vector<std::string>& targets,
-      const std::vector<FuncsWithState*>& funcs) {
-    return client_->sendBatchWait(funcs, targets);
-  }
+      const std::vector<FuncsWithState*>& funcs);
+
+  // Non-blocking sendBatchWait. funcs (and the states bound to them) must
+  // stay alive until the returned future is ready, and it must be waited on:
+  // the batches of DIRECT targets are sealed at their deadline by the wait.
+  std::future<comm::ReplyStatus> sendBatchAsync(
+      const std::vector<std::string>& targets,
+      const std::vector<FuncsWithState*>& funcs);
+
+  // Largest batch that all the targets take at once (0 if none is known).
+  int getBatchSize(const std::vector<std::string>& targets) const;
 
  private:
   const Context* context_;
@@ -97,6 +107,19 @@ class GameClient {
 
   concurrency::Counter<int> numStoppedCounter_;
 
+  // A const state only goes to memory.
+  template <typename S>
+  static void bindTypedState(const S* s, FuncsWithState* funcs) {
+    funcs->state_to_mem_funcs.addTypedState(getTypedClassId<S>(), s);
+  }
+
+  template <typename S>
+  static void bindTypedState(S* s, FuncsWithState* funcs) {
+    const int class_id = getTypedClassId<S>();
+    funcs->state_to_mem_funcs.addTypedState(class_id, s);
+    funcs->mem_to_state_funcs.addTypedState(class_id, s);
+  }
+
   void prepareToStop() {
     prepareToStop_ = true;
   }
@@ -105,6 +128,109 @@ class GameClient {
     stop_games_ = true;
     numStoppedCounter_.waitUntilCount(n_);
   }
+
+  // Some of the targets have the DIRECT transfer type.
+  comm::ReplyStatus sendDirect(
+      const std::vector<std::string>& targets,
+      FuncsWithState* const* funcs,
+      size_t n);
+};
+
+// The functions of some targets bound to states S*..., made once and reused
+// by every send while the states stay at the same addresses (bound functions
+// only keep pointers to them). A send then costs no binding, nor any
+// allocation. E.g. with the state and the reply of a game:
+//
+//   StateBindingT<const State, Reply> binding(client, {"actor"});
+//   binding.sendWait(&state, &reply);
+//
+// Not thread-safe: there is one binding per game thread.
+template <typename... S>
+class StateBindingT {
+ public:
+  StateBindingT(GameClient* client, const std::vector<std::string>& targets)
+      : client_(client), targets_(targets) {}
+
+  // Rebinds only if one of the states moved.
+  FuncsWithState* bind(S*... s) {
+    const std::tuple<S*...> states(s...);
+    if (!bound_ || states != states_) {
+      funcs_ = FuncsWithState();
+      (funcs_.add(client_->BindStateToFunctions(targets_, s)), ...);
+      states_ = states;
+      bound_ = true;
+    }
+    return &funcs_;
+  }
+
+  comm::ReplyStatus sendWait(S*... s) {
+    return client_->sendWait(targets_, bind(s...));
+  }
+
+ private:
+  GameClient* client_;
+  std::vector<std::string> targets_;
+  std::tuple<S*...> states_;
+  bool bound_ = false;
+  FuncsWithState funcs_;
+};
+
+// Same as StateBindingT, for batches of states. The batches, one per type,
+// have the same size.
+template <typename... S>
+class BatchStateBindingT {
+ public:
+  BatchStateBindingT(
+      GameClient* client,
+      const std::vector<std::string>& targets)
+      : client_(client), targets_(targets) {}
+
+  bool isBoundTo(const std::vector<S*>&... batch) const {
+    return bound_ && std::tie(batch...) == batches_;
+  }
+
+  const std::vector<FuncsWithState*>& bind(const std::vector<S*>&... batch) {
+    if (!isBoundTo(batch...)) {
+      const size_t n = std::get<0>(std::tie(batch...)).size();
+      funcs_.assign(n, FuncsWithState());
+      (addBatch(batch), ...);
+      ptrs_.clear();
+      for (auto& funcs : funcs_) {
+        ptrs_.push_back(&funcs);
+      }
+      batches_ = std::tie(batch...);
+      bound_ = true;
+    }
+    return ptrs_;
+  }
+
+  comm::ReplyStatus sendBatchWait(const std::vector<S*>&... batch) {
+    return client_->sendBatchWait(targets_, bind(batch...));
+  }
+
+  // The binding must not change until the returned future is ready.
+  std::future<comm::ReplyStatus> sendBatchAsync(
+      const std::vector<S*>&... batch) {
+    return client_->sendBatchAsync(targets_, bind(batch...));
+  }
+
+ private:
+  GameClient* client_;
+  std::vector<std::string> targets_;
+  std::tuple<std::vector<S*>...> batches_;
+  bool bound_ = false;
+  std::vector<FuncsWithState> funcs_;
+  std::vector<FuncsWithState*> ptrs_;
+
+  template <typename T>
+  void addBatch(const std::vector<T*>& batch) {
+    assert(batch.size() == funcs_.size());
+    std::vector<FuncsWithState> funcs =
+        client_->BindStateToFunctions(targets_, batch);
+    for (size_t i = 0; i < funcs.size(); ++i) {
+      funcs_[i].add(funcs[i]);
+    }
+  }
 };
 
 class Context {
@@ -123,6 +249,10 @@ class Context {
       return *smem_;
     }
 
+    const SharedMem& smem() const {
+      return *smem_;
+    }
+
     void start() {
       th_.reset(new std::thread([&]() {
         // assert(nice(10) == 10);
@@ -248,17 +378,72 @@ class Context {
     //    LOG(INFO) << key << " ";
     // }
 
-    smem2keys_[options.getRecvOptions().label] = keys;
+    const std::string& label = options.getRecvOptions().label;
+    smem2keys_[label] = keys;
     auto anyps = extractor_.getAnyP(keys);
+    const int idx = collectors_.size() + directSmems_.size();
+
+    if (options.getTransferType() == SharedMemOptions::DIRECT) {
+      std::unique_ptr<DirectBatcher>& batcher = directBatchers_[label];
+      if (batcher == nullptr) {
+        batcher.reset(new DirectBatcher(batchClient_.get(), options));
+      }
+      directSmems_.emplace_back(
+          new SharedMem(idx, options, anyps, &extractor_));
+      batcher->addSharedMem(directSmems_.back().get());
+      return *directSmems_.back();
+    }
 
     collectors_.emplace_back(new GameStateCollector(
         server_.get(),
         batchClient_.get(),
         std::unique_ptr<SharedMem>(
-            new SharedMem(collectors_.size(), options, anyps))));
+            new SharedMem(idx, options, anyps, &extractor_))));
     return collectors_.back()->smem();
   }
 
+  // Of all the SharedMem of a label.
+  BatchStats getBatchStats(const std::string& label) const {
+    BatchStats stats;
+    auto add = [&](const SharedMem& smem) {
+      if (smem.getSharedMemOptions().getLabel() == label) {
+        stats.add(smem.getBatchStats());
+      }
+    };
+    for (const auto& r : collectors_) {
+      add(r->smem());
+    }
+    for (const auto& smem : directSmems_) {
+      add(*smem);
+    }
+    return stats;
+  }
+
+  // Batch size of the SharedMem of a label, 0 if it has none.
+  int getBatchSize(const std::string& label) const {
+    for (const auto& r : collectors_) {
+      if (r->smem().getSharedMemOptions().getLabel() == label) {
+        return r->smem().getSharedMemOptions().getBatchSize();
+      }
+    }
+    for (const auto& smem : directSmems_) {
+      if (smem->getSharedMemOptions().getLabel() == label) {
+        return smem->getSharedMemOptions().getBatchSize();
+      }
+    }
+    return 0;
+  }
+
+  // Null unless the label has the DIRECT transfer type.
+  DirectBatcher* getDirectBatcher(const std::string& label) const {
+    auto it = directBatchers_.find(label);
+    return it == directBatchers_.end() ? nullptr : it->second.get();
+  }
+
+  bool hasDirectBatchers() const {
+    return !directBatchers_.empty();
+  }
+
   const std::vector<std::string>* getSMemKeys(
       const std::string& smem_name) const {
     auto it = smem2keys_.find(smem_name);
@@ -341,6 +526,9 @@ class Context {
       for (auto& r : collectors_) {
         r->prepareToStop();
       }
+      for (auto& p : directBatchers_) {
+        p.second->prepareToStop();
+      }
 
       // Then stop all the threads.
       logger_->info("Stop all game threads ...");
@@ -372,6 +560,9 @@ class Context {
  private:
   Extractor extractor_;
   std::vector<std::unique_ptr<GameStateCollector>> collectors_;
+  std::vector<std::unique_ptr<SharedMem>> directSmems_;
+  std::unordered_map<std::string, std::unique_ptr<DirectBatcher>>
+      directBatchers_;
 
   Comm comm_;
   std::unique_ptr<Server> server_;
@@ -393,11 +584,125 @@ class Context {
   std::shared_ptr<spdlog::logger> logger_;
 };
 
+inline comm::ReplyStatus GameClient::sendWait(
+    const std::vector<std::string>& targets,
+    FuncsWithState* funcs) {
+  if (context_->hasDirectBatchers()) {
+    return sendDirect(targets, &funcs, 1);
+  }
+  return client_->sendWait(funcs, targets);
+}
+
+inline comm::ReplyStatus GameClient::sendBatchWait(
+    const std::vector<std::string>& targets,
+    const std::vector<FuncsWithState*>& funcs) {
+  if (context_->hasDirectBatchers()) {
+    return sendDirect(targets, funcs.data(), funcs.size());
+  }
+  return client_->sendBatchWait(funcs, targets);
+}
+
+inline std::future<comm::ReplyStatus> GameClient::sendBatchAsync(
+    const std::vector<std::string>& targets,
+    const std::vector<FuncsWithState*>& funcs) {
+  if (!context_->hasDirectBatchers()) {
+    return client_->sendBatchAsync(funcs, targets);
+  }
+
+  // One future per DIRECT target, and one for all the others.
+  std::vector<std::future<comm::ReplyStatus>> sent;
+  std::vector<std::string> others;
+  for (const auto& target : targets) {
+    DirectBatcher* batcher = context_->getDirectBatcher(target);
+    if (batcher != nullptr) {
+      sent.push_back(batcher->sendBatchAsync(funcs.data(), funcs.size()));
+    } else {
+      others.push_back(target);
+    }
+  }
+  if (!others.empty()) {
+    sent.push_back(client_->sendBatchAsync(funcs, others));
+  }
+  if (sent.size() == 1) {
+    return std::move(sent[0]);
+  }
+  return std::async(std::launch::deferred, [sent = std::move(sent)]() mutable {
+    comm::ReplyStatus status = comm::SUCCESS;
+    for (auto& f : sent) {
+      const comm::ReplyStatus res = f.get();
+      if (res != comm::SUCCESS) {
+        status = res;
+      }
+    }
+    return status;
+  });
+}
+
+inline int GameClient::getBatchSize(
+    const std::vector<std::string>& targets) const {
+  int batchsize = 0;
+  for (const auto& target : targets) {
+    const int n = context_->getBatchSize(target);
+    if (n > 0 && (batchsize == 0 || n < batchsize)) {
+      batchsize = n;
+    }
+  }
+  return batchsize;
+}
+
+inline comm::ReplyStatus GameClient::sendDirect(
+    const std::vector<std::string>& targets,
+    FuncsWithState* const* funcs,
+    size_t n) {
+  // Reused by the next call from the same thread.
+  static thread_local std::vector<DirectBatcher*> batchers;
+  static thread_local std::vector<std::string> others;
+  static thread_local std::vector<DirectBatcher::Ticket> tickets;
+  batchers.clear();
+  others.clear();
+  for (const auto& target : targets) {
+    DirectBatcher* batcher = context_->getDirectBatcher(target);
+    if (batcher != nullptr) {
+      batchers.push_back(batcher);
+    } else {
+      others.push_back(target);
+    }
+  }
+  if (batchers.empty()) {
+    return n == 1 ? client_->sendWait(funcs[0], others)
+                  : client_->sendBatchWait(
+                        std::vector<FuncsWithState*>(funcs, funcs + n),
+                        others);
+  }
+  if (batchers.size() == 1 && others.empty()) {
+    return batchers[0]->sendBatchWait(funcs, n);
+  }
+
+  // The direct targets are filled while the others process the request.
+  tickets.clear();
+  comm::ReplyStatus status = comm::SUCCESS;
+  for (DirectBatcher* batcher : batchers) {
+    for (size_t i = 0; i < n; ++i) {
+      status = batcher->send(funcs[i], &tickets, status);
+    }
+  }
+  if (!others.empty()) {
+    const comm::ReplyStatus res = client_->sendBatchWait(
+        std::vector<FuncsWithState*>(funcs, funcs + n), others);
+    if (res != comm::SUCCESS) {
+      status = res;
+    }
+  }
+  return DirectBatcher::waitAll(tickets, status);
+}
+
 template <typename S>
 inline FuncsWithState GameClient::BindStateToFunctions(
     const std::vector<std::string>& smem_names,
     S* s) {
   const Extractor& extractor = context_->getExtractor();
+  const TypedClassBase* typed =
+      extractor.getTypedClass<typename std::remove_cv<S>::type>();
   FuncsWithState funcsWithState;
 
   std::set<std::string> dup;
@@ -420,20 +725,22 @@ inline FuncsWithState GameClient::BindStateToFunctions(
         continue;
       }
 
-      if (funcsWithState.state_to_mem_funcs.addFunction(
-              key, funcs->BindStateToStateToMemFunc(*s))) {
-        // LOG(INFO) << "GetPackage: key: " << key << "Add s2m "
-        //           << std:: endl;
+      // The typed fields of S are bound all at once, below.
+      if (typed == nullptr || !typed->hasStateToMem(key)) {
+        funcsWithState.state_to_mem_funcs.addFunction(
+            key, funcs->BindStateToStateToMemFunc(*s));
       }
 
-      if (funcsWithState.mem_to_state_funcs.addFunction(
-              key, funcs->BindStateToMemToStateFunc(*s))) {
-        // LOG(INFO) << "GetPackage: key: " << key << "Add m2s "
-        //           << std::endl;
+      if (typed == nullptr || !typed->hasMemToState(key)) {
+        funcsWithState.mem_to_state_funcs.addFunction(
+            key, funcs->BindStateToMemToStateFunc(*s));
       }
       dup.insert(key);
     }
   }
+  if (typed != nullptr) {
+    bindTypedState(s, &funcsWithState);
+  }
   return funcsWithState;
 }
 
@@ -442,6 +749,8 @@ inline std::vector<FuncsWithState> GameClient::BindStateToFunctions(
     const std::vector<std::string>& smem_names,
     const std::vector<S*>& batch_s) {
   const Extractor& extractor = context_->getExtractor();
+  const TypedClassBase* typed =
+      extractor.getTypedClass<typename std::remove_cv<S>::type>();
   std::vector<FuncsWithState> batchFuncsWithState(batch_s.size());
 
   std::set<std::string> dup;
@@ -468,21 +777,24 @@ inline std::vector<FuncsWithState> GameClient::BindStateToFunctions(
         auto& funcsWithState = batchFuncsWithState[i];
         S* s = batch_s[i];
 
-        if (funcsWithState.state_to_mem_funcs.addFunction(
-                key, funcs->BindStateToStateToMemFunc(*s))) {
-          // LOG(INFO) << "GetPackage: key: " << key << "Add s2m "
-          //           << std:: endl;
+        if (typed == nullptr || !typed->hasStateToMem(key)) {
+          funcsWithState.state_to_mem_funcs.addFunction(
+              key, funcs->BindStateToStateToMemFunc(*s));
         }
 
-        if (funcsWithState.mem_to_state_funcs.addFunction(
-                key, funcs->BindStateToMemToStateFunc(*s))) {
-          // LOG(INFO) << "GetPackage: key: " << key << "Add m2s "
-          //           << std::endl;
+        if (typed == nullptr || !typed->hasMemToState(key)) {
+          funcsWithState.mem_to_state_funcs.addFunction(
+              key, funcs->BindStateToMemToStateFunc(*s));
         }
       }
       dup.insert(key);
     }
   }
+  if (typed != nullptr) {
+    for (size_t i = 0; i < batch_s.size(); ++i) {
+      bindTypedState(batch_s[i], &batchFuncsWithState[i]);
+    }
+  }
   return batchFuncsWithState;
 }
 
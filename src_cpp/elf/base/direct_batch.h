@@ -0,0 +1,422 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "elf/comm/comm.h"
+#include "elf/concurrency/ConcurrentQueue.h"
+
+#include "sharedmem.h"
+
+namespace elf {
+
+// The SharedMem of a label with the DIRECT transfer type. A game thread
+// claims a slot of the batch being formed, and writes its state there
+// itself. The thread that completes the batch, when it is full or at its
+// deadline, publishes it to Context::wait(). The game threads then read their
+// replies from their slots, and the last one opens the batch again.
+//
+// No collector thread nor comm queue is involved: there is no thread hop
+// between the game threads and the one of Context::wait().
+//
+// The batch size, minimum and deadline are the ones of the SharedMemOptions of
+// the first SharedMem. The adaptive timeout is not supported.
+//
+// An async send takes no thread either: the thread that publishes a batch
+// reads the replies of its async slots itself, so they never hold the batch,
+// and the future of the send is ready once all of them are read.
+class DirectBatcher {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // A claimed slot, written, whose reply is to be read.
+  struct Ticket {
+    DirectBatcher* batcher = nullptr;
+    size_t batch = 0;
+    int slot = -1;
+    FuncsWithState* funcs = nullptr;
+  };
+
+  DirectBatcher(BatchClient* batchClient, const SharedMemOptions& options)
+      : batchClient_(batchClient),
+        batchsize_(options.getBatchSize()),
+        minBatchSize_(std::max(options.getMinBatchSize(), 1)),
+        timeoutUsec_(options.getRecvOptions().wait_opt.timeout_usec) {}
+
+  DirectBatcher(const DirectBatcher&) = delete;
+  DirectBatcher& operator=(const DirectBatcher&) = delete;
+
+  // One batch per SharedMem.
+  void addSharedMem(SharedMem* smem) {
+    batches_.emplace_back(new Batch(smem, batchsize_));
+  }
+
+  // While stopping, incomplete batches go out at once.
+  void prepareToStop() {
+    minBatchSize_ = 1;
+    timeoutUsec_ = 2;
+    for (auto& b : batches_) {
+      b->replied.notifyAll();
+    }
+  }
+
+  // Writes funcs[i] to a slot each, then waits for the replies.
+  comm::ReplyStatus sendBatchWait(FuncsWithState* const* funcs, size_t n) {
+    std::vector<Ticket>& tickets = localTickets();
+    tickets.clear();
+    comm::ReplyStatus status = comm::SUCCESS;
+    for (size_t i = 0; i < n; ++i) {
+      status = send(funcs[i], &tickets, status);
+    }
+    return waitAll(tickets, status);
+  }
+
+  // The two halves of sendBatchWait(), to wait for other targets in between.
+  // The ticket is appended to tickets. If no batch is open, the replies of
+  // tickets are read first, since our slots may hold the batches that we
+  // wait for, and tickets is emptied. Returns status, or the failure of one
+  // of the replies read.
+  comm::ReplyStatus send(
+      FuncsWithState* funcs,
+      std::vector<Ticket>* tickets,
+      comm::ReplyStatus status) {
+    Ticket ticket;
+    while (!trySend(funcs, &ticket, nullptr)) {
+      status = waitAll(*tickets, status);
+      tickets->clear();
+      waitOpen();
+    }
+    tickets->push_back(ticket);
+    return status;
+  }
+
+  // Writes funcs[i] to a slot each, and returns without waiting for the
+  // replies. The states of funcs must stay alive until the returned future
+  // is ready. Waiting on it seals the batches at their deadline, so it must
+  // be waited on, like the tickets of send().
+  std::future<comm::ReplyStatus> sendBatchAsync(
+      FuncsWithState* const* funcs,
+      size_t n) {
+    std::shared_ptr<AsyncSend> async = std::make_shared<AsyncSend>(n);
+    std::future<comm::ReplyStatus> replied = async->promise.get_future();
+    if (n == 0) {
+      async->promise.set_value(comm::SUCCESS);
+    }
+    const auto sent = Clock::now();
+    std::vector<size_t> batches;
+    for (size_t i = 0; i < n; ++i) {
+      Ticket ticket;
+      while (!trySend(funcs[i], &ticket, async)) {
+        waitOpen();
+      }
+      if (std::find(batches.begin(), batches.end(), ticket.batch) ==
+          batches.end()) {
+        batches.push_back(ticket.batch);
+      }
+    }
+
+    return std::async(
+        std::launch::deferred,
+        [this,
+         batches = std::move(batches),
+         sent,
+         replied = std::move(replied)]() mutable {
+          return waitAsync(batches, sent, &replied);
+        });
+  }
+
+  // Of any batchers.
+  static comm::ReplyStatus waitAll(
+      const std::vector<Ticket>& tickets,
+      comm::ReplyStatus status) {
+    for (const Ticket& t : tickets) {
+      const comm::ReplyStatus res = t.batcher->wait(t);
+      if (res != comm::SUCCESS) {
+        status = res;
+      }
+    }
+    return status;
+  }
+
+ private:
+  // state of a batch: the slots claimed, and the slots claimed but not
+  // written yet, plus one while the batch takes claims.
+  static constexpr uint64_t kSealed = uint64_t(1) << 63;
+  static constexpr int kClaimedShift = 32;
+  static constexpr uint64_t kPendingMask = (uint64_t(1) << 32) - 1;
+
+  // The slots of a sendBatchAsync() not read yet.
+  struct AsyncSend {
+    std::atomic<size_t> unread;
+    std::atomic<comm::ReplyStatus> status{comm::SUCCESS};
+    std::promise<comm::ReplyStatus> promise;
+
+    explicit AsyncSend(size_t n) : unread(n) {}
+
+    void read(comm::ReplyStatus res) {
+      if (res != comm::SUCCESS) {
+        status = res;
+      }
+      if (unread.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        promise.set_value(status);
+      }
+    }
+  };
+
+  struct AsyncSlot {
+    std::shared_ptr<AsyncSend> send;
+    FuncsWithState* funcs = nullptr;
+  };
+
+  struct Batch {
+    SharedMem* smem;
+    std::atomic<uint64_t> state{1};
+    // Slots that have not read their reply yet.
+    std::atomic<int> unread{0};
+    std::atomic<bool> isReplied{false};
+    comm::ReplyStatus status = comm::UNKNOWN;
+    // Of the first claim, in ns since the epoch of Clock. 0 if unknown.
+    std::atomic<int64_t> firstNs{0};
+    std::vector<Clock::time_point> arrivals;
+    // Of the slots of async sends, the others are empty.
+    std::vector<AsyncSlot> async;
+    concurrency::Waiters replied;
+
+    Batch(SharedMem* smem, int batchsize)
+        : smem(smem), arrivals(batchsize), async(batchsize) {}
+  };
+
+  BatchClient* batchClient_;
+  const std::vector<std::string> batchTargets_ = {""};
+  const int batchsize_;
+  std::atomic<int> minBatchSize_;
+  std::atomic<int> timeoutUsec_;
+  std::vector<std::unique_ptr<Batch>> batches_;
+  // Where the last claim went, to start the next one there.
+  std::atomic<size_t> current_{0};
+  concurrency::Waiters open_;
+
+  static int claimed(uint64_t s) {
+    return (s & ~kSealed) >> kClaimedShift;
+  }
+
+  static uint64_t pending(uint64_t s) {
+    return s & kPendingMask;
+  }
+
+  static std::vector<Ticket>& localTickets() {
+    static thread_local std::vector<Ticket> tickets;
+    return tickets;
+  }
+
+  static std::vector<std::pair<int, AsyncSlot>>& localAsyncSlots() {
+    static thread_local std::vector<std::pair<int, AsyncSlot>> slots;
+    return slots;
+  }
+
+  // Null async for a slot whose reply is read by wait().
+  bool trySend(
+      FuncsWithState* funcs,
+      Ticket* ticket,
+      const std::shared_ptr<AsyncSend>& async) {
+    const size_t start = current_.load(std::memory_order_relaxed);
+    for (size_t k = 0; k < batches_.size(); ++k) {
+      const size_t i = (start + k) % batches_.size();
+      Batch& b = *batches_[i];
+      const int slot = claim(b);
+      if (slot < 0) {
+        continue;
+      }
+      if (k > 0) {
+        current_.store(i, std::memory_order_relaxed);
+      }
+      if (slot + 1 < batchsize_) {
+        // Still open: wakes the next claimer, one at a time rather than all
+        // of them when a batch opens.
+        open_.notifyOne();
+      }
+      *ticket = {this, i, slot, funcs};
+      if (async != nullptr) {
+        b.async[slot] = {async, funcs};
+      }
+      funcs->state_to_mem_funcs.transfer(slot, *b.smem);
+      // The last writer publishes.
+      const uint64_t s = b.state.fetch_sub(1, std::memory_order_acq_rel) - 1;
+      if (pending(s) == 0) {
+        publish(b);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  int claim(Batch& b) {
+    uint64_t s = b.state.load(std::memory_order_acquire);
+    while (true) {
+      if (s & kSealed) {
+        return -1;
+      }
+      const int slot = claimed(s);
+      uint64_t next = s + (uint64_t(1) << kClaimedShift) + 1;
+      if (slot + 1 == batchsize_) {
+        // Full: no more claims, and the slots are all it waits for.
+        next = (next - 1) | kSealed;
+      }
+      if (b.state.compare_exchange_weak(
+              s, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        const auto now = Clock::now();
+        b.arrivals[slot] = now;
+        if (slot == 0) {
+          b.firstNs.store(
+              now.time_since_epoch().count(), std::memory_order_relaxed);
+        }
+        return slot;
+      }
+    }
+  }
+
+  // Takes no more claims, if the batch has enough of them.
+  void trySeal(Batch& b) {
+    uint64_t s = b.state.load(std::memory_order_acquire);
+    while (true) {
+      if ((s & kSealed) || claimed(s) < minBatchSize_) {
+        return;
+      }
+      const uint64_t next = (s - 1) | kSealed;
+      if (b.state.compare_exchange_weak(
+              s, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        if (pending(next) == 0) {
+          publish(b);
+        }
+        return;
+      }
+    }
+  }
+
+  // Blocks until the batch is processed, then reads the replies of its async
+  // slots.
+  void publish(Batch& b) {
+    const int n = claimed(b.state.load(std::memory_order_acquire));
+    b.unread.store(n, std::memory_order_relaxed);
+    b.smem->fillDirect(n, b.arrivals.data());
+    const comm::ReplyStatus status =
+        batchClient_->sendWait(b.smem, batchTargets_);
+    // Taken before the batch can open again.
+    std::vector<std::pair<int, AsyncSlot>>& slots = localAsyncSlots();
+    slots.clear();
+    for (int i = 0; i < n; ++i) {
+      if (b.async[i].send != nullptr) {
+        slots.emplace_back(i, std::move(b.async[i]));
+        b.async[i] = AsyncSlot();
+      }
+    }
+    b.status = status;
+    b.isReplied.store(true, std::memory_order_release);
+    b.replied.notifyAll();
+
+    for (auto& p : slots) {
+      p.second.funcs->mem_to_state_funcs.transfer(p.first, *b.smem);
+      release(b);
+      p.second.send->read(status);
+    }
+    slots.clear();
+  }
+
+  // At most that long between two checks of a batch.
+  static constexpr std::chrono::milliseconds kPoll{100};
+
+  // Seals b if it is past its deadline. Returns when to check it again.
+  // arrival is that of one of its claims, for when the first one is not
+  // visible yet.
+  Clock::time_point checkDeadline(Batch& b, Clock::time_point arrival) {
+    const int timeout_usec = timeoutUsec_;
+    auto until = Clock::now() + kPoll;
+    if (timeout_usec > 0) {
+      // arrival is later than the first claim.
+      const int64_t first_ns = b.firstNs.load(std::memory_order_relaxed);
+      const auto first = first_ns != 0
+          ? Clock::time_point(Clock::duration(first_ns))
+          : arrival;
+      const auto deadline = first + std::chrono::microseconds(timeout_usec);
+      if (Clock::now() >= deadline) {
+        // Until the minimum is there, the claims to come seal it.
+        trySeal(b);
+      } else {
+        until = deadline;
+      }
+    }
+    return until;
+  }
+
+  comm::ReplyStatus wait(const Ticket& t) {
+    Batch& b = *batches_[t.batch];
+    auto isReplied = [&b]() {
+      return b.isReplied.load(std::memory_order_acquire);
+    };
+    while (!isReplied()) {
+      b.replied.wait(isReplied, checkDeadline(b, b.arrivals[t.slot]));
+    }
+
+    t.funcs->mem_to_state_funcs.transfer(t.slot, *b.smem);
+    const comm::ReplyStatus status = b.status;
+    release(b);
+    return status;
+  }
+
+  // Until the slots of an async send in batches, sent then, are all read.
+  comm::ReplyStatus waitAsync(
+      const std::vector<size_t>& batches,
+      Clock::time_point sent,
+      std::future<comm::ReplyStatus>* replied) {
+    while (true) {
+      auto until = Clock::now() + kPoll;
+      for (size_t i : batches) {
+        until = std::min(until, checkDeadline(*batches_[i], sent));
+      }
+      if (replied->wait_until(until) == std::future_status::ready) {
+        return replied->get();
+      }
+    }
+  }
+
+  // A slot is read. The last one opens the batch again.
+  void release(Batch& b) {
+    if (b.unread.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      b.isReplied.store(false, std::memory_order_relaxed);
+      b.firstNs.store(0, std::memory_order_relaxed);
+      b.state.store(1, std::memory_order_release);
+      open_.notifyOne();
+    }
+  }
+
+  void waitOpen() {
+    auto isOpen = [this]() {
+      for (const auto& b : batches_) {
+        if (!(b->state.load(std::memory_order_acquire) & kSealed)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    while (!isOpen()) {
+      open_.wait(isOpen, Clock::now() + kPoll);
+    }
+  }
+};
+
+} // namespace elf
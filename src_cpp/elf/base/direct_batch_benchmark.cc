@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Round trip of a request from a game thread to Context::wait() and back,
+// with a trivial "network" that replies at once, for each transfer type of
+// the SharedMem:
+//
+//   server: the collector thread copies the states to the batch.
+//   client: the collector thread has the game threads copy them.
+//   direct: the game threads claim a slot and copy their states, with no
+//           collector thread.
+//
+// Usage: bench_direct_batch [sends_per_game] [batchsize] [timeout_usec]
+//                           [num_smem]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "context.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Obs {
+  int64_t id = 0;
+};
+
+struct Reply {
+  int64_t a = -1;
+};
+
+void extractId(const Obs& s, int64_t* p) {
+  *p = s.id;
+}
+
+void replyA(Reply& r, const int64_t* p) {
+  r.a = *p;
+}
+
+struct Result {
+  double rate = 0;
+  double p50_us = 0;
+  double p99_us = 0;
+};
+
+Result run(
+    elf::SharedMemOptions::TransferType type,
+    int num_games,
+    int sends_per_game,
+    int batchsize,
+    int timeout_usec,
+    int num_smem) {
+  elf::Context ctx;
+  elf::Extractor& e = ctx.getExtractor();
+  e.addField<int64_t>({"id", "a"}).addExtent(batchsize);
+  e.addTypedClass<Obs>().addFunction<int64_t, extractId>("id");
+  e.addTypedClass<Reply>().addFunction<int64_t, replyA>("a");
+
+  elf::SharedMemOptions options =
+      ctx.createSharedMemOptions("actor", batchsize);
+  options.setTransferType(type);
+  options.setTimeout(timeout_usec);
+  std::vector<std::vector<int64_t>> id(num_smem);
+  std::vector<std::vector<int64_t>> a(num_smem);
+  for (int i = 0; i < num_smem; ++i) {
+    elf::SharedMem& smem = ctx.allocateSharedMem(options, {"id", "a"});
+    const int idx = smem.getSharedMemOptions().getIdx();
+    id[idx].resize(batchsize);
+    a[idx].resize(batchsize);
+    smem["id"]->setAddress(reinterpret_cast<uint64_t>(id[idx].data()), {8});
+    smem["a"]->setAddress(reinterpret_cast<uint64_t>(a[idx].data()), {8});
+  }
+
+  std::vector<std::vector<double>> latencies_us(num_games);
+  std::atomic<int> done(0);
+  ctx.setStartCallback(num_games, [&](int g, elf::GameClient* client) {
+    elf::StateBindingT<const Obs, Reply> binding(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    latencies_us[g].reserve(sends_per_game);
+    for (int i = 0; i < sends_per_game; ++i) {
+      obs.id = i;
+      const auto start = Clock::now();
+      binding.sendWait(&obs, &reply);
+      latencies_us[g].push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - start)
+              .count());
+    }
+    done++;
+    while (!client->DoStopGames()) {
+      binding.sendWait(&obs, &reply);
+    }
+  });
+
+  ctx.start();
+  const auto start = Clock::now();
+  while (done < num_games) {
+    const elf::SharedMem* smem = ctx.wait(100);
+    if (smem != nullptr) {
+      const int idx = smem->getSharedMemOptions().getIdx();
+      std::copy(
+          id[idx].begin(),
+          id[idx].begin() + smem->getEffectiveBatchSize(),
+          a[idx].begin());
+    }
+    ctx.step();
+  }
+  const double sec =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  ctx.stop();
+
+  std::vector<double> all;
+  for (const auto& l : latencies_us) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  Result result;
+  result.rate = all.size() / sec;
+  result.p50_us = all[all.size() / 2];
+  result.p99_us = all[all.size() * 99 / 100];
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const int sends_per_game = argc > 1 ? std::atoi(argv[1]) : 2000;
+  const int batchsize = argc > 2 ? std::atoi(argv[2]) : 32;
+  const int timeout_usec = argc > 3 ? std::atoi(argv[3]) : 100;
+  const int num_smem = argc > 4 ? std::atoi(argv[4]) : 2;
+
+  std::cout << sends_per_game << " sends per game, batchsize " << batchsize
+            << ", timeout_usec " << timeout_usec << ", " << num_smem
+            << " SharedMem" << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "transfer  games   Kreq/s  p50_us  p99_us" << std::endl;
+
+  const std::vector<std::pair<std::string, elf::SharedMemOptions::TransferType>>
+      types = {{"server", elf::SharedMemOptions::SERVER},
+               {"client", elf::SharedMemOptions::CLIENT},
+               {"direct", elf::SharedMemOptions::DIRECT}};
+  for (int num_games : {1, 8, 32, 128}) {
+    for (const auto& type : types) {
+      const Result r = run(
+          type.second,
+          num_games,
+          sends_per_game,
+          batchsize,
+          timeout_usec,
+          num_smem);
+      std::cout << std::setw(8) << type.first << std::setw(7) << num_games
+                << std::setw(9) << r.rate / 1e3 << std::setw(8) << r.p50_us
+                << std::setw(8) << r.p99_us << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,297 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "context.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+struct Obs {
+  int64_t id = 0;
+};
+
+struct Reply {
+  int64_t a = -1;
+  int64_t b = -1;
+};
+
+void extractId(const Obs& s, int64_t* p) {
+  *p = s.id;
+}
+
+void replyA(Reply& r, const int64_t* p) {
+  r.a = *p;
+}
+
+void replyB(Reply& r, const int64_t* p) {
+  r.b = *p;
+}
+
+const int kBatchSize = 4;
+
+using Binding = elf::StateBindingT<const Obs, Reply>;
+
+class DirectBatchTest : public ::testing::Test {
+ protected:
+  elf::Context ctx_;
+  // Per SharedMem.
+  std::vector<std::vector<int64_t>> id_;
+  std::vector<std::vector<int64_t>> out_;
+  std::vector<std::string> labels_;
+  elf::BatchStats stats_;
+
+  void SetUp() override {
+    elf::Extractor& e = ctx_.getExtractor();
+    e.addField<int64_t>({"id", "a", "id2", "b"}).addExtent(kBatchSize);
+    e.addTypedClass<Obs>()
+        .addFunction<int64_t, extractId>("id")
+        .addFunction<int64_t, extractId>("id2");
+    e.addTypedClass<Reply>()
+        .addFunction<int64_t, replyA>("a")
+        .addFunction<int64_t, replyB>("b");
+  }
+
+  // Replies out = 2 * id to the requests of label.
+  void allocate(
+      const std::string& label,
+      elf::SharedMemOptions::TransferType type,
+      int timeout_usec,
+      int num_smem = 1) {
+    elf::SharedMemOptions options =
+        ctx_.createSharedMemOptions(label, kBatchSize);
+    options.setTransferType(type);
+    options.setTimeout(timeout_usec);
+    const bool first = label == "actor";
+    labels_.push_back(label);
+    for (int i = 0; i < num_smem; ++i) {
+      elf::SharedMem& smem = ctx_.allocateSharedMem(
+          options, first ? std::vector<std::string>{"id", "a"}
+                         : std::vector<std::string>{"id2", "b"});
+      const int idx = smem.getSharedMemOptions().getIdx();
+      id_.resize(idx + 1, std::vector<int64_t>(kBatchSize));
+      out_.resize(idx + 1, std::vector<int64_t>(kBatchSize));
+      smem[first ? "id" : "id2"]->setAddress(
+          reinterpret_cast<uint64_t>(id_[idx].data()), {8});
+      smem[first ? "a" : "b"]->setAddress(
+          reinterpret_cast<uint64_t>(out_[idx].data()), {8});
+    }
+  }
+
+  // Runs game on num_games game threads, and answers their requests until
+  // they all return. stats_ are those of "actor" at that time.
+  void run(int num_games, std::function<void(int, elf::GameClient*)> game) {
+    std::atomic<int> done(0);
+    ctx_.setStartCallback(num_games, [&](int i, elf::GameClient* client) {
+      game(i, client);
+      done++;
+      // Context::stop() expects the games to send until they are stopped,
+      // and the collectors to get requests.
+      Binding binding(client, labels_);
+      Obs obs;
+      Reply reply;
+      while (!client->DoStopGames()) {
+        binding.sendWait(&obs, &reply);
+      }
+    });
+    ctx_.start();
+    while (done < num_games) {
+      const elf::SharedMem* smem = ctx_.wait(100);
+      if (smem != nullptr) {
+        const int idx = smem->getSharedMemOptions().getIdx();
+        for (size_t i = 0; i < smem->getEffectiveBatchSize(); ++i) {
+          out_[idx][i] = 2 * id_[idx][i];
+        }
+      }
+      ctx_.step();
+    }
+    stats_ = ctx_.getBatchStats("actor");
+    ctx_.stop();
+  }
+};
+
+} // namespace
+
+TEST_F(DirectBatchTest, manyGames) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 1000, 2);
+  const int kGames = 8;
+  const int kSends = 200;
+  std::vector<int> errors(kGames);
+
+  run(kGames, [&](int g, elf::GameClient* client) {
+    Binding binding(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < kSends; ++i) {
+      obs.id = g * kSends + i;
+      EXPECT_NE(binding.sendWait(&obs, &reply), comm::FAILED);
+      errors[g] += reply.a != 2 * obs.id;
+    }
+  });
+
+  for (int g = 0; g < kGames; ++g) {
+    EXPECT_EQ(errors[g], 0) << "game " << g;
+  }
+  // And the ones sent once done.
+  EXPECT_GE(stats_.num_requests, kGames * kSends);
+}
+
+TEST_F(DirectBatchTest, lastWriterPublishes) {
+  // No deadline: only full batches.
+  allocate("actor", elf::SharedMemOptions::DIRECT, 0);
+  run(kBatchSize, [&](int g, elf::GameClient* client) {
+    Binding binding(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < 50; ++i) {
+      obs.id = g + i;
+      binding.sendWait(&obs, &reply);
+      EXPECT_EQ(reply.a, 2 * obs.id);
+    }
+  });
+
+  EXPECT_GE(stats_.num_batches, 50);
+  EXPECT_EQ(stats_.batch_sizes[kBatchSize], stats_.num_batches);
+}
+
+TEST_F(DirectBatchTest, deadline) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 5000);
+  std::vector<std::chrono::steady_clock::duration> latencies;
+  run(1, [&](int, elf::GameClient* client) {
+    Binding binding(client, {"actor"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < 5; ++i) {
+      obs.id = i;
+      const auto start = std::chrono::steady_clock::now();
+      binding.sendWait(&obs, &reply);
+      latencies.push_back(std::chrono::steady_clock::now() - start);
+      EXPECT_EQ(reply.a, 2 * i);
+    }
+  });
+
+  // A lone game fills one slot, the batch goes at the deadline.
+  for (const auto& latency : latencies) {
+    EXPECT_GE(latency, std::chrono::milliseconds(5));
+    EXPECT_LT(latency, std::chrono::milliseconds(100));
+  }
+  EXPECT_GE(stats_.batch_sizes[1], 5);
+}
+
+TEST_F(DirectBatchTest, batchLargerThanSharedMem) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 1000);
+  run(1, [&](int, elf::GameClient* client) {
+    elf::BatchStateBindingT<const Obs, Reply> binding(client, {"actor"});
+    std::vector<Obs> obs(kBatchSize + 2);
+    std::vector<Reply> reply(obs.size());
+    std::vector<const Obs*> batch_s;
+    std::vector<Reply*> batch_a;
+    for (size_t i = 0; i < obs.size(); ++i) {
+      obs[i].id = i;
+      batch_s.push_back(&obs[i]);
+      batch_a.push_back(&reply[i]);
+    }
+    EXPECT_NE(binding.sendBatchWait(batch_s, batch_a), comm::FAILED);
+    for (size_t i = 0; i < obs.size(); ++i) {
+      EXPECT_EQ(reply[i].a, 2 * obs[i].id);
+    }
+  });
+
+  EXPECT_EQ(stats_.batch_sizes[kBatchSize], 1);
+  EXPECT_EQ(stats_.batch_sizes[2], 1);
+}
+
+TEST_F(DirectBatchTest, withOtherTransfer) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 1000);
+  allocate("value", elf::SharedMemOptions::CLIENT, 1000);
+  run(2, [&](int g, elf::GameClient* client) {
+    Binding binding(client, {"actor", "value"});
+    Obs obs;
+    Reply reply;
+    for (int i = 0; i < 20; ++i) {
+      obs.id = 100 * g + i;
+      binding.sendWait(&obs, &reply);
+      EXPECT_EQ(reply.a, 2 * obs.id);
+      EXPECT_EQ(reply.b, 2 * obs.id);
+    }
+  });
+}
+
+// More requests than the batches of a target take at once, so that its
+// sender has to read its first replies before it can claim more slots.
+TEST_F(DirectBatchTest, mixedTargetsLargerThanBatches) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 1000, 2);
+  allocate("value", elf::SharedMemOptions::DIRECT, 1000);
+  const int n = 2 * kBatchSize + 3;
+  run(1, [&](int, elf::GameClient* client) {
+    elf::BatchStateBindingT<const Obs, Reply> binding(
+        client, {"actor", "value"});
+    std::vector<Obs> obs(n);
+    std::vector<Reply> reply(n);
+    std::vector<const Obs*> batch_s;
+    std::vector<Reply*> batch_a;
+    for (int i = 0; i < n; ++i) {
+      obs[i].id = i;
+      batch_s.push_back(&obs[i]);
+      batch_a.push_back(&reply[i]);
+    }
+    EXPECT_NE(binding.sendBatchWait(batch_s, batch_a), comm::FAILED);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(reply[i].a, 2 * i);
+      EXPECT_EQ(reply[i].b, 2 * i);
+    }
+  });
+}
+
+// Async sends in flight together hold more slots than there are, and are
+// only waited on at the end.
+TEST_F(DirectBatchTest, asyncSends) {
+  allocate("actor", elf::SharedMemOptions::DIRECT, 1000, 2);
+  const int kSends = 3;
+  const int n = kBatchSize + 2;
+  run(1, [&](int, elf::GameClient* client) {
+    std::vector<std::unique_ptr<elf::BatchStateBindingT<const Obs, Reply>>>
+        bindings;
+    std::vector<Obs> obs(kSends * n);
+    std::vector<Reply> reply(obs.size());
+    std::vector<std::future<comm::ReplyStatus>> sent;
+    for (int k = 0; k < kSends; ++k) {
+      std::vector<const Obs*> batch_s;
+      std::vector<Reply*> batch_a;
+      for (int i = k * n; i < (k + 1) * n; ++i) {
+        obs[i].id = i;
+        batch_s.push_back(&obs[i]);
+        batch_a.push_back(&reply[i]);
+      }
+      bindings.emplace_back(
+          new elf::BatchStateBindingT<const Obs, Reply>(client, {"actor"}));
+      sent.push_back(bindings.back()->sendBatchAsync(batch_s, batch_a));
+    }
+    for (auto& f : sent) {
+      EXPECT_NE(f.get(), comm::FAILED);
+    }
+    for (size_t i = 0; i < obs.size(); ++i) {
+      EXPECT_EQ(reply[i].a, 2 * obs[i].id);
+    }
+  });
+
+  EXPECT_GE(stats_.num_requests, kSends * n);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <set>
@@ -15,6 +16,8 @@
 #include <type_traits>
 #include <typeinfo>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "common.h"
 
@@ -332,6 +335,13 @@ class AnyP {
     return reinterpret_cast<const T*>(p_ + LinearIdx({l}));
   }
 
+  // Address of the batch_idx-th slot, without checks. Used by the typed
+  // fields, whose type is checked when they are registered.
+  unsigned char* getSlotAddress(int batch_idx) const {
+    assert(p_ != nullptr);
+    return p_ + batch_idx * stride_[0];
+  }
+
   std::string info() const {
     std::stringstream ss;
     ss << std::hex << (void*)p_ << std::dec << ", Field: " << f_.info();
@@ -360,12 +370,78 @@ class AnyP {
   }
 };
 
+// Typed fields: a class of states registers the functions of its fields as
+// template arguments (see TypedClassT). A SharedMem resolves them once to
+// the AnyP of each field, so that the transfer of a datum is one direct call
+// per field into its batch slot, without the string lookups, std::function
+// and dynamic_cast of the FuncMapT path.
+using TypedStateToMemFunc = void (*)(const void* s, unsigned char* p);
+using TypedMemToStateFunc = void (*)(void* s, const unsigned char* p);
+
+inline int nextTypedClassId() {
+  static std::atomic<int> next_id(0);
+  return next_id++;
+}
+
+// Dense id of the class S, to index the typed fields of a SharedMem.
+template <typename S>
+int getTypedClassId() {
+  static const int id = nextTypedClassId();
+  return id;
+}
+
+class TypedClassBase {
+ public:
+  template <typename Func>
+  struct Field {
+    std::string key;
+    Func func;
+  };
+
+  virtual ~TypedClassBase() = default;
+
+  const std::vector<Field<TypedStateToMemFunc>>& getStateToMemFields() const {
+    return state_to_mem_;
+  }
+
+  const std::vector<Field<TypedMemToStateFunc>>& getMemToStateFields() const {
+    return mem_to_state_;
+  }
+
+  bool hasStateToMem(const std::string& key) const {
+    return find(state_to_mem_, key);
+  }
+
+  bool hasMemToState(const std::string& key) const {
+    return find(mem_to_state_, key);
+  }
+
+ protected:
+  std::vector<Field<TypedStateToMemFunc>> state_to_mem_;
+  std::vector<Field<TypedMemToStateFunc>> mem_to_state_;
+
+ private:
+  template <typename Func>
+  static bool find(
+      const std::vector<Field<Func>>& fields,
+      const std::string& key) {
+    for (const auto& f : fields) {
+      if (f.key == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
 class SharedMem;
 
 template <bool use_const>
 class FuncsWithStateT {
  public:
   using FuncsWithState = FuncsWithStateT<use_const>;
+  using TypedState =
+      typename std::conditional<use_const, const void*, void*>::type;
 
   template <typename T>
   using PointerFunc = std::function<void(
@@ -386,6 +462,11 @@ class FuncsWithStateT {
     return false;
   }
 
+  // Transfer the typed fields of class_id of s as well.
+  void addTypedState(int class_id, TypedState s) {
+    typed_.emplace_back(class_id, s);
+  }
+
 #if 0
     template <typename T>
     bool add(const std::string &key, PointerFunc<T> func) {
@@ -432,10 +513,12 @@ class FuncsWithStateT {
     for (const auto& p : funcs.funcs_) {
       funcs_.insert(p);
     }
+    typed_.insert(typed_.end(), funcs.typed_.begin(), funcs.typed_.end());
   }
 
  private:
   std::unordered_map<std::string, Func> funcs_;
+  std::vector<std::pair<int, TypedState>> typed_;
 };
 
 using FuncStateToMemWithState = FuncsWithStateT<true>;
@@ -468,6 +551,9 @@ struct FuncsWithState {
 template <typename S>
 class ClassFieldT;
 
+template <typename S>
+class TypedClassT;
+
 //
 class Extractor {
  public:
@@ -505,6 +591,30 @@ class Extractor {
     return ClassFieldT<S>(this);
   }
 
+  // Fields of S with compile-time functions. They take over from the
+  // functions of S registered with addClass() for the same keys.
+  template <typename S>
+  TypedClassT<S>& addTypedClass() {
+    auto& c = typed_classes_[getTypedClassId<S>()];
+    if (c == nullptr) {
+      c.reset(new TypedClassT<S>(this));
+    }
+    return static_cast<TypedClassT<S>&>(*c);
+  }
+
+  template <typename S>
+  const TypedClassBase* getTypedClass() const {
+    auto it = typed_classes_.find(getTypedClassId<S>());
+    return it == typed_classes_.end() ? nullptr : it->second.get();
+  }
+
+  void applyTyped(
+      std::function<void(int class_id, const TypedClassBase&)> func) const {
+    for (const auto& c : typed_classes_) {
+      func(c.first, *c.second);
+    }
+  }
+
   const FuncMapBase* getFunctions(const std::string& key) const {
     auto it = fields_.find(key);
 
@@ -570,6 +680,7 @@ class Extractor {
  private:
   // A bunch of pointer to Field.
   std::unordered_map<std::string, std::unique_ptr<FuncMapBase>> fields_;
+  std::unordered_map<int, std::unique_ptr<TypedClassBase>> typed_classes_;
   std::shared_ptr<spdlog::logger> logger_;
 };
 
@@ -638,4 +749,51 @@ class ClassFieldT {
   }
 };
 
+// e.g. e.addTypedClass<Reply>().addFunction<float, ReplyValue>("V"), where
+// ReplyValue is void(Reply&, const float*) (memory to state) or
+// void(const Reply&, float*) (state to memory).
+template <typename S>
+class TypedClassT : public TypedClassBase {
+ public:
+  using TypedClass = TypedClassT<S>;
+
+  TypedClassT(Extractor* ext)
+      : ext_(ext),
+        logger_(elf::logging::getIndexedLogger("elf::base::TypedClassT-", "")) {
+  }
+
+  template <typename T, void (*F)(const S&, T*)>
+  TypedClass& addFunction(const std::string& key) {
+    check<T>(key);
+    state_to_mem_.push_back({key, [](const void* s, unsigned char* p) {
+                               F(*static_cast<const S*>(s),
+                                 reinterpret_cast<T*>(p));
+                             }});
+    return *this;
+  }
+
+  template <typename T, void (*F)(S&, const T*)>
+  TypedClass& addFunction(const std::string& key) {
+    check<T>(key);
+    mem_to_state_.push_back({key, [](void* s, const unsigned char* p) {
+                               F(*static_cast<S*>(s),
+                                 reinterpret_cast<const T*>(p));
+                             }});
+    return *this;
+  }
+
+ private:
+  Extractor* ext_;
+  std::shared_ptr<spdlog::logger> logger_;
+
+  template <typename T>
+  void check(const std::string& key) {
+    if (ext_->getFunctions<T>(key) == nullptr) {
+      logger_->error(
+          "TypedClassT: cannot find {} of type {}", key, TypeNameT<T>::name());
+      assert(false);
+    }
+  }
+};
+
 } // namespace elf
@@ -8,23 +8,30 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "elf/comm/comm.h"
 #include "elf/concurrency/ConcurrentQueue.h"
 #include "elf/logging/IndexedLoggerFactory.h"
 
+#include "batch_policy.h"
 #include "extractor.h"
 
 namespace elf {
 
+// The collectors of a label share their queue: a game waits for the first
+// collector that is free.
 using Comm = typename comm::CommT<
     FuncsWithState*,
     true,
     concurrency::ConcurrentQueue,
-    concurrency::ConcurrentQueue>;
+    concurrency::ConcurrentQueueMPMC>;
 // Message sent from client to server
 using Message = typename Comm::Message;
 using Server = typename Comm::Server;
@@ -32,7 +39,11 @@ using Client = typename Comm::Client;
 
 class SharedMemOptions {
  public:
-  enum TransferType { SERVER = 0, CLIENT };
+  // Who copies the states to the memory, and the replies back: the collector
+  // thread (SERVER), or the game threads when the collector asks for it
+  // (CLIENT). With DIRECT, the game threads fill the batch themselves, with
+  // no collector thread (see DirectBatcher).
+  enum TransferType { SERVER = 0, CLIENT, DIRECT };
 
   SharedMemOptions(const std::string& label, int batchsize)
       : options_(label, batchsize, 0, 1) {}
@@ -49,6 +60,17 @@ class SharedMemOptions {
     options_.wait_opt.min_batchsize = minbatchsize;
   }
 
+  // The deadline follows the arrival rate, within [min_timeout_usec,
+  // max_timeout_usec], instead of the one of setTimeout().
+  void setAdaptiveTimeout(
+      float target_fill,
+      int min_timeout_usec,
+      int max_timeout_usec) {
+    adaptive_.target_fill = target_fill;
+    adaptive_.min_timeout_usec = min_timeout_usec;
+    adaptive_.max_timeout_usec = max_timeout_usec;
+  }
+
   void setTransferType(TransferType type) {
     type_ = type;
   }
@@ -77,6 +99,10 @@ class SharedMemOptions {
     return options_.wait_opt.min_batchsize;
   }
 
+  const AdaptiveTimeoutOptions& getAdaptiveTimeout() const {
+    return adaptive_;
+  }
+
   TransferType getTransferType() const {
     return type_;
   }
@@ -86,7 +112,15 @@ class SharedMemOptions {
     ss << "SMem[" << options_.label << "], idx: " << idx_
        << ", batchsize: " << options_.wait_opt.batchsize;
 
-    if (options_.wait_opt.timeout_usec > 0) {
+    if (options_.wait_opt.min_batchsize > 1) {
+      ss << ", min_batchsize: " << options_.wait_opt.min_batchsize;
+    }
+
+    if (adaptive_.enabled()) {
+      ss << ", adaptive timeout_usec: [" << adaptive_.min_timeout_usec << ", "
+         << adaptive_.max_timeout_usec
+         << "], target_fill: " << adaptive_.target_fill;
+    } else if (options_.wait_opt.timeout_usec > 0) {
       ss << ", timeout_usec: " << options_.wait_opt.timeout_usec;
     }
 
@@ -100,6 +134,7 @@ class SharedMemOptions {
  private:
   int idx_ = -1;
   comm::RecvOptions options_;
+  AdaptiveTimeoutOptions adaptive_;
   TransferType type_ = CLIENT;
 };
 
@@ -127,22 +162,58 @@ inline void mem2state(const SharedMem& mem, Message& msg) {
 
 class SharedMem {
  public:
+  // The typed fields of extractor, if any, are transferred without a
+  // lookup per field.
   SharedMem(
       int idx,
       const SharedMemOptions& smem_opts,
-      const std::unordered_map<std::string, AnyP>& mem)
+      const std::unordered_map<std::string, AnyP>& mem,
+      const Extractor* extractor = nullptr)
       : opts_(smem_opts),
         mem_(mem),
+        adaptive_(smem_opts.getAdaptiveTimeout(), smem_opts.getBatchSize()),
+        stats_(smem_opts.getBatchSize()),
         logger_(elf::logging::getIndexedLogger("elf::base::SharedMem-", "")) {
     opts_.setIdx(idx);
+    if (extractor != nullptr) {
+      extractor->applyTyped([this](int class_id, const TypedClassBase& c) {
+        this->addTypedClass(class_id, c);
+      });
+    }
+  }
+
+  // The typed fields point into mem_.
+  SharedMem(const SharedMem&) = delete;
+  SharedMem& operator=(const SharedMem&) = delete;
+
+  void transferTyped(int class_id, const void* s, int batch_idx) {
+    if (class_id >= (int)typed_.size()) {
+      return;
+    }
+    for (const auto& f : typed_[class_id].state_to_mem) {
+      f.func(s, f.anyp->getSlotAddress(batch_idx));
+    }
+  }
+
+  void transferTyped(int class_id, void* s, int batch_idx) const {
+    if (class_id >= (int)typed_.size()) {
+      return;
+    }
+    for (const auto& f : typed_[class_id].mem_to_state) {
+      f.func(s, f.anyp->getSlotAddress(batch_idx));
+    }
   }
 
   void waitBatchFillMem(Server* server) {
+    if (adaptive_.enabled()) {
+      opts_.setTimeout(adaptive_.timeoutUsec());
+    }
     server->waitBatch(opts_.getRecvOptions(), &msgs_from_client_);
     active_batch_size_ = 0;
     for (const Message& m : msgs_from_client_) {
       active_batch_size_ += m.data.size();
     }
+    recordBatch();
 
     if ((int)active_batch_size_ > opts_.getBatchSize() ||
         (int)active_batch_size_ < opts_.getMinBatchSize()) {
@@ -166,6 +237,25 @@ class SharedMem {
     }
   }
 
+  // DIRECT transfer: the game threads wrote the first n slots themselves,
+  // and the one of slot i arrived at arrivals[i].
+  void fillDirect(
+      size_t n,
+      const std::chrono::steady_clock::time_point* arrivals) {
+    active_batch_size_ = n;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.addBatch(n);
+    for (size_t i = 0; i < n; ++i) {
+      stats_.addQueueDelay(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              now - arrivals[i])
+              .count(),
+          1);
+    }
+    stats_.timeout_usec = opts_.getRecvOptions().wait_opt.timeout_usec;
+  }
+
   void waitReplyReleaseBatch(Server* server, comm::ReplyStatus batch_status) {
     if (opts_.getTransferType() == SharedMemOptions::SERVER) {
       local_mem2state();
@@ -187,7 +277,9 @@ class SharedMem {
     return active_batch_size_;
   }
 
+  // Also turns off the adaptive timeout.
   void setTimeout(int timeout_usec) {
+    adaptive_.disable();
     opts_.setTimeout(timeout_usec);
   }
 
@@ -195,6 +287,12 @@ class SharedMem {
     opts_.setMinBatchSize(minbatchsize);
   }
 
+  // Thread-safe.
+  BatchStats getBatchStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return stats_;
+  }
+
   std::string info() const {
     std::stringstream ss;
     ss << opts_.info() << std::endl;
@@ -229,8 +327,22 @@ class SharedMem {
   }
 
  private:
+  template <typename Func>
+  struct TypedField {
+    const AnyP* anyp;
+    Func func;
+  };
+
+  // The typed fields of a class that are in this SharedMem.
+  struct TypedFields {
+    std::vector<TypedField<TypedStateToMemFunc>> state_to_mem;
+    std::vector<TypedField<TypedMemToStateFunc>> mem_to_state;
+  };
+
   SharedMemOptions opts_;
   std::unordered_map<std::string, AnyP> mem_;
+  // Indexed by class id.
+  std::vector<TypedFields> typed_;
 
   // We get a batch of messages from client
   // Note that msgs_from_client_.size() is no longer the batchsize, since one
@@ -238,8 +350,61 @@ class SharedMem {
   std::vector<Message> msgs_from_client_;
   size_t active_batch_size_ = 0;
 
+  AdaptiveTimeout adaptive_;
+  mutable std::mutex statsMutex_;
+  BatchStats stats_;
+
   std::shared_ptr<spdlog::logger> logger_;
 
+  void recordBatch() {
+    if (msgs_from_client_.empty()) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    auto first = msgs_from_client_[0].sent;
+    auto last = first;
+    for (const Message& m : msgs_from_client_) {
+      first = std::min(first, m.sent);
+      last = std::max(last, m.sent);
+    }
+    // A full batch tells nothing about the requests after the last one.
+    const bool full = (int)active_batch_size_ == opts_.getBatchSize();
+    adaptive_.update(
+        active_batch_size_,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            (full ? last : now) - first)
+            .count());
+
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.addBatch(active_batch_size_);
+    for (const Message& m : msgs_from_client_) {
+      stats_.addQueueDelay(
+          std::chrono::duration_cast<std::chrono::microseconds>(now - m.sent)
+              .count(),
+          m.data.size());
+    }
+    stats_.timeout_usec = opts_.getRecvOptions().wait_opt.timeout_usec;
+  }
+
+  void addTypedClass(int class_id, const TypedClassBase& c) {
+    if (class_id >= (int)typed_.size()) {
+      typed_.resize(class_id + 1);
+    }
+    TypedFields& fields = typed_[class_id];
+    for (const auto& f : c.getStateToMemFields()) {
+      const AnyP* anyp = (*this)[f.key];
+      if (anyp != nullptr) {
+        fields.state_to_mem.push_back({anyp, f.func});
+      }
+    }
+    for (const auto& f : c.getMemToStateFields()) {
+      const AnyP* anyp = (*this)[f.key];
+      if (anyp != nullptr) {
+        fields.mem_to_state.push_back({anyp, f.func});
+      }
+    }
+  }
+
   void local_state2mem() {
     // Send the state to shared memory.
     for (const Message& m : msgs_from_client_) {
@@ -288,6 +453,10 @@ class SharedMem {
 
 template <bool use_const>
 void FuncsWithStateT<use_const>::transfer(int msg_idx, SharedMem_t smem) const {
+  for (const auto& p : typed_) {
+    smem.transferTyped(p.first, p.second, msg_idx);
+  }
+  // String-keyed fallback, e.g. for classes registered with addClass().
   for (const auto& p : funcs_) {
     auto* anyp = smem[p.first];
     assert(anyp != nullptr);
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "context.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+struct Obs {
+  float x[3];
+  int64_t id;
+  float y;
+};
+
+struct Reply {
+  int64_t a = -1;
+  float y = 0;
+};
+
+void extractX(const Obs& s, float* p) {
+  std::copy(s.x, s.x + 3, p);
+}
+
+void extractId(const Obs& s, int64_t* p) {
+  *p = s.id;
+}
+
+void extractY(const Obs& s, float* p) {
+  *p = s.y;
+}
+
+void clearX(const Obs&, float* p) {
+  std::fill(p, p + 3, 0.0f);
+}
+
+void replyA(Reply& r, const int64_t* p) {
+  r.a = *p;
+}
+
+void replyY(Reply& r, const float* p) {
+  r.y = *p;
+}
+
+const int kBatchSize = 4;
+// Slots of x are padded to 4 floats.
+const int kXStride = 4;
+
+class SharedMemTest : public ::testing::Test {
+ protected:
+  elf::Context ctx_;
+  elf::SharedMem* smem_ = nullptr;
+  std::vector<float> x_ = std::vector<float>(kBatchSize * kXStride, -1);
+  std::vector<int64_t> id_ = std::vector<int64_t>(kBatchSize, -1);
+  std::vector<float> y_ = std::vector<float>(kBatchSize, -1);
+  std::vector<int64_t> a_ = std::vector<int64_t>(kBatchSize, -1);
+
+  void SetUp() override {
+    elf::Extractor& e = ctx_.getExtractor();
+    e.addField<float>("x").addExtents(kBatchSize, {kBatchSize, 3});
+    e.addField<int64_t>({"id", "a"}).addExtent(kBatchSize);
+    e.addField<float>("y").addExtent(kBatchSize);
+
+    // Typed fields take over from the string-keyed ones of the same class.
+    e.addClass<Obs>().addFunction<float>("x", clearX);
+    e.addTypedClass<Obs>()
+        .addFunction<float, extractX>("x")
+        .addFunction<int64_t, extractId>("id");
+    // Not typed.
+    e.addClass<Obs>().addFunction<float>("y", extractY);
+    e.addTypedClass<Reply>()
+        .addFunction<int64_t, replyA>("a")
+        .addFunction<float, replyY>("y");
+
+    smem_ = &ctx_.allocateSharedMem(
+        ctx_.createSharedMemOptions("actor", kBatchSize),
+        {"x", "id", "y", "a"});
+    setAddress("x", x_.data(), {kXStride * 4, 4});
+    setAddress("id", id_.data(), {8});
+    setAddress("y", y_.data(), {4});
+    setAddress("a", a_.data(), {8});
+  }
+
+  void setAddress(const std::string& key, void* p, std::vector<int> stride) {
+    (*smem_)[key]->setAddress(reinterpret_cast<uint64_t>(p), stride);
+  }
+};
+
+} // namespace
+
+TEST_F(SharedMemTest, typedStateToMem) {
+  const Obs obs{{1, 2, 3}, 42, 0.5};
+  elf::FuncsWithState funcs =
+      ctx_.getClient()->BindStateToFunctions({"actor"}, &obs);
+  funcs.state_to_mem_funcs.transfer(2, *smem_);
+
+  EXPECT_EQ(x_[2 * kXStride], 1);
+  EXPECT_EQ(x_[2 * kXStride + 1], 2);
+  EXPECT_EQ(x_[2 * kXStride + 2], 3);
+  EXPECT_EQ(x_[2 * kXStride + 3], -1);
+  EXPECT_EQ(x_[1 * kXStride + 2], -1);
+  EXPECT_EQ(id_[2], 42);
+  // Through the string-keyed fallback.
+  EXPECT_EQ(y_[2], 0.5);
+  EXPECT_EQ(y_[1], -1);
+}
+
+TEST_F(SharedMemTest, typedBatchAndMemToState) {
+  std::vector<Obs> obs = {{{1, 1, 1}, 10, 1}, {{2, 2, 2}, 20, 2}};
+  std::vector<Reply> replies(2);
+  std::vector<const Obs*> batch_s = {&obs[0], &obs[1]};
+  std::vector<Reply*> batch_a = {&replies[0], &replies[1]};
+
+  auto funcs_s = ctx_.getClient()->BindStateToFunctions({"actor"}, batch_s);
+  auto funcs_a = ctx_.getClient()->BindStateToFunctions({"actor"}, batch_a);
+  for (size_t i = 0; i < funcs_s.size(); ++i) {
+    funcs_s[i].add(funcs_a[i]);
+    funcs_s[i].state_to_mem_funcs.transfer(i, *smem_);
+  }
+  EXPECT_EQ(id_[0], 10);
+  EXPECT_EQ(id_[1], 20);
+  EXPECT_EQ(x_[kXStride], 2);
+
+  // The "network" replies in place.
+  a_[0] = 7;
+  a_[1] = 8;
+  y_[1] = 0.25;
+  for (size_t i = 0; i < funcs_s.size(); ++i) {
+    funcs_s[i].mem_to_state_funcs.transfer(i, *smem_);
+  }
+  EXPECT_EQ(replies[0].a, 7);
+  EXPECT_EQ(replies[1].a, 8);
+  EXPECT_EQ(replies[0].y, 1);
+  EXPECT_EQ(replies[1].y, 0.25);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,8 +8,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -24,6 +28,44 @@ template <
     template <typename> class ServerQueue>
 class NodeT;
 
+// The data of a message, owned by the sender. A sender blocks until the
+// session ends, so the data outlives the message.
+template <typename Data>
+class DataView {
+ public:
+  DataView() {}
+  DataView(const Data* data, size_t size) : data_(data), size_(size) {}
+
+  const Data* begin() const {
+    return data_;
+  }
+
+  const Data* end() const {
+    return data_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const Data& operator[](size_t i) const {
+    return data_[i];
+  }
+
+  void clear() {
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+ private:
+  const Data* data_ = nullptr;
+  size_t size_ = 0;
+};
+
 template <
     typename Data,
     typename Reply,
@@ -35,26 +77,32 @@ struct MsgT {
 
   ClientToServer* from = nullptr;
   ServerToClient* to = nullptr;
-  std::vector<Data> data;
+  DataView<Data> data;
   size_t base_idx = 0;
+  // When the message was queued.
+  std::chrono::steady_clock::time_point sent;
 
-  MsgT(ClientToServer* from, ServerToClient* to, const std::vector<Data>& in)
+  MsgT(ClientToServer* from, ServerToClient* to, const DataView<Data>& in)
       : from(from), to(to), data(in) {}
 
-  MsgT(ClientToServer* from, ServerToClient* to, Data in) : from(from), to(to) {
-    data.push_back(in);
-  }
+  MsgT(ClientToServer* from, ServerToClient* to, const Data* in, size_t n)
+      : from(from), to(to), data(in, n) {}
 
   MsgT() {}
 };
 
+// How a server forms a batch. It waits for at least min_batchsize requests
+// and takes at most batchsize of them. Once it has min_batchsize, it returns
+// when the batch is full or at the deadline, timeout_usec after the arrival
+// of the first request of the batch. Requests already queued at the deadline
+// are still taken, up to batchsize.
+//
+// timeout_usec = 0 waits for a full batch. With min_batchsize = 0, an empty
+// batch is returned if nothing arrives within timeout_usec.
 struct WaitOptions {
   int batchsize = 1;
-
-  // If timeout_usec > 0, an incomplete batch of
-  // size >= min_batchsize will be returned.
   int timeout_usec = 0;
-  bool min_batchsize = 0;
+  int min_batchsize = 0;
 
   WaitOptions(int batchsize, int timeout_usec = 0, int min_batchsize = 0)
       : batchsize(batchsize),
@@ -87,11 +135,12 @@ class NodeT {
       return false;
     }
 
+    // Set first: a passive node may see its session end before the loop
+    // below is done.
+    n_ = static_cast<int>(targets.size());
     for (const auto& pa : targets) {
       pa.to->EnqueueMessage(SendMsg(this, pa.to, pa.data));
     }
-
-    n_ = targets.size();
     return true;
   }
 
@@ -106,17 +155,21 @@ class NodeT {
       const WaitOptions& opt,
       std::vector<RecvMsg>* messages) {
     assert(opt.batchsize > 0);
+    assert(opt.min_batchsize <= opt.batchsize);
 
     messages->clear();
 
     size_t data_count = 0;
+    const auto timeout = std::chrono::microseconds(opt.timeout_usec);
+    // Until the first request arrives.
+    auto deadline = std::chrono::steady_clock::now() + timeout;
 
     while (true) {
       RecvMsg message;
 
       bool use_timeout =
           ((int)data_count >= opt.min_batchsize && opt.timeout_usec > 0);
-      if (!get_msg(opt, use_timeout, &message))
+      if (!get_msg(use_timeout, deadline, &message))
         break;
 
       if ((int)(message.data.size() + data_count) > opt.batchsize) {
@@ -127,6 +180,12 @@ class NodeT {
       // No empty package is allowed.
       assert(!message.data.empty());
 
+      if (messages->empty()) {
+        deadline = message.sent + timeout;
+      }
+
+      // It may have been sent to another node sharing the queue.
+      message.to = this;
       message.base_idx = data_count;
       messages->push_back(message);
       data_count += message.data.size();
@@ -141,19 +200,65 @@ class NodeT {
   }
 
   void notifySessionInvite() {
-    replyCount_.increment();
+    const int count = replyCount_.increment();
+    if (onSessionEnd_ != nullptr && count == n_) {
+      n_ = 0;
+      replyCount_.reset();
+      onSessionEnd_();
+    }
+  }
+
+  // A passive node has no thread of its own that waits on it. A message sent
+  // to it is handled at once by on_message, on the sender's thread, and the
+  // end of a session calls on_session_end, on the thread of the last
+  // notifySessionInvite(). Set before the first session.
+  void setPassive(
+      std::function<void(const RecvMsg&)> on_message,
+      std::function<void()> on_session_end) {
+    onMessage_ = std::move(on_message);
+    onSessionEnd_ = std::move(on_session_end);
+  }
+
+  // Use the queue of owner from now on: a message sent to either node goes to
+  // whichever asks first. Done before anyone sends to this node.
+  void shareQueue(const Node& owner) {
+    static_assert(
+        MyQueue<RecvMsg>::kMultiConsumer,
+        "The queue cannot have several consumers");
+    q_ = owner.q_;
   }
 
   void EnqueueMessage(RecvMsg&& msg) {
-    q_.push(msg);
+    if (onMessage_ != nullptr) {
+      onMessage_(msg);
+      return;
+    }
+    msg.sent = std::chrono::steady_clock::now();
+    q_->push(msg);
+  }
+
+  // Scratch space of the thread that owns the node, reused from one session
+  // to the next so that sessions do not allocate once it has grown.
+  std::vector<SendMsg>& sendBuffer() {
+    return sendBuffer_;
+  }
+
+  std::vector<RecvMsg>& recvBuffer() {
+    return recvBuffer_;
   }
 
  private:
-  int n_ = 0;
+  std::atomic<int> n_{0};
+
+  std::function<void(const RecvMsg&)> onMessage_;
+  std::function<void()> onSessionEnd_;
+
+  std::vector<SendMsg> sendBuffer_;
+  std::vector<RecvMsg> recvBuffer_;
 
   RecvMsg unprocessed_msg_;
-  // Concurrent Queue.
-  MyQueue<RecvMsg> q_;
+  // Concurrent Queue, maybe shared with other nodes.
+  std::shared_ptr<MyQueue<RecvMsg>> q_ = std::make_shared<MyQueue<RecvMsg>>();
 
   elf::concurrency::Counter<int> replyCount_;
 
@@ -162,25 +267,23 @@ class NodeT {
     unprocessed_msg_ = msg;
   }
 
-  bool get_msg(const WaitOptions& opt, bool use_timeout, RecvMsg* msg) {
+  bool get_msg(
+      bool use_timeout,
+      std::chrono::steady_clock::time_point deadline,
+      RecvMsg* msg) {
     if (!unprocessed_msg_.data.empty()) {
       *msg = unprocessed_msg_;
       unprocessed_msg_.data.clear();
       return true;
     }
     if (use_timeout) {
-      // use timeout.
-      // LOG(INFO) << "Timeout. " << hex << this
-      //           << dec
-      //           << ", opt.timeout_usec = "
-      //           << opt.timeout_usec
-      //           << ", messages->size() = "
-      //           << messages->size()
-      //           << std::endl;
-      return q_.pop(msg, std::chrono::microseconds(opt.timeout_usec));
+      // Past the deadline, only takes what is already there.
+      const auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+          deadline - std::chrono::steady_clock::now());
+      return q_->pop(msg, std::max(left, std::chrono::microseconds(0)));
     } else {
       // This will block.
-      q_.pop(msg);
+      q_->pop(msg);
       return true;
     }
   }
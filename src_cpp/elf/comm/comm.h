@@ -8,9 +8,13 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
 #include <thread>
@@ -116,22 +120,33 @@ class CommInternalT {
     // can be resent
     // (e.g., the action returned from the reply will be sent for training).
     ReplyStatus sendWait(Id id, const std::vector<Id>& server_ids, Data data) {
-      return sendBatchWait(id, server_ids, std::vector<Data>{data});
+      return sendBatchWait(id, server_ids, &data, 1);
     }
 
     ReplyStatus sendBatchWait(
         Id id,
         const std::vector<Id>& server_ids,
         const std::vector<Data>& data) {
-      assert(!data.empty());
+      return sendBatchWait(id, server_ids, data.data(), data.size());
+    }
+
+    // Servers read data in place, until they release the session. Once the
+    // buffers of the node have grown, nothing is allocated here.
+    ReplyStatus sendBatchWait(
+        Id id,
+        const std::vector<Id>& server_ids,
+        const Data* data,
+        size_t data_size) {
+      assert(data_size > 0);
       // Find server that could accept this task.
-      std::vector<ClientToServerMsg> messages;
       ClientNode* node = p_->client(id);
+      std::vector<ClientToServerMsg>& messages = node->sendBuffer();
+      messages.clear();
       for (Id server_id : server_ids) {
         ServerNode* server = p_->server(server_id);
         // LOG(INFO) <<  "Send to server " << hex
         //           << server << dec << std::endl;
-        messages.push_back(ClientToServerMsg(node, server, data));
+        messages.push_back(ClientToServerMsg(node, server, data, data_size));
       }
       node->startSession(messages);
 
@@ -144,7 +159,8 @@ class CommInternalT {
         final_status = SUCCESS;
 
         WaitOptions opt(1);
-        std::vector<ServerToClientMsg> server_to_client_msgs;
+        std::vector<ServerToClientMsg>& server_to_client_msgs =
+            node->recvBuffer();
 
         while (n > 0 && node->waitSessionInvite(opt, &server_to_client_msgs)) {
           assert(server_to_client_msgs.size() == 1);
@@ -170,6 +186,39 @@ class CommInternalT {
       return final_status;
     }
 
+    // Same as sendBatchWait, but return at once. The session runs on a
+    // passive node that no thread waits on: the servers run its reply
+    // closures themselves, and the last release fulfills the future. The
+    // nodes are recycled, so there are as many of them as the peak number of
+    // requests in flight, and no thread per request.
+    std::future<ReplyStatus> sendBatchAsync(
+        const std::vector<Id>& server_ids,
+        const Data* data,
+        size_t data_size) {
+      assert(data_size > 0);
+      AsyncSession* session = p_->acquireAsyncSession();
+      session->data.assign(data, data + data_size);
+      session->status = kExpectReply ? SUCCESS : UNKNOWN;
+      session->promise = std::promise<ReplyStatus>();
+      std::future<ReplyStatus> res = session->promise.get_future();
+
+      std::vector<ClientToServerMsg>& messages = session->node.sendBuffer();
+      messages.clear();
+      for (Id server_id : server_ids) {
+        messages.push_back(ClientToServerMsg(
+            &session->node,
+            p_->server(server_id),
+            session->data.data(),
+            session->data.size()));
+      }
+      if (messages.empty()) {
+        p_->finishAsyncSession(session);
+      } else {
+        session->node.startSession(messages);
+      }
+      return res;
+    }
+
    private:
     CommInternal* p_;
   };
@@ -189,6 +238,11 @@ class CommInternalT {
       return node->waitSessionInvite(opt, batch);
     }
 
+    // Server id takes its messages from the queue of owner.
+    void shareQueue(Id id, Id owner) {
+      p_->server(id)->shareQueue(*p_->server(owner));
+    }
+
    public:
     explicit Server(CommInternal* p) : p_(p) {}
 
@@ -202,10 +256,12 @@ class CommInternalT {
       ServerNode* node = messages[0].to;
       // assert(node != nullptr);
 
-      std::vector<ServerToClientMsg> server_to_client_msgs;
+      std::vector<ServerToClientMsg>& server_to_client_msgs =
+          node->sendBuffer();
+      server_to_client_msgs.clear();
       for (size_t i = 0; i < messages.size(); ++i) {
         server_to_client_msgs.push_back(
-            ServerToClientMsg(node, messages[i].from, functions[i]));
+            ServerToClientMsg(node, messages[i].from, &functions[i], 1));
       }
       node->startSession(server_to_client_msgs);
       node->waitSessionEnd();
@@ -253,11 +309,56 @@ class CommInternalT {
     return elem->second.get();
   }
 
+  // A request sent by sendBatchAsync().
+  struct AsyncSession {
+    ClientNode node;
+    std::vector<Data> data;
+    std::atomic<ReplyStatus> status{UNKNOWN};
+    std::promise<ReplyStatus> promise;
+  };
+
+  AsyncSession* acquireAsyncSession() {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    if (!freeAsyncSessions_.empty()) {
+      AsyncSession* session = freeAsyncSessions_.back();
+      freeAsyncSessions_.pop_back();
+      return session;
+    }
+    asyncSessions_.emplace_back(new AsyncSession());
+    AsyncSession* session = asyncSessions_.back().get();
+    session->node.setPassive(
+        [session](const ServerToClientMsg& msg) {
+          // Same as the loop of sendBatchWait, on the server's thread.
+          assert(msg.data.size() == 1);
+          const ReplyStatus res = msg.data[0]();
+          if (res == UNKNOWN || res == FAILED) {
+            session->status = res;
+          }
+          msg.from->notifySessionInvite();
+        },
+        [this, session]() { finishAsyncSession(session); });
+    return session;
+  }
+
+  void finishAsyncSession(AsyncSession* session) {
+    std::promise<ReplyStatus> promise = std::move(session->promise);
+    const ReplyStatus status = session->status;
+    {
+      std::lock_guard<std::mutex> lock(asyncMutex_);
+      freeAsyncSessions_.push_back(session);
+    }
+    promise.set_value(status);
+  }
+
   using ClientMap = tbb::concurrent_hash_map<Id, std::unique_ptr<ClientNode>>;
   using ServerMap = tbb::concurrent_hash_map<Id, std::unique_ptr<ServerNode>>;
 
   ClientMap clients_;
   ServerMap servers_;
+
+  std::mutex asyncMutex_;
+  std::vector<std::unique_ptr<AsyncSession>> asyncSessions_;
+  std::vector<AsyncSession*> freeAsyncSessions_;
 };
 
 struct SendOptions {
@@ -341,14 +442,27 @@ class CommT : public CommInternalT<
           std::this_thread::get_id(), label2server(labels), data);
     }
 
+    // Same as sendBatchWait, but return at once. The replies are run by the
+    // servers; what data points to must stay valid until the returned future
+    // is ready.
+    std::future<ReplyStatus> sendBatchAsync(
+        const std::vector<Data>& data,
+        const std::vector<std::string>& labels) {
+      return CommInternal::Client::sendBatchAsync(
+          label2server(labels), data.data(), data.size());
+    }
+
    private:
     Comm* pp_;
     std::mt19937 rng_;
     std::shared_ptr<spdlog::logger> logger_;
 
-    std::vector<Id> label2server(const std::vector<std::string>& labels) {
+    // The ids are reused by the next call from the same thread.
+    const std::vector<Id>& label2server(
+        const std::vector<std::string>& labels) {
       assert(!labels.empty());
-      std::vector<Id> server_ids;
+      static thread_local std::vector<Id> server_ids;
+      server_ids.clear();
 
       for (const auto& label : labels) {
         // [TODO] Will this one work in multithreading case?
@@ -375,6 +489,9 @@ class CommT : public CommInternalT<
     explicit Server(Comm* pp) : CommInternal::Server(pp), pp_(pp) {}
 
     // TODO: Put these logic to a separate place.
+    // If ServerQueue allows several consumers, the servers of a label share
+    // one queue: a message goes to the first server that is free, rather
+    // than to one picked at random.
     void RegServer(const std::string& label) {
       std::lock_guard<std::mutex> lock(pp_->register_mutex_);
       ServerLabelMap::accessor elem;
@@ -382,7 +499,13 @@ class CommT : public CommInternalT<
       if (uninitialized) {
         elem->second.reset(new std::vector<Id>());
       }
-      elem->second->push_back(std::this_thread::get_id());
+      const Id id = std::this_thread::get_id();
+      if constexpr (ServerQueue<Message>::kMultiConsumer) {
+        if (!elem->second->empty()) {
+          this->shareQueue(id, elem->second->front());
+        }
+      }
+      elem->second->push_back(id);
       counter_.increment();
     }
 
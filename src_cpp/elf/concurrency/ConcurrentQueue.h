@@ -20,6 +20,9 @@
  *   If the timeout duration is reached, then we return false and do not
  *   store anything in the given pointer.
  *
+ * static constexpr bool kMultiConsumer
+ *   Whether several threads may pop from the same queue.
+ *
  * We define the following classes:
  *
  * ConcurrentQueueMoodyCamel<T> (aliased to ConcurrentQueue<T>)
@@ -27,6 +30,9 @@
  *
  * ConcurrentQueueTBB<T>
  *   An alternative implementation, backed by tbb::concurrent_queue.
+ *
+ * ConcurrentQueueMPMC<T>
+ *   A bounded lock-free queue for several consumers, with a bulk pop.
  */
 
 #pragma once
@@ -34,9 +40,12 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -46,6 +55,51 @@
 namespace elf {
 namespace concurrency {
 
+// Threads that sleep until a condition of a lock-free structure may have
+// changed. The notifying side only takes the lock if someone sleeps: the
+// fences make sure that either the sleeper sees the change, or the notifier
+// sees the sleeper.
+class Waiters {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // To call after a change that may end a wait.
+  void notifyOne() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (n_.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_one();
+    }
+  }
+
+  void notifyAll() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (n_.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_all();
+    }
+  }
+
+  // Sleeps until notified, unless ready() already. False at the deadline.
+  template <typename Ready>
+  bool wait(Ready ready, Clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    n_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool awake = true;
+    if (!ready()) {
+      awake = cv_.wait_until(lock, deadline) == std::cv_status::no_timeout;
+    }
+    n_.fetch_sub(1, std::memory_order_relaxed);
+    return awake;
+  }
+
+ private:
+  std::atomic<int> n_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
 // moodycamel internally maintains a bunch of sub-queues for each producer
 // thread and sometimes is not fair (the consumer.might always pick the data
 // from a particular thread). Therefore, we amend it with a deque, which makes
@@ -54,6 +108,7 @@ template <typename T>
 class ConcurrentQueueMoodyCamel {
  public:
   using value_type = T;
+  static constexpr bool kMultiConsumer = false;
 
   void push(const T& value) {
     q_.enqueue(value);
@@ -92,52 +147,254 @@ class ConcurrentQueueMoodyCamel {
   }
 
   bool _prefetch(T* v) {
-    T value;
-    while (q_.wait_dequeue_timed(value, std::chrono::microseconds(0))) {
-      buffer_.push_back(value);
+    // Without a backlog, the first item skips the deque (and the allocation
+    // of its blocks).
+    if (buffer_.empty()) {
+      if (!q_.wait_dequeue_timed(*v, std::chrono::microseconds(0))) {
+        return false;
+      }
+      _drain();
+      return true;
     }
 
-    if (buffer_.empty())
-      return false;
-
+    _drain();
     *v = buffer_.front();
     buffer_.pop_front();
     return true;
   }
+
+  void _drain() {
+    T value;
+    while (q_.wait_dequeue_timed(value, std::chrono::microseconds(0))) {
+      buffer_.push_back(value);
+    }
+  }
 };
 
+// Consumers spin for a while, then sleep until a push.
 template <typename T>
 class ConcurrentQueueTBB {
  public:
   using value_type = T;
+  using Clock = std::chrono::steady_clock;
+  static constexpr bool kMultiConsumer = true;
 
   void push(const T& value) {
     q_.push(value);
+    waiters_.notifyOne();
   }
 
   void pop(T* value) {
-    while (true) {
-      if (q_.try_pop(*value)) {
-        return;
-      }
+    while (!pop(value, std::chrono::seconds(1))) {
     }
   }
 
   template <typename Rep, typename Period>
   bool pop(T* value, std::chrono::duration<Rep, Period> timeout) {
-    if (!q_.try_pop(*value)) {
-      // Sleep would not efficiently return the element.
-      std::this_thread::sleep_for(timeout);
-      if (!q_.try_pop(*value)) {
+    const Clock::time_point deadline = Clock::now() + timeout;
+    for (int spins = 0;; ++spins) {
+      if (q_.try_pop(*value)) {
+        return true;
+      }
+      // A zero or elapsed timeout gets a single try.
+      if (Clock::now() >= deadline) {
         return false;
       }
+      if (spins < kSpins) {
+        std::this_thread::yield();
+      } else if (!waiters_.wait([this]() { return !q_.empty(); }, deadline)) {
+        return q_.try_pop(*value);
+      }
     }
-    return true;
   }
 
  private:
+  // Yields before sleeping.
+  static constexpr int kSpins = 64;
+
   using QueueT = tbb::concurrent_queue<T>;
   QueueT q_;
+  Waiters waiters_;
+};
+
+// A bounded multi-producer, multi-consumer queue: a ring of cells, each with
+// a sequence number that tells whether it is ready to be written or read
+// (D. Vyukov's design). Producers and consumers each contend on one atomic
+// position, and a consumer claims a whole run of ready cells at once, so
+// several consumers, e.g. the collectors of a label, can share the queue.
+//
+// push() waits while the queue is full. Consumers spin for a while before
+// they sleep.
+template <typename T>
+class ConcurrentQueueMPMC {
+ public:
+  using value_type = T;
+  using Clock = std::chrono::steady_clock;
+  static constexpr bool kMultiConsumer = true;
+  static constexpr size_t kDefaultCapacity = 4096;
+
+  // The capacity is rounded up to a power of 2.
+  explicit ConcurrentQueueMPMC(size_t capacity = kDefaultCapacity) {
+    size_t n = 2;
+    while (n < capacity) {
+      n *= 2;
+    }
+    mask_ = n - 1;
+    cells_.reset(new Cell[n]);
+    for (size_t i = 0; i < n; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentQueueMPMC(const ConcurrentQueueMPMC&) = delete;
+  ConcurrentQueueMPMC& operator=(const ConcurrentQueueMPMC&) = delete;
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  bool try_push(const T& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t seq = cell.seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          notEmpty_.notifyOne();
+          return true;
+        }
+      } else if (diff < 0) {
+        // Full.
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(const T& value) {
+    for (int spins = 0; !try_push(value); ++spins) {
+      if (spins < kSpins) {
+        std::this_thread::yield();
+      } else {
+        notFull_.wait(
+            [this]() { return !_full(); },
+            Clock::now() + std::chrono::seconds(1));
+      }
+    }
+  }
+
+  // Pops up to max_items into values, without waiting.
+  size_t try_pop_bulk(T* values, size_t max_items) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (max_items > 0) {
+      // The run of ready cells from pos.
+      size_t n = 0;
+      while (n < max_items) {
+        const size_t seq =
+            cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire);
+        if (seq != pos + n + 1) {
+          break;
+        }
+        n++;
+      }
+      if (n == 0) {
+        const size_t seq =
+            cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+          // Empty.
+          return 0;
+        }
+        // Another consumer took it.
+        pos = head_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (head_.compare_exchange_weak(
+              pos, pos + n, std::memory_order_relaxed)) {
+        // The cells are ours until we release them.
+        for (size_t i = 0; i < n; ++i) {
+          Cell& cell = cells_[(pos + i) & mask_];
+          values[i] = std::move(cell.value);
+          cell.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+        }
+        notFull_.notifyAll();
+        return n;
+      }
+    }
+    return 0;
+  }
+
+  // Pops up to max_items into values. Returns once there are max_items, or
+  // at the deadline with whatever arrived until then (maybe nothing).
+  size_t try_pop_bulk(T* values, size_t max_items, Clock::time_point deadline) {
+    size_t n = 0;
+    for (int spins = 0; n < max_items; ++spins) {
+      const size_t got = try_pop_bulk(values + n, max_items - n);
+      if (got > 0) {
+        n += got;
+        spins = 0;
+        continue;
+      }
+      // Nothing to wait for past the deadline: one try is all it gets.
+      if (Clock::now() >= deadline) {
+        break;
+      }
+      if (spins < kSpins) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (!notEmpty_.wait([this]() { return !_empty(); }, deadline)) {
+        // One last look.
+        n += try_pop_bulk(values + n, max_items - n);
+        break;
+      }
+    }
+    return n;
+  }
+
+  void pop(T* value) {
+    while (!pop(value, std::chrono::seconds(1))) {
+    }
+  }
+
+  template <typename Rep, typename Period>
+  bool pop(T* value, std::chrono::duration<Rep, Period> timeout) {
+    return try_pop_bulk(value, 1, Clock::now() + timeout) == 1;
+  }
+
+ private:
+  // Yields before sleeping.
+  static constexpr int kSpins = 64;
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+
+  // Apart, so that producers and consumers do not share a cache line.
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) Waiters notEmpty_;
+  Waiters notFull_;
+
+  bool _full() const {
+    const size_t pos = tail_.load(std::memory_order_relaxed);
+    const size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+    return (intptr_t)seq - (intptr_t)pos < 0;
+  }
+
+  bool _empty() const {
+    const size_t pos = head_.load(std::memory_order_relaxed);
+    const size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+    return (intptr_t)seq - (intptr_t)(pos + 1) < 0;
+  }
 };
 
 // Define the moodycamel queue to be the default implementation
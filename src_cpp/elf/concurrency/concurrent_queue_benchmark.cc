@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Contention of the server side queues of comm: many producers (games) and
+// a few consumers (collectors). Each consumer spends work_ns per item, like
+// a collector filling a batch.
+//
+//   moodycamel: one single-consumer queue per consumer, and the producers
+//               pick one at random per item, as comm routes to the servers
+//               of a label today.
+//   tbb:        one shared queue.
+//   mpmc:       one shared ConcurrentQueueMPMC, popped one item at a time.
+//   mpmc bulk:  the same, popped by batches of up to 32 items.
+//
+// Usage: bench_concurrent_queue [num_producers] [items_per_producer] [work_ns]
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentQueue.h"
+
+namespace {
+
+using elf::concurrency::ConcurrentQueueMPMC;
+using elf::concurrency::ConcurrentQueueMoodyCamel;
+using elf::concurrency::ConcurrentQueueTBB;
+using Clock = std::chrono::steady_clock;
+
+// About the size of a comm message.
+struct Item {
+  void* from = nullptr;
+  void* to = nullptr;
+  const void* data = nullptr;
+  size_t size = 0;
+  size_t base_idx = 0;
+};
+
+const auto kTimeout = std::chrono::microseconds(100);
+const int kBulk = 32;
+
+void spin(int64_t ns) {
+  const auto end = Clock::now() + std::chrono::nanoseconds(ns);
+  while (Clock::now() < end) {
+  }
+}
+
+// push(producer, item), and pop(consumer, items) returns how many items it
+// got, maybe none after a timeout.
+struct Ops {
+  std::function<void(int, const Item&)> push;
+  std::function<int(int, Item*)> pop;
+};
+
+double run(
+    const Ops& ops,
+    int num_producers,
+    int num_consumers,
+    int items_per_producer,
+    int64_t work_ns) {
+  const int64_t total = int64_t(num_producers) * items_per_producer;
+  std::atomic<int64_t> consumed(0);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> threads;
+  for (int c = 0; c < num_consumers; ++c) {
+    threads.emplace_back([&, c]() {
+      std::vector<Item> items(kBulk);
+      while (!go) {
+      }
+      while (consumed < total) {
+        const int n = ops.pop(c, items.data());
+        spin(work_ns * n);
+        consumed += n;
+      }
+    });
+  }
+  for (int p = 0; p < num_producers; ++p) {
+    threads.emplace_back([&, p]() {
+      Item item;
+      while (!go) {
+        std::this_thread::yield();
+      }
+      for (int i = 0; i < items_per_producer; ++i) {
+        item.base_idx = i;
+        ops.push(p, item);
+      }
+    });
+  }
+
+  const auto start = Clock::now();
+  go = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  const double sec =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return total / sec;
+}
+
+void bench(
+    const std::string& name,
+    int num_consumers,
+    const Ops& ops,
+    int num_producers,
+    int items_per_producer,
+    int64_t work_ns) {
+  const double rate =
+      run(ops, num_producers, num_consumers, items_per_producer, work_ns);
+  std::cout << std::setw(12) << name << std::setw(11) << num_consumers
+            << std::setw(14) << rate / 1e6 << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const int num_producers = argc > 1 ? std::atoi(argv[1]) : 256;
+  const int items_per_producer = argc > 2 ? std::atoi(argv[2]) : 2000;
+  const int64_t work_ns = argc > 3 ? std::atoll(argv[3]) : 200;
+
+  std::cout << num_producers << " producers, " << items_per_producer
+            << " items each, " << work_ns << " ns/item to consume"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "       queue  consumers  Mitems/s" << std::endl;
+
+  for (int num_consumers : {1, 2, 4, 8}) {
+    {
+      std::vector<std::unique_ptr<ConcurrentQueueMoodyCamel<Item>>> qs;
+      for (int c = 0; c < num_consumers; ++c) {
+        qs.emplace_back(new ConcurrentQueueMoodyCamel<Item>());
+      }
+      std::vector<std::mt19937> rngs;
+      for (int p = 0; p < num_producers; ++p) {
+        rngs.emplace_back(p);
+      }
+      Ops ops;
+      ops.push = [&](int p, const Item& item) {
+        qs[rngs[p]() % num_consumers]->push(item);
+      };
+      ops.pop = [&](int c, Item* items) {
+        return qs[c]->pop(items, kTimeout) ? 1 : 0;
+      };
+      bench(
+          "moodycamel",
+          num_consumers,
+          ops,
+          num_producers,
+          items_per_producer,
+          work_ns);
+    }
+    {
+      ConcurrentQueueTBB<Item> q;
+      Ops ops;
+      ops.push = [&](int, const Item& item) { q.push(item); };
+      ops.pop = [&](int, Item* items) {
+        return q.pop(items, kTimeout) ? 1 : 0;
+      };
+      bench(
+          "tbb",
+          num_consumers,
+          ops,
+          num_producers,
+          items_per_producer,
+          work_ns);
+    }
+    {
+      ConcurrentQueueMPMC<Item> q;
+      Ops ops;
+      ops.push = [&](int, const Item& item) { q.push(item); };
+      ops.pop = [&](int, Item* items) {
+        return q.pop(items, kTimeout) ? 1 : 0;
+      };
+      bench(
+          "mpmc",
+          num_consumers,
+          ops,
+          num_producers,
+          items_per_producer,
+          work_ns);
+    }
+    {
+      ConcurrentQueueMPMC<Item> q;
+      Ops ops;
+      ops.push = [&](int, const Item& item) { q.push(item); };
+      ops.pop = [&](int, Item* items) {
+        return (int)q.try_pop_bulk(items, kBulk, Clock::now() + kTimeout);
+      };
+      bench(
+          "mpmc bulk",
+          num_consumers,
+          ops,
+          num_producers,
+          items_per_producer,
+          work_ns);
+    }
+  }
+  return 0;
+}
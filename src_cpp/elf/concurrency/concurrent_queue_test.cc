@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConcurrentQueue.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "elf/comm/comm.h"
+
+using elf::concurrency::ConcurrentQueueMPMC;
+using elf::concurrency::ConcurrentQueueTBB;
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+namespace {
+
+// CPU time of the calling thread.
+double threadCpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+} // namespace
+
+TEST(ConcurrentQueueTBBTest, timedPopWakesOnPush) {
+  ConcurrentQueueTBB<Clock::time_point> q;
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(milliseconds(50));
+    q.push(Clock::now());
+  });
+
+  const double cpu_ms = threadCpuMs();
+  Clock::time_point pushed;
+  ASSERT_TRUE(q.pop(&pushed, std::chrono::seconds(10)));
+  // Not after the whole timeout.
+  EXPECT_LT(Clock::now() - pushed, milliseconds(20));
+  // Parked, not spinning, while waiting.
+  EXPECT_LT(threadCpuMs() - cpu_ms, 10);
+  producer.join();
+}
+
+TEST(ConcurrentQueueTBBTest, blockingPopParks) {
+  ConcurrentQueueTBB<Clock::time_point> q;
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(milliseconds(50));
+    q.push(Clock::now());
+  });
+
+  const double cpu_ms = threadCpuMs();
+  Clock::time_point pushed;
+  q.pop(&pushed);
+  EXPECT_LT(Clock::now() - pushed, milliseconds(20));
+  EXPECT_LT(threadCpuMs() - cpu_ms, 10);
+  producer.join();
+}
+
+TEST(ConcurrentQueueTBBTest, timedPopTimesOut) {
+  ConcurrentQueueTBB<int> q;
+  int v = -1;
+  const auto start = Clock::now();
+  EXPECT_FALSE(q.pop(&v, milliseconds(20)));
+  const auto elapsed = Clock::now() - start;
+  EXPECT_GE(elapsed, milliseconds(20));
+  EXPECT_LT(elapsed, milliseconds(200));
+  EXPECT_EQ(v, -1);
+}
+
+TEST(ConcurrentQueueTBBTest, zeroTimeoutPopReturnsAtOnce) {
+  ConcurrentQueueTBB<int> q;
+  int v = -1;
+  const auto start = Clock::now();
+  EXPECT_FALSE(q.pop(&v, std::chrono::microseconds(0)));
+  EXPECT_LT(Clock::now() - start, milliseconds(5));
+  EXPECT_EQ(v, -1);
+
+  q.push(1);
+  EXPECT_TRUE(q.pop(&v, std::chrono::microseconds(0)));
+  EXPECT_EQ(v, 1);
+}
+
+TEST(ConcurrentQueueTBBTest, wakeupUnderLoad) {
+  const int kProducers = 4;
+  const int kConsumers = 2;
+  const int kItems = 200;
+  ConcurrentQueueTBB<Clock::time_point> q;
+
+  // Keep the cores busy.
+  std::atomic<bool> done(false);
+  std::vector<std::thread> hogs;
+  for (unsigned i = 0; i < std::max(std::thread::hardware_concurrency(), 2u);
+       ++i) {
+    hogs.emplace_back([&]() {
+      while (!done) {
+      }
+    });
+  }
+
+  std::vector<std::vector<double>> latencies_ms(kConsumers);
+  std::atomic<int> received(0);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < kConsumers; ++c) {
+    threads.emplace_back([&, c]() {
+      Clock::time_point pushed;
+      while (received < kProducers * kItems) {
+        if (q.pop(&pushed, milliseconds(200))) {
+          latencies_ms[c].push_back(
+              std::chrono::duration<double, std::milli>(Clock::now() - pushed)
+                  .count());
+          received++;
+        }
+      }
+    });
+  }
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < kItems; ++i) {
+        q.push(Clock::now());
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  done = true;
+  for (auto& t : hogs) {
+    t.join();
+  }
+
+  std::vector<double> all;
+  for (const auto& l : latencies_ms) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  ASSERT_EQ(all.size(), kProducers * kItems);
+  std::sort(all.begin(), all.end());
+  // Sleeping out the timeout would take 200ms.
+  EXPECT_LT(all[all.size() / 2], 20);
+}
+
+TEST(ConcurrentQueueMPMCTest, fifoAndCapacity) {
+  ConcurrentQueueMPMC<int> q(5);
+  EXPECT_EQ(q.capacity(), 8);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_TRUE(q.try_push(i));
+  }
+  EXPECT_FALSE(q.try_push(8));
+
+  int v = -1;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(q.pop(&v, std::chrono::microseconds(0)));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_FALSE(q.pop(&v, std::chrono::microseconds(0)));
+  // Wraps around.
+  EXPECT_TRUE(q.try_push(9));
+  q.pop(&v);
+  EXPECT_EQ(v, 9);
+}
+
+TEST(ConcurrentQueueMPMCTest, bulkPopDeadline) {
+  ConcurrentQueueMPMC<int> q;
+  int values[10];
+  for (int i = 0; i < 3; ++i) {
+    q.push(i);
+  }
+  EXPECT_EQ(q.try_pop_bulk(values, 2), 2);
+  EXPECT_EQ(values[1], 1);
+
+  // Waits for more, until the deadline.
+  const auto start = Clock::now();
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    q.push(3);
+  });
+  const size_t n =
+      q.try_pop_bulk(values, 10, start + std::chrono::milliseconds(20));
+  producer.join();
+  EXPECT_GE(Clock::now() - start, std::chrono::milliseconds(20));
+  ASSERT_EQ(n, 2);
+  EXPECT_EQ(values[0], 2);
+  EXPECT_EQ(values[1], 3);
+
+  // Returns as soon as it has max_items.
+  q.push(4);
+  const auto t = Clock::now();
+  EXPECT_EQ(q.try_pop_bulk(values, 1, t + std::chrono::seconds(10)), 1);
+  EXPECT_LT(Clock::now() - t, std::chrono::seconds(1));
+}
+
+TEST(ConcurrentQueueMPMCTest, bulkPopPastDeadline) {
+  ConcurrentQueueMPMC<int> q;
+  int values[4];
+  const auto start = Clock::now();
+  EXPECT_EQ(q.try_pop_bulk(values, 4, start), 0);
+  EXPECT_LT(Clock::now() - start, std::chrono::milliseconds(5));
+
+  // Still takes what is there.
+  q.push(1);
+  q.push(2);
+  EXPECT_EQ(q.try_pop_bulk(values, 4, Clock::now()), 2);
+  EXPECT_EQ(values[1], 2);
+}
+
+TEST(ConcurrentQueueMPMCTest, manyProducersAndConsumers) {
+  const int kProducers = 8;
+  const int kConsumers = 4;
+  const int kItems = 20000;
+  // Small, to have producers wait for room.
+  ConcurrentQueueMPMC<int> q(64);
+
+  std::vector<std::atomic<int>> seen(kProducers * kItems);
+  std::atomic<int> consumed(0);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < kConsumers; ++c) {
+    threads.emplace_back([&]() {
+      int values[16];
+      while (consumed < kProducers * kItems) {
+        const size_t n = q.try_pop_bulk(
+            values, 16, Clock::now() + std::chrono::milliseconds(1));
+        for (size_t i = 0; i < n; ++i) {
+          seen[values[i]]++;
+        }
+        consumed += n;
+      }
+    });
+  }
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p]() {
+      for (int i = 0; i < kItems; ++i) {
+        q.push(p * kItems + i);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(consumed, kProducers * kItems);
+  for (const auto& n : seen) {
+    ASSERT_EQ(n, 1);
+  }
+}
+
+TEST(ConcurrentQueueMPMCTest, serversOfALabelShareTheQueue) {
+  using Comm = comm::CommT<
+      int,
+      false,
+      elf::concurrency::ConcurrentQueue,
+      ConcurrentQueueMPMC>;
+  const int kMessages = 100;
+
+  Comm comm;
+  auto server = comm.getServer();
+  std::atomic<bool> done(false);
+  // Registered, but never takes a message.
+  std::thread idle([&]() {
+    server->RegServer("actor");
+    while (!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  std::thread busy([&]() {
+    server->RegServer("actor");
+    std::vector<Comm::Message> batch;
+    for (int received = 0; received < kMessages;) {
+      server->waitBatch(comm::RecvOptions("actor", 1), &batch);
+      received += batch.size();
+      server->ReleaseBatch(batch, comm::SUCCESS);
+    }
+  });
+  server->waitForRegs(2);
+
+  // With a queue per server, about half of these would wait for idle.
+  auto client = comm.getClient();
+  for (int i = 0; i < kMessages; ++i) {
+    client->sendWait(i, {"actor"});
+  }
+  busy.join();
+  done = true;
+  idle.join();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+namespace elf_utils {
+
+// Counter-based generator: the i-th output is a hash of (key, i), so there is
+// no state to contend on besides the counter, and streams with different keys
+// are independent. Meets UniformRandomBitGenerator, so it also works with the
+// <random> distributions.
+class CounterRng {
+ public:
+  using result_type = uint64_t;
+
+  explicit CounterRng(uint64_t seed = 0, uint64_t stream = 0) {
+    this->seed(seed, stream);
+  }
+
+  void seed(uint64_t seed, uint64_t stream = 0) {
+    key_ = mix(seed ^ mix(stream + kGolden));
+    counter_ = 0;
+  }
+
+  static constexpr result_type min() {
+    return 0;
+  }
+  static constexpr result_type max() {
+    return ~result_type(0);
+  }
+
+  result_type operator()() {
+    return mix(key_ + (++counter_) * kGolden);
+  }
+
+  void discard(uint64_t n) {
+    counter_ += n;
+  }
+
+  // Uniform in [0, 1).
+  float uniform() {
+    return (operator()() >> 40) * (1.0f / (1 << 24));
+  }
+
+  // Uniform in [0, n), without the modulo bias or division.
+  uint32_t below(uint32_t n) {
+    return static_cast<uint32_t>(((operator()() >> 32) * n) >> 32);
+  }
+
+ private:
+  static constexpr uint64_t kGolden = 0x9E3779B97F4A7C15ULL;
+
+  uint64_t key_;
+  uint64_t counter_;
+
+  // SplitMix64 finalizer.
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+};
+
+namespace detail {
+
+inline std::atomic<uint64_t>& threadRngSeed() {
+  static std::atomic<uint64_t> seed(get_seed(0));
+  return seed;
+}
+
+inline std::atomic<uint64_t>& threadRngStreams() {
+  static std::atomic<uint64_t> streams(0);
+  return streams;
+}
+
+} // namespace detail
+
+// Seed of the thread generators created from now on. Each thread gets the
+// next stream of it, so runs that start their threads in the same order draw
+// the same numbers.
+inline void set_thread_rng_seed(uint64_t seed) {
+  detail::threadRngSeed() = seed;
+  detail::threadRngStreams() = 0;
+}
+
+// Generator of the calling thread, for code that has no generator of its own.
+inline CounterRng& thread_rng() {
+  thread_local CounterRng rng(
+      detail::threadRngSeed().load(), detail::threadRngStreams()++);
+  return rng;
+}
+
+template <typename Rng>
+uint64_t random_u64(Rng* rng) {
+  if constexpr (Rng::max() - Rng::min() == 0xFFFFFFFFFFFFFFFFULL) {
+    return (*rng)() - Rng::min();
+  } else {
+    // 32-bit generators, e.g. std::mt19937.
+    uint64_t hi = static_cast<uint32_t>((*rng)() - Rng::min());
+    uint64_t lo = static_cast<uint32_t>((*rng)() - Rng::min());
+    return (hi << 32) | lo;
+  }
+}
+
+// Uniform in (0, 1].
+template <typename Rng>
+float uniform_open(Rng* rng) {
+  return ((random_u64(rng) >> 40) + 1) * (1.0f / (1 << 24));
+}
+
+// Gamma(alpha, 1), Marsaglia and Tsang. Shapes below 1 are boosted with
+// Gamma(alpha) = Gamma(alpha + 1) * U^(1 / alpha).
+class GammaSampler {
+ public:
+  explicit GammaSampler(float alpha)
+      : boost_(alpha < 1.0f), inv_alpha_(1.0f / alpha) {
+    assert(alpha > 0);
+    d_ = (boost_ ? alpha + 1.0f : alpha) - 1.0f / 3.0f;
+    c_ = 1.0f / std::sqrt(9.0f * d_);
+  }
+
+  template <typename Rng>
+  float operator()(Rng* rng) {
+    float g = 0;
+    while (true) {
+      float x = normal(rng);
+      float v = 1.0f + c_ * x;
+      if (v <= 0)
+        continue;
+      v = v * v * v;
+      float u = uniform_open(rng);
+      float x2 = x * x;
+      // Squeeze first; the log is needed for ~2% of the draws.
+      if (u < 1.0f - 0.0331f * x2 * x2 ||
+          std::log(u) < 0.5f * x2 + d_ * (1.0f - v + std::log(v))) {
+        g = d_ * v;
+        break;
+      }
+    }
+    if (boost_)
+      g *= std::pow(uniform_open(rng), inv_alpha_);
+    return g;
+  }
+
+ private:
+  bool boost_;
+  float inv_alpha_;
+  float d_;
+  float c_;
+
+  // Normals come in pairs (polar method); keep the spare one.
+  bool has_spare_ = false;
+  float spare_ = 0;
+
+  template <typename Rng>
+  float normal(Rng* rng) {
+    if (has_spare_) {
+      has_spare_ = false;
+      return spare_;
+    }
+    float u, v, s;
+    do {
+      u = 2.0f * uniform_open(rng) - 1.0f;
+      v = 2.0f * uniform_open(rng) - 1.0f;
+      s = u * u + v * v;
+    } while (s >= 1.0f || s == 0.0f);
+    float m = std::sqrt(-2.0f * std::log(s) / s);
+    spare_ = v * m;
+    has_spare_ = true;
+    return u * m;
+  }
+};
+
+// Symmetric Dirichlet(alpha) over n entries, written to out.
+template <typename Rng>
+void sample_dirichlet(float alpha, size_t n, Rng* rng, float* out) {
+  GammaSampler gamma(alpha);
+  float Z = 0;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = gamma(rng);
+    Z += out[i];
+  }
+  // Tiny alphas can underflow every entry.
+  const float inv_Z = Z > 0 ? 1.0f / Z : 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] *= inv_Z;
+  }
+}
+
+// Walker's alias table: O(n) to build, O(1) per draw. Worth it when drawing
+// many times from the same weights; for a single draw use
+// sample_multinomial().
+class AliasTable {
+ public:
+  AliasTable() {}
+  AliasTable(const float* weights, size_t n) {
+    build(weights, n);
+  }
+
+  void build(const float* weights, size_t n) {
+    prob_.assign(n, 1.0f);
+    alias_.resize(n);
+    if (n == 0)
+      return;
+
+    double total = 0;
+    for (size_t i = 0; i < n; ++i) {
+      total += weights[i];
+    }
+
+    // Vose's method.
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+      alias_[i] = i;
+      scaled[i] = total > 0 ? weights[i] * n / total : 1.0;
+      (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      uint32_t s = small.back();
+      small.pop_back();
+      uint32_t l = large.back();
+      prob_[s] = scaled[s];
+      alias_[s] = l;
+      scaled[l] -= 1.0 - scaled[s];
+      if (scaled[l] < 1.0) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // Whatever is left is 1 up to rounding.
+  }
+
+  size_t size() const {
+    return prob_.size();
+  }
+
+  template <typename Rng>
+  size_t sample(Rng* rng) const {
+    assert(!prob_.empty());
+    uint64_t r = random_u64(rng);
+    size_t i = ((r >> 32) * prob_.size()) >> 32;
+    float u = static_cast<uint32_t>(r) * (1.0f / 4294967296.0f);
+    return u < prob_[i] ? i : alias_[i];
+  }
+
+ private:
+  std::vector<float> prob_;
+  std::vector<uint32_t> alias_;
+};
+
+} // namespace elf_utils
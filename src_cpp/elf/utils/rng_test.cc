@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "rng.h"
+
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace elf_utils {
+
+TEST(RngTest, seedAndStreams) {
+  CounterRng a(42), b(42), c(42, 1), d(43);
+  std::set<uint64_t> seen;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t x = a();
+    EXPECT_EQ(x, b());
+    seen.insert(x);
+    seen.insert(c());
+    seen.insert(d());
+  }
+  EXPECT_EQ(seen.size(), 3000);
+
+  // discard() skips exactly that many draws.
+  CounterRng e(7), f(7);
+  e.discard(10);
+  for (int i = 0; i < 10; ++i) {
+    f();
+  }
+  EXPECT_EQ(e(), f());
+}
+
+TEST(RngTest, uniformAndBelow) {
+  CounterRng rng(1);
+  const int n = 100000;
+  std::vector<int> counts(10, 0);
+  double sum = 0;
+  for (int i = 0; i < n; ++i) {
+    float u = rng.uniform();
+    ASSERT_GE(u, 0.0f);
+    ASSERT_LT(u, 1.0f);
+    sum += u;
+    uint32_t k = rng.below(10);
+    ASSERT_LT(k, 10u);
+    counts[k]++;
+  }
+  EXPECT_NEAR(sum / n, 0.5, 0.01);
+  for (int c : counts) {
+    EXPECT_NEAR(c, n / 10, n / 100);
+  }
+}
+
+TEST(RngTest, threadRngIsPerThread) {
+  set_thread_rng_seed(5);
+  uint64_t x = 0, y = 0;
+  std::thread t1([&] { x = thread_rng()(); });
+  t1.join();
+  std::thread t2([&] { y = thread_rng()(); });
+  t2.join();
+  EXPECT_NE(x, y);
+
+  // Same seed and thread order, same numbers.
+  set_thread_rng_seed(5);
+  uint64_t x2 = 0;
+  std::thread t3([&] { x2 = thread_rng()(); });
+  t3.join();
+  EXPECT_EQ(x, x2);
+}
+
+TEST(RngTest, gammaMoments) {
+  CounterRng rng(3);
+  for (float alpha : {0.03f, 0.3f, 1.0f, 4.0f}) {
+    GammaSampler gamma(alpha);
+    const int n = 200000;
+    double sum = 0, sum2 = 0;
+    for (int i = 0; i < n; ++i) {
+      double g = gamma(&rng);
+      ASSERT_GE(g, 0.0);
+      sum += g;
+      sum2 += g * g;
+    }
+    double mean = sum / n;
+    double var = sum2 / n - mean * mean;
+    // Gamma(alpha, 1) has mean and variance alpha.
+    EXPECT_NEAR(mean, alpha, 0.02 * alpha + 0.005) << "alpha " << alpha;
+    EXPECT_NEAR(var, alpha, 0.1 * alpha + 0.005) << "alpha " << alpha;
+  }
+}
+
+TEST(RngTest, dirichlet) {
+  CounterRng rng(4);
+  const int n = 362;
+  std::vector<float> p(n);
+  std::vector<double> mean(n, 0.0);
+  const int trials = 2000;
+  for (int t = 0; t < trials; ++t) {
+    sample_dirichlet(0.03f, n, &rng, p.data());
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+      ASSERT_GE(p[i], 0.0f);
+      sum += p[i];
+      mean[i] += p[i] / trials;
+    }
+    EXPECT_NEAR(sum, 1.0, 1e-4);
+  }
+  // Symmetric: each entry has mean 1 / n.
+  double avg = 0;
+  for (double m : mean) {
+    avg += m / n;
+  }
+  EXPECT_NEAR(avg, 1.0 / n, 1e-6);
+
+  // Works with <random> generators too.
+  std::mt19937 mt(1);
+  sample_dirichlet(0.3f, n, &mt, p.data());
+}
+
+TEST(RngTest, aliasTable) {
+  const std::vector<float> weights = {1.0f, 0.0f, 3.0f, 6.0f};
+  AliasTable table(weights.data(), weights.size());
+  EXPECT_EQ(table.size(), weights.size());
+
+  CounterRng rng(6);
+  const int n = 100000;
+  std::vector<int> counts(weights.size(), 0);
+  for (int i = 0; i < n; ++i) {
+    counts[table.sample(&rng)]++;
+  }
+  EXPECT_EQ(counts[1], 0);
+  for (size_t i = 0; i < weights.size(); ++i) {
+    EXPECT_NEAR(counts[i], n * weights[i] / 10, n / 100) << i;
+  }
+}
+
+TEST(RngTest, sampleMultinomial) {
+  std::vector<std::pair<int, float>> v = {{10, 0.2f}, {11, 0.0f}, {12, 0.8f}};
+  CounterRng rng(8);
+  std::vector<int> counts(v.size(), 0);
+  const int n = 50000;
+  for (int i = 0; i < n; ++i) {
+    counts[sample_multinomial(v, &rng)]++;
+  }
+  EXPECT_EQ(counts[1], 0);
+  EXPECT_NEAR(counts[0], n * 0.2, n / 100);
+}
+
+} // namespace elf_utils
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -155,25 +155,21 @@ std::pair<typename Map::iterator, bool> map_get(
   }
 }
 
-template <typename A>
-size_t sample_multinomial(
-    const std::vector<std::pair<A, float>>& v,
-    std::mt19937* gen) {
-  std::vector<float> accu(v.size() + 1);
-
+template <typename A, typename Gen>
+size_t sample_multinomial(const std::vector<std::pair<A, float>>& v, Gen* gen) {
   float Z = 0.0;
   for (const auto& vv : v) {
     Z += vv.second;
   }
 
-  std::uniform_real_distribution<> dis(0, Z);
+  std::uniform_real_distribution<float> dis(0, Z);
   float rd = dis(*gen);
 
-  accu[0] = 0;
-  for (size_t i = 1; i < accu.size(); i++) {
-    accu[i] = v[i - 1].second + accu[i - 1];
-    if (rd < accu[i]) {
-      return i - 1;
+  float accu = 0;
+  for (size_t i = 0; i < v.size(); i++) {
+    accu += v[i].second;
+    if (rd < accu) {
+      return i;
     }
   }
 
@@ -826,6 +826,44 @@ bool TryPlay(const Board* board, int x, int y, Stone player, GroupId4* ids) {
   return true;
 }
 
+void FindAllLegalMoves(const Board* board, MoveMask* mask) {
+  memset(mask, 0, sizeof(MoveMask));
+  const Stone player = board->_next_player;
+
+  for (int y = 0; y < BOARD_SIZE; ++y) {
+    for (int x = 0; x < BOARD_SIZE; ++x) {
+      Coord c = OFFSETXY(x, y);
+      if (!EMPTY(board->_infos[c].color))
+        continue;
+      if (isSimpleKoViolation(board, c, player))
+        continue;
+
+      // Same as !isSuicideMove(), read from the group table directly: the
+      // move has a liberty, joins our group that has another liberty, or
+      // captures.
+      bool legal = false;
+      FOR4(c, i4, c4) {
+        unsigned char id = board->_infos[c4].id;
+        if (G_EMPTY(id)) {
+          legal = true;
+          break;
+        }
+        if (!G_ONBOARD(id))
+          continue;
+        const Group& g = board->_groups[id];
+        if (g.color == player ? g.liberties > 1 : g.liberties == 1) {
+          legal = true;
+          break;
+        }
+      }
+      ENDFOR4
+
+      if (legal)
+        mask->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+    }
+  }
+}
+
 void getAllStones(const Board* board, AllMoves* black, AllMoves* white) {
   black->num_moves = 0;
   white->num_moves = 0;
@@ -296,6 +296,17 @@ bool TryPlay(const Board* board, int x, int y, Stone player, GroupId4* ids);
 // Simple version of it.
 bool TryPlay2(const Board* board, Coord m, GroupId4* ids);
 
+// One bit per coordinate.
+typedef struct {
+  uint64_t bits[(BOUND_COORD + 63) / 64];
+} MoveMask;
+
+#define MOVE_MASK_HAS(mask, c) ((((mask)->bits[(c) >> 6]) >> ((c)&63)) & 1)
+
+// Set the bits of all the moves TryPlay2 accepts for the next player, in one
+// sweep over the board. PASS and RESIGN are not in the mask.
+void FindAllLegalMoves(const Board* board, MoveMask* mask);
+
 // Actually play the game. If return true, then the game ended (either by PASS +
 // PASS or by RESIGN)
 bool Play(Board* board, const GroupId4* ids);
@@ -248,37 +248,35 @@ void BoardFeature::extractAGZ(float* features) const {
   std::fill(features, features + MAX_NUM_AGZ_FEATURE * kBoardRegion, 0.0);
 
   const Board* _board = &s_.board();
-  // get history of type std::deque<BoardHistory>
-  // and BoardHistory is a struct with members:
-  // std::vector<Coord> black;
-  // std::vector<Coord> white;
-  const auto& history = s_.getHistory();
+  // History of the last MAX_NUM_AGZ_HISTORY positions, most recent first.
+  // Each BoardHistory is a packed copy of the stones (see Board::Bits).
+  const int history_size = s_.getHistorySize();
 
   Stone player = _board->_next_player;
+  Stone opponent = OPPONENT(player);
 
-  if (history.size() > MAX_NUM_AGZ_HISTORY) {
+  if (history_size > MAX_NUM_AGZ_HISTORY) {
     logger_->info(
-        "#history.size() = {}, > {}", history.size(), MAX_NUM_AGZ_HISTORY);
+        "#history.size() = {}, > {}", history_size, MAX_NUM_AGZ_HISTORY);
     assert(false);
   }
 
   // Save the current board state to game state.
-  int i = 0;
-  for (auto it = history.rbegin(); it != history.rend(); ++it) {
-    const std::vector<Coord>* myself = &it->black;
-    const std::vector<Coord>* opponent = &it->white;
-    if (player == S_WHITE)
-      std::swap(myself, opponent);
-
-    float* plane_myself = LAYER(i);
-    for (Coord c : *myself)
-      plane_myself[transform(c)] = 1.0;
-
-    float* plane_opponent = LAYER(i + 1);
-    for (Coord c : *opponent)
-      plane_opponent[transform(c)] = 1.0;
-
-    i += 2;
+  for (int k = 0; k < history_size; ++k) {
+    const BoardHistory& h = s_.getHistory(k);
+    float* plane_myself = LAYER(2 * k);
+    float* plane_opponent = LAYER(2 * k + 1);
+
+    for (int i = 0; i < BOARD_SIZE; ++i) {
+      for (int j = 0; j < BOARD_SIZE; ++j) {
+        Coord c = OFFSETXY(i, j);
+        Stone s = h.color(c);
+        if (s == player)
+          plane_myself[transform(c)] = 1.0;
+        else if (s == opponent)
+          plane_opponent[transform(c)] = 1.0;
+      }
+    }
   }
 
   float* black_indicator = LAYER(2 * MAX_NUM_AGZ_HISTORY);
@@ -38,21 +38,19 @@
 #define MAX_NUM_AGZ_FEATURE 18
 #define MAX_NUM_AGZ_HISTORY 8
 
+// Stones of a past position, packed as in Board::Bits (2 bits per point).
 struct BoardHistory {
-  std::vector<Coord> black;
-  std::vector<Coord> white;
+  Board::Bits bits;
 
+  BoardHistory() {
+    memset(bits, 0, sizeof(bits));
+  }
   BoardHistory(const Board& b) {
-    for (int i = 0; i < BOARD_SIZE; ++i) {
-      for (int j = 0; j < BOARD_SIZE; ++j) {
-        Coord c = OFFSETXY(i, j);
-        Stone s = b._infos[c].color;
-        if (s == S_WHITE)
-          white.push_back(c);
-        else if (s == S_BLACK)
-          black.push_back(c);
-      }
-    }
+    copyBits(bits, b._bits);
+  }
+
+  Stone color(Coord c) const {
+    return (bits[c >> 2] >> ((c & 3) << 1)) & 3;
   }
 };
 
@@ -71,7 +69,8 @@ class BoardFeature {
             "")) {}
   BoardFeature(const GoState& s) : s_(s), _rot(NONE), _flip(false) {}
 
-  static BoardFeature RandomShuffle(const GoState& s, std::mt19937* rng) {
+  template <typename Rng>
+  static BoardFeature RandomShuffle(const GoState& s, Rng* rng) {
     BoardFeature bf(s);
     bf.setD4Code((*rng)() % 8);
     return bf;
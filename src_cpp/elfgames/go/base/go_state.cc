@@ -85,11 +85,14 @@ bool GoState::forward(const Coord& c) {
   _add_board_hash(c);
 
   Play(&_board, &ids);
+  if (c != M_PASS)
+    _tt_score.store(kUnknownTTScore, std::memory_order_relaxed);
 
   _moves.push_back(c);
-  _history.emplace_back(_board);
-  if (_history.size() > MAX_NUM_AGZ_HISTORY)
-    _history.pop_front();
+  _history_head = (_history_head + 1) % MAX_NUM_AGZ_HISTORY;
+  _history[_history_head] = BoardHistory(_board);
+  if (_history_size < MAX_NUM_AGZ_HISTORY)
+    _history_size++;
   return true;
 }
 
@@ -100,12 +103,14 @@ bool GoState::_check_superko() const {
     return false;
 
   uint64_t key = _board._hash;
-  auto it = _board_hash.find(key);
-  if (it != _board_hash.end()) {
-    for (const auto& r : it->second) {
-      if (isBitsEqual(_board._bits, r.bits))
-        return true;
-    }
+  if (!_board_hash_filter.test(key % kSuperkoFilterSize) ||
+      !_board_hash_filter.test((key >> 32) % kSuperkoFilterSize))
+    return false;
+
+  for (const _BoardRecord* r = _board_hash.get(); r != nullptr;
+       r = r->prev.get()) {
+    if (r->hash == key && isBitsEqual(_board._bits, r->bits))
+      return true;
   }
   return false;
 }
@@ -115,9 +120,14 @@ void GoState::_add_board_hash(const Coord& c) {
     return;
 
   uint64_t key = _board._hash;
-  auto& r = _board_hash[key];
-  r.emplace_back();
-  copyBits(r.back().bits, _board._bits);
+  auto r = std::make_shared<_BoardRecord>();
+  r->hash = key;
+  copyBits(r->bits, _board._bits);
+  r->prev = std::move(_board_hash);
+  _board_hash = std::move(r);
+
+  _board_hash_filter.set(key % kSuperkoFilterSize);
+  _board_hash_filter.set((key >> 32) % kSuperkoFilterSize);
 }
 
 bool GoState::checkMove(const Coord& c) const {
@@ -127,17 +137,25 @@ bool GoState::checkMove(const Coord& c) const {
   return TryPlay2(&_board, c, &ids);
 }
 
+void GoState::getLegalMoves(MoveMask* mask) const {
+  FindAllLegalMoves(&_board, mask);
+}
+
 void GoState::applyHandicap(int handi) {
   _handi_table.apply(handi, &_board);
+  _tt_score.store(kUnknownTTScore, std::memory_order_relaxed);
 }
 
 void GoState::reset() {
   clearBoard(&_board);
   _moves.clear();
-  _board_hash.clear();
-  _history.clear();
+  _board_hash.reset();
+  _board_hash_filter.reset();
+  _history_head = 0;
+  _history_size = 0;
   _final_value = 0.0;
   _has_final_value = false;
+  _tt_score.store(kUnknownTTScore, std::memory_order_relaxed);
 }
 
 HandicapTable GoState::_handi_table;
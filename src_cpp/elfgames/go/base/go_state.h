@@ -8,8 +8,10 @@
 
 #pragma once
 
-#include <deque>
-#include <queue>
+#include <atomic>
+#include <bitset>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -29,62 +31,57 @@ class HandicapTable {
   void apply(int handi, Board* board) const;
 };
 
-inline std::vector<bool>
-simple_flood_fill(const Board& b, Stone player, std::ostream* oo = nullptr) {
-  std::queue<Coord> q;
+inline int simple_tt_scoring(const Board& b, std::ostream* oo = nullptr) {
+  // No dead stone considered.
+  // A stone counts for its owner. An empty region counts for a player if it
+  // only touches stones of that player. One sweep, each region filled once.
+  bool visited[BOUND_COORD] = {false};
+  Coord stack[BOARD_SIZE * BOARD_SIZE];
+
+  int black_v = 0, white_v = 0;
   for (int i = 0; i < BOARD_SIZE; ++i) {
     for (int j = 0; j < BOARD_SIZE; ++j) {
       Coord c = OFFSETXY(i, j);
-      if (b._infos[c].color == player) {
-        q.push(c);
+      Stone s = b._infos[c].color;
+      if (s == S_BLACK) {
+        black_v++;
+        continue;
+      }
+      if (s == S_WHITE) {
+        white_v++;
+        continue;
+      }
+      if (visited[c])
+        continue;
+
+      // Flood fill the empty region, and OR the colors that border it.
+      int region_size = 0;
+      int border = 0;
+      int top = 0;
+      stack[top++] = c;
+      visited[c] = true;
+      while (top > 0) {
+        Coord cc = stack[--top];
+        region_size++;
+
+        FOR4(cc, _, c4)
+        Stone s4 = b._infos[c4].color;
+        if (s4 == S_EMPTY) {
+          if (!visited[c4]) {
+            visited[c4] = true;
+            stack[top++] = c4;
+          }
+        } else if (s4 != S_OFF_BOARD) {
+          border |= s4;
+        }
+        ENDFOR4
       }
-    }
-  }
 
-  if (oo != nullptr)
-    *oo << "For player " << player2str(player) << ": #stone: " << q.size()
-        << std::endl;
-
-  std::vector<bool> open(BOARD_SIZE * BOARD_SIZE, false);
-  std::vector<bool> f(BOARD_SIZE * BOARD_SIZE, false);
-
-  int counter = 0;
-  while (!q.empty()) {
-    Coord c = q.front();
-    // if (oo != nullptr) *oo << coord2str2(c) << " ";
-    q.pop();
-    f[EXPORT_OFFSET(c)] = true;
-    counter++;
-
-    FOR4(c, _, cc)
-    int offset = EXPORT_OFFSET(cc);
-    if (b._infos[cc].color == S_EMPTY && !open[offset]) {
-      open[offset] = true;
-      q.push(cc);
+      if (border == S_BLACK)
+        black_v += region_size;
+      else if (border == S_WHITE)
+        white_v += region_size;
     }
-    ENDFOR4
-  }
-
-  if (oo != nullptr)
-    *oo << std::endl
-        << "For player " << player2str(player) << ": territory = " << counter
-        << std::endl;
-  return f;
-}
-
-inline int simple_tt_scoring(const Board& b, std::ostream* oo = nullptr) {
-  // No dead stone considered.
-  // [TODO] Can be more efficient with bitset.
-  // if (oo != nullptr) *oo << "In tt scoring" << endl;
-  std::vector<bool> black = simple_flood_fill(b, S_BLACK, oo);
-  std::vector<bool> white = simple_flood_fill(b, S_WHITE, oo);
-
-  int black_v = 0, white_v = 0;
-  for (size_t i = 0; i < black.size(); ++i) {
-    if (black[i] && !white[i])
-      black_v++;
-    else if (white[i] && !black[i])
-      white_v++;
   }
 
   if (oo != nullptr)
@@ -99,6 +96,8 @@ class GoState {
   }
   bool forward(const Coord& c);
   bool checkMove(const Coord& c) const;
+  // All moves checkMove() accepts, except PASS.
+  void getLegalMoves(MoveMask* mask) const;
 
   void setFinalValue(float final_value) {
     _final_value = final_value;
@@ -114,13 +113,22 @@ class GoState {
   void reset();
   void applyHandicap(int handi);
 
+  // Copying is cheap enough for MCTS node expansion: the history is a small
+  // fixed ring, and the superko records are shared with the source state.
   GoState(const GoState& s)
-      : _history(s._history),
+      : _history_head(s._history_head),
+        _history_size(s._history_size),
         _board_hash(s._board_hash),
+        _board_hash_filter(s._board_hash_filter),
         _moves(s._moves),
         _final_value(s._final_value),
-        _has_final_value(s._has_final_value) {
+        _has_final_value(s._has_final_value),
+        _tt_score(s._tt_score.load(std::memory_order_relaxed)) {
     copyBoard(&_board, &s._board);
+    for (int i = 0; i < _history_size; ++i) {
+      const int idx = _historyIndex(i);
+      _history[idx] = s._history[idx];
+    }
   }
 
   static HandicapTable& handi_table() {
@@ -196,35 +204,85 @@ class GoState {
     if (_check_superko()) {
       final_score = nextPlayer() == S_BLACK ? 1.0 : -1.0;
     } else {
-      final_score = (float)simple_tt_scoring(_board, oo) - komi;
+      final_score = (float)_getTTScore(oo) - komi;
     }
 
     return final_score;
   }
 
-  // TODO: not a good design..
-  const std::deque<BoardHistory>& getHistory() const {
-    return _history;
+  // Number of past positions kept (at most MAX_NUM_AGZ_HISTORY).
+  int getHistorySize() const {
+    return _history_size;
+  }
+  // i = 0 is the current position, i = 1 the one before, etc.
+  const BoardHistory& getHistory(int i) const {
+    return _history[_historyIndex(i)];
+  }
+
+  // Bytes of the state. Board records are shared with the states it
+  // descends from, so only the one its last move added is counted.
+  size_t getMemoryBytes() const {
+    size_t n = sizeof(GoState) + _moves.capacity() * sizeof(Coord);
+    if (_board_hash != nullptr && lastMove() != M_PASS) {
+      n += sizeof(_BoardRecord);
+    }
+    return n;
   }
 
  protected:
+  static constexpr size_t kSuperkoFilterSize = 1024;
+  static constexpr int kUnknownTTScore = std::numeric_limits<int>::min();
+
   Board _board;
-  std::deque<BoardHistory> _history;
 
+  // Ring buffer of the last positions, _history_head being the latest.
+  BoardHistory _history[MAX_NUM_AGZ_HISTORY];
+  int _history_head = 0;
+  int _history_size = 0;
+
+  // Positions before each non-pass move, newest first. Records are immutable
+  // and shared by all states that descend from the same game prefix.
   struct _BoardRecord {
+    uint64_t hash;
     Board::Bits bits;
+    std::shared_ptr<const _BoardRecord> prev;
   };
 
-  std::unordered_map<uint64_t, std::vector<_BoardRecord>> _board_hash;
+  std::shared_ptr<const _BoardRecord> _board_hash;
+  // Bloom filter on the hashes of _board_hash, so that most superko checks
+  // do not walk the list.
+  std::bitset<kSuperkoFilterSize> _board_hash_filter;
 
   std::vector<Coord> _moves;
   float _final_value = 0.0;
   bool _has_final_value = false;
 
+  // simple_tt_scoring() of _board, or kUnknownTTScore. A pass keeps it, so
+  // the pass replies the search expands are scored for free. Atomic since
+  // search threads may score the same (const) state.
+  mutable std::atomic<int> _tt_score{kUnknownTTScore};
+
   static HandicapTable _handi_table;
 
+  int _historyIndex(int i) const {
+    return (_history_head - i + MAX_NUM_AGZ_HISTORY) % MAX_NUM_AGZ_HISTORY;
+  }
+
   bool _check_superko() const;
   void _add_board_hash(const Coord& c);
+
+  int _getTTScore(std::ostream* oo) const {
+    if (oo != nullptr) {
+      // Recompute, for the trace.
+      return simple_tt_scoring(_board, oo);
+    }
+    int score = _tt_score.load(std::memory_order_relaxed);
+    if (score == kUnknownTTScore) {
+      score = simple_tt_scoring(_board);
+      _tt_score.store(score, std::memory_order_relaxed);
+    }
+    return score;
+  }
 };
 
 struct GoReply {
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Measures what MCTS node expansion costs for GoState: copying the parent
+// state and playing one move, plus the heap memory held by the states of a
+// search tree, at a few points of a (random) game. Also measures the
+// Tromp-Taylor scoring the dangerous-pass check runs on every leaf.
+//
+// Usage: bench_go_state [num_nodes_per_tree]
+
+#include <malloc.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "elfgames/go/base/go_state.h"
+
+namespace {
+
+std::atomic<int64_t> g_heap_bytes(0);
+
+Coord randomLegalMove(const GoState& s, std::mt19937* rng) {
+  for (int trial = 0; trial < 1000; ++trial) {
+    Coord c = OFFSETXY((*rng)() % BOARD_SIZE, (*rng)() % BOARD_SIZE);
+    if (s.checkMove(c)) {
+      return c;
+    }
+  }
+  return M_PASS;
+}
+
+// Play random legal moves until the given ply.
+GoState makePosition(int ply, std::mt19937* rng) {
+  GoState s;
+  while (s.getPly() < ply) {
+    Coord c = randomLegalMove(s, rng);
+    if (c == M_PASS || !s.forward(c)) {
+      // Dead end (or superko), start over.
+      s.reset();
+    }
+  }
+  return s;
+}
+
+void bench(int ply, int num_nodes) {
+  std::mt19937 rng(ply);
+  GoState root = makePosition(ply, &rng);
+
+  // Pre-draw the moves so the timing only covers copy + forward.
+  std::vector<Coord> moves;
+  for (int i = 0; i < num_nodes; ++i) {
+    moves.push_back(randomLegalMove(root, &rng));
+  }
+
+  std::vector<std::unique_ptr<GoState>> tree;
+  tree.reserve(num_nodes);
+
+  const int64_t heap_before = g_heap_bytes.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_nodes; ++i) {
+    // Expand from the root or one of the recent nodes, like a shallow tree.
+    const GoState& parent = (i < 8) ? root : *tree[i - 1 - (i % 8)];
+    std::unique_ptr<GoState> child(new GoState(parent));
+    child->forward(moves[i]);
+    tree.push_back(std::move(child));
+  }
+  auto end = std::chrono::steady_clock::now();
+  const int64_t heap_bytes = g_heap_bytes.load() - heap_before;
+
+  const double us_per_node =
+      std::chrono::duration<double, std::micro>(end - start).count() /
+      num_nodes;
+  std::cout << "ply " << ply << ": expansion " << us_per_node
+            << " us/node, memory " << heap_bytes / num_nodes
+            << " bytes/node, " << heap_bytes / 1024.0 / 1024.0 << " MB per "
+            << num_nodes << "-node tree" << std::endl;
+}
+
+// Score leaves the way MCTSActor::remove_pass_if_dangerous() does: each
+// child of the root once, then its pass reply (the same stones).
+void benchScoring(int ply, int num_nodes) {
+  std::mt19937 rng(ply);
+  GoState root = makePosition(ply, &rng);
+
+  std::vector<std::unique_ptr<GoState>> leaves;
+  for (int i = 0; i < num_nodes; ++i) {
+    std::unique_ptr<GoState> child(new GoState(root));
+    child->forward(randomLegalMove(root, &rng));
+    leaves.push_back(std::move(child));
+  }
+
+  float total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_nodes; ++i) {
+    total += leaves[i]->evaluate(7.5);
+    GoState pass_reply(*leaves[i]);
+    pass_reply.forward(M_PASS);
+    total += pass_reply.evaluate(7.5);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const double us_per_leaf =
+      std::chrono::duration<double, std::micro>(end - start).count() /
+      num_nodes;
+  std::cout << "ply " << ply << ": scoring " << us_per_leaf
+            << " us/leaf (checksum " << total << ")" << std::endl;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+  void* p = std::malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  g_heap_bytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p != nullptr) {
+    g_heap_bytes -= malloc_usable_size(p);
+  }
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  ::operator delete(p);
+}
+
+int main(int argc, char** argv) {
+  const int num_nodes = argc > 1 ? std::atoi(argv[1]) : 1600;
+  std::cout << "Board size: " << BOARD_SIZE
+            << ", sizeof(GoState): " << sizeof(GoState) << std::endl;
+  for (int ply : {10, 150, 300}) {
+    bench(ply, num_nodes);
+  }
+  for (int ply : {10, 150, 300}) {
+    benchScoring(ply, num_nodes);
+  }
+  return 0;
+}
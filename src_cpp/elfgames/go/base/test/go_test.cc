@@ -630,6 +630,25 @@ TEST(GoTest, testScoring) {
   EXPECT_EQ(score, 2.5);
 }
 
+TEST(GoTest, testScoringCache) {
+  GoState b;
+  b.forward(str2coord("ba"));
+  b.forward(str2coord("aa"));
+  // The empty region touches both colors.
+  EXPECT_EQ(b.evaluate(0), 0);
+
+  // A copy and a pass keep the score.
+  GoState b2(b);
+  b2.forward(M_PASS);
+  EXPECT_EQ(b2.evaluate(0), 0);
+
+  // Capturing aa leaves only black on the board.
+  GoState b3(b);
+  b3.forward(str2coord("ab"));
+  EXPECT_EQ(b3.evaluate(0), BOARD_SIZE * BOARD_SIZE);
+  EXPECT_EQ(b.evaluate(0), 0);
+}
+
 TEST(GoTest, testReplayPosition) {
   GoState b;
   std::string s;
@@ -664,6 +683,44 @@ TEST(GoTest, testReplayPosition) {
   EXPECT_TRUE(boardEqual(b, b2));
 }
 
+TEST(GoTest, testHistoryAndCopy) {
+  GoState b;
+  // Black on the first row, white on the last one.
+  for (int i = 0; i < 5; ++i) {
+    b.forward(toFlat(i, 0));
+    b.forward(toFlat(i, BOARD_SIZE - 1));
+  }
+  EXPECT_EQ(b.getHistorySize(), MAX_NUM_AGZ_HISTORY);
+  for (int k = 0; k < b.getHistorySize(); ++k) {
+    // k moves ago, the last (10 - k) moves were not played yet.
+    const BoardHistory& h = b.getHistory(k);
+    for (int i = 0; i < 5; ++i) {
+      const int black_ply = 2 * i + 1;
+      const int white_ply = 2 * i + 2;
+      EXPECT_EQ(
+          h.color(toFlat(i, 0)), black_ply <= 10 - k ? S_BLACK : S_EMPTY);
+      EXPECT_EQ(
+          h.color(toFlat(i, BOARD_SIZE - 1)),
+          white_ply <= 10 - k ? S_WHITE : S_EMPTY);
+    }
+  }
+
+  // A copy continues on its own, without touching the source.
+  GoState b2(b);
+  b2.forward(toFlat(5, 0));
+  EXPECT_EQ(b2.getHistory(0).color(toFlat(5, 0)), S_BLACK);
+  EXPECT_EQ(b2.getHistory(1).color(toFlat(4, BOARD_SIZE - 1)), S_WHITE);
+  EXPECT_EQ(b.getHistory(0).color(toFlat(5, 0)), S_EMPTY);
+  EXPECT_EQ(b.getAllMoves().size(), 10u);
+  EXPECT_EQ(b2.getAllMoves().size(), 11u);
+  EXPECT_FALSE(b.terminated());
+  EXPECT_FALSE(b2.terminated());
+
+  b2.reset();
+  EXPECT_EQ(b2.getHistorySize(), 0);
+  EXPECT_EQ(b.getHistorySize(), MAX_NUM_AGZ_HISTORY);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
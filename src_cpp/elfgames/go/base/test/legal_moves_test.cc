@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "elfgames/go/base/board.h"
+#include "elfgames/go/base/go_state.h"
+#include "elfgames/go/sgf/sgf.h"
+
+#ifndef LADDER_SUITE_DIR
+#define LADDER_SUITE_DIR "ladder_suite"
+#endif
+
+namespace {
+
+// Compare the mask with TryPlay2 on every point, and return the number of
+// legal moves.
+int checkLegalMoves(const GoState& s) {
+  MoveMask mask;
+  s.getLegalMoves(&mask);
+
+  int num_legal = 0;
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      Coord c = getCoord(x, y);
+      GroupId4 ids;
+      bool expected = TryPlay2(&s.board(), c, &ids);
+      EXPECT_EQ(MOVE_MASK_HAS(&mask, c) != 0, expected)
+          << "At " << coord2str(c) << ", ply " << s.getPly() << std::endl
+          << s.showBoard();
+      num_legal += expected;
+    }
+  }
+  // Nothing outside of the board.
+  int num_bits = 0;
+  for (uint64_t word : mask.bits) {
+    num_bits += __builtin_popcountll(word);
+  }
+  EXPECT_EQ(num_bits, num_legal);
+  return num_legal;
+}
+
+} // namespace
+
+TEST(LegalMovesTest, emptyBoard) {
+  GoState s;
+  EXPECT_EQ(checkLegalMoves(s), BOARD_SIZE * BOARD_SIZE);
+}
+
+// Random games, which run into suicide points, captures and kos.
+TEST(LegalMovesTest, randomGames) {
+  std::mt19937 rng(1);
+  for (int game = 0; game < 20; ++game) {
+    GoState s;
+    for (int ply = 0; ply < 2 * BOARD_SIZE * BOARD_SIZE; ++ply) {
+      if (checkLegalMoves(s) == 0) {
+        break;
+      }
+      MoveMask mask;
+      s.getLegalMoves(&mask);
+      std::vector<Coord> moves;
+      for (Coord c = 0; c < BOUND_COORD; ++c) {
+        if (MOVE_MASK_HAS(&mask, c)) {
+          moves.push_back(c);
+        }
+      }
+      if (!s.forward(moves[rng() % moves.size()])) {
+        break;
+      }
+    }
+  }
+}
+
+// Every position of the games in ladder_suite/, which are full of captures
+// and ataris.
+TEST(LegalMovesTest, ladderSuite) {
+  std::ifstream list(LADDER_SUITE_DIR "/ladder_list");
+  if (!list.is_open()) {
+    GTEST_SKIP() << "Cannot open " << LADDER_SUITE_DIR;
+  }
+
+  std::set<std::string> files;
+  std::string file;
+  int ply;
+  while (list >> file >> ply) {
+    files.insert(file);
+  }
+
+  int num_games = 0;
+  for (const auto& f : files) {
+    Sgf sgf;
+    ASSERT_TRUE(sgf.load(LADDER_SUITE_DIR "/ladder/" + f)) << f;
+    if (sgf.getBoardSize() != BOARD_SIZE || sgf.getHandicapStones() > 0) {
+      continue;
+    }
+    num_games++;
+
+    GoState s;
+    for (auto iter = sgf.begin(); !iter.done(); ++iter) {
+      checkLegalMoves(s);
+      if (!s.forward(iter.getCurrMove().move)) {
+        break;
+      }
+    }
+  }
+  if (num_games == 0) {
+    GTEST_SKIP() << "No game of size " << BOARD_SIZE << " without handicap";
+  }
+  std::cout << "Checked " << num_games << " games" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
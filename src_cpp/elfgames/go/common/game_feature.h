@@ -158,16 +158,8 @@ class GoFeature {
 
   void registerExtractor(int batchsize, elf::Extractor& e) {
     // Register multiple fields.
-    auto& s = e.addField<float>("s").addExtents(
+    e.addField<float>("s").addExtents(
         batchsize, {batchsize, _num_plane, BOARD_SIZE, BOARD_SIZE});
-    if (options_.use_df_feature) {
-      s.addFunction<BoardFeature>(extractState)
-          .addFunction<GoStateExtOffline>(extractStateExt);
-    } else {
-      s.addFunction<BoardFeature>(extractStateAGZ)
-          .addFunction<GoStateExtOffline>(extractStateExtAGZ);
-    }
-
     e.addField<int64_t>("a").addExtent(batchsize);
     e.addField<int64_t>("rv").addExtent(batchsize);
     e.addField<int64_t>("offline_a")
@@ -181,28 +173,39 @@ class GoFeature {
     e.addField<int64_t>({"black_ver", "white_ver", "selfplay_ver"})
         .addExtent(batchsize);
 
-    e.addClass<GoReply>()
-        .addFunction<int64_t>("a", ReplyAction)
-        .addFunction<float>("pi", ReplyPolicy)
-        .addFunction<float>("V", ReplyValue)
-        .addFunction<int64_t>("rv", ReplyVersion);
-
-    e.addClass<GoStateExtOffline>()
-        .addFunction<int32_t>("move_idx", extractMoveIdx)
-        .addFunction<int32_t>("num_move", extractNumMove)
-        .addFunction<float>("predicted_value", extractPredictedValue)
-        .addFunction<int32_t>("aug_code", extractAugCode)
-        .addFunction<float>("winner", extractWinner)
-        .addFunction<float>("mcts_scores", extractMCTSPi)
-        .addFunction<int64_t>("offline_a", extractOfflineAction)
-        .addFunction<int64_t>("selfplay_ver", extractStateSelfplayVersion);
-
-    e.addClass<ModelPair>()
-        .addFunction<int64_t>("black_ver", extractAIModelBlackVersion)
-        .addFunction<int64_t>("white_ver", extractAIModelWhiteVersion);
-
-    e.addClass<MsgVersion>().addFunction<int64_t>(
-        "selfplay_ver", extractSelfplayVersion);
+    // All the classes are typed, so that a batch is filled with direct
+    // calls into its slots.
+    auto& bf = e.addTypedClass<BoardFeature>();
+    auto& ext = e.addTypedClass<GoStateExtOffline>();
+    if (options_.use_df_feature) {
+      bf.addFunction<float, extractState>("s");
+      ext.addFunction<float, extractStateExt>("s");
+    } else {
+      bf.addFunction<float, extractStateAGZ>("s");
+      ext.addFunction<float, extractStateExtAGZ>("s");
+    }
+
+    e.addTypedClass<GoReply>()
+        .addFunction<int64_t, ReplyAction>("a")
+        .addFunction<float, ReplyPolicy>("pi")
+        .addFunction<float, ReplyValue>("V")
+        .addFunction<int64_t, ReplyVersion>("rv");
+
+    ext.addFunction<int32_t, extractMoveIdx>("move_idx")
+        .addFunction<int32_t, extractNumMove>("num_move")
+        .addFunction<float, extractPredictedValue>("predicted_value")
+        .addFunction<int32_t, extractAugCode>("aug_code")
+        .addFunction<float, extractWinner>("winner")
+        .addFunction<float, extractMCTSPi>("mcts_scores")
+        .addFunction<int64_t, extractOfflineAction>("offline_a")
+        .addFunction<int64_t, extractStateSelfplayVersion>("selfplay_ver");
+
+    e.addTypedClass<ModelPair>()
+        .addFunction<int64_t, extractAIModelBlackVersion>("black_ver")
+        .addFunction<int64_t, extractAIModelWhiteVersion>("white_ver");
+
+    e.addTypedClass<MsgVersion>()
+        .addFunction<int64_t, extractSelfplayVersion>("selfplay_ver");
   }
 
   std::map<std::string, int> getParams() const {
@@ -69,12 +69,24 @@ MCTSGoAI* GoGameSelfPlay::init_ai(
         mcts_rollout_per_thread_override);
     opt.num_rollouts_per_thread = mcts_rollout_per_thread_override;
   }
+  // How the search is scheduled is up to this host, whatever the request
+  // says (e.g. the batched driver on a CPU-only client).
+  const auto& local_opt = _context_options.mcts_options;
+  if (local_opt.use_batched_driver && !opt.use_batched_driver) {
+    logger_->info(
+        "Batched MCTS driver with {} workers",
+        local_opt.batched_driver_workers);
+    opt.use_batched_driver = true;
+    opt.batched_driver_workers = local_opt.batched_driver_workers;
+  }
   if (opt.verbose) {
     opt.log_prefix = "ts-game" + std::to_string(_game_idx) + "-mcts";
     logger_->warn("Log prefix {}", opt.log_prefix);
   }
 
-  return new MCTSGoAI(opt, [&](int) { return new MCTSActor(client_, params); });
+  return new MCTSGoAI(opt, [&](int) {
+    return new MCTSActor(client_, params, eval_cache_);
+  });
 }
 
 Coord GoGameSelfPlay::mcts_make_diverse_move(MCTSGoAI* mcts_go_ai, Coord c) {
@@ -417,6 +429,12 @@ void GoGameSelfPlay::act() {
     return;
   }
 
+  // The other side moves next (a human or the other AI): keep searching
+  // until it does. finish_game() stops it with the tree.
+  if ((_human_player != nullptr || _ai2 != nullptr) && !s.terminated()) {
+    curr_ai->startPondering(s);
+  }
+
   if (s.terminated()) {
     auto reason = s.isTwoPass()
         ? FR_TWO_PASSES
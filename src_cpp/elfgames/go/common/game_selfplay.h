@@ -55,6 +55,12 @@ class GoGameSelfPlay : public GoGameBase {
     return _state_ext.getLastGameFinalValue();
   }
 
+  // Evaluation cache shared by the MCTS actors of all games. Must be set
+  // before the game starts.
+  void setEvalCache(EvalCache* eval_cache) {
+    eval_cache_ = eval_cache;
+  }
+
  private:
   void setAsync();
   void restart();
@@ -73,6 +79,7 @@ class GoGameSelfPlay : public GoGameBase {
  private:
   ThreadedDispatcher* dispatcher_ = nullptr;
   GameNotifierBase* notifier_ = nullptr;
+  EvalCache* eval_cache_ = nullptr;
   GoStateExt _state_ext;
 
   Sgf _preload_sgf;
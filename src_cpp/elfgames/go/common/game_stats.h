@@ -43,6 +43,17 @@ class GameStats {
     _win_rate_stats.feed(final_value);
   }
 
+  void feedTreeMemory(
+      int64_t tree_nodes,
+      int64_t tree_bytes,
+      int64_t total_nodes,
+      int64_t total_bytes,
+      int64_t num_pruned_nodes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tree_stats.feed(
+        tree_nodes, tree_bytes, total_nodes, total_bytes, num_pruned_nodes);
+  }
+
   void feedSgf(const std::string& sgf) {
     std::lock_guard<std::mutex> lock(_mutex);
     _sgfs.push_back(sgf);
@@ -54,6 +65,11 @@ class GameStats {
     return _win_rate_stats;
   }
 
+  SearchTreeStats getSearchTreeStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tree_stats;
+  }
+
   std::vector<std::string> getPlayedGames() {
     std::lock_guard<std::mutex> lock(_mutex);
     return _sgfs;
@@ -63,6 +79,7 @@ class GameStats {
   std::mutex _mutex;
   Ranking _move_ranking;
   WinRateStats _win_rate_stats;
+  SearchTreeStats _tree_stats;
   std::vector<std::string> _sgfs;
   std::shared_ptr<spdlog::logger> _logger;
 };
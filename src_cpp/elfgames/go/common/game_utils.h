@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <random>
 #include "elf/legacy/pybind_helper.h"
@@ -105,3 +107,35 @@ struct WinRateStats {
 
   REGISTER_PYBIND_FIELDS(black_wins, white_wins, sum_reward, total_games);
 };
+
+// Sizes of the MCTS trees, as reported after each move.
+struct SearchTreeStats {
+  // Largest tree seen.
+  int64_t max_tree_nodes = 0;
+  int64_t max_tree_bytes = 0;
+  // All the trees of the process, after the last move.
+  int64_t total_nodes = 0;
+  int64_t total_bytes = 0;
+  // Nodes pruned to stay within the node budgets.
+  int64_t num_pruned_nodes = 0;
+
+  void feed(
+      int64_t tree_nodes,
+      int64_t tree_bytes,
+      int64_t all_nodes,
+      int64_t all_bytes,
+      int64_t pruned) {
+    max_tree_nodes = std::max(max_tree_nodes, tree_nodes);
+    max_tree_bytes = std::max(max_tree_bytes, tree_bytes);
+    total_nodes = all_nodes;
+    total_bytes = all_bytes;
+    num_pruned_nodes += pruned;
+  }
+
+  REGISTER_PYBIND_FIELDS(
+      max_tree_nodes,
+      max_tree_bytes,
+      total_nodes,
+      total_bytes,
+      num_pruned_nodes);
+};
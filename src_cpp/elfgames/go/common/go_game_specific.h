@@ -104,6 +104,9 @@ struct GameOptions {
   // Whether we use async mode for selfplay.
   bool selfplay_async = false;
 
+  // Size of the network evaluation cache shared by all games (0 = no cache).
+  int eval_cache_size = 0;
+
   // When playing with human (or other programs), if human pass, we also pass.
   bool following_pass = false;
 
@@ -142,6 +145,8 @@ struct GameOptions {
        << ", update #games: " << selfplay_update_num
        << ", async: " << elf_utils::print_bool(selfplay_async) << std::endl;
     ss << "UseMCTS: " << elf_utils::print_bool(use_mcts) << std::endl;
+    if (eval_cache_size > 0)
+      ss << "Eval cache size: " << eval_cache_size << std::endl;
     ss << "Data Aug: " << data_aug << std::endl;
     ss << "Start_ratio_pre_moves: " << start_ratio_pre_moves << std::endl;
     ss << "ratio_pre_moves: " << ratio_pre_moves << std::endl;
@@ -264,5 +269,6 @@ struct GameOptions {
       white_mcts_rollout_per_thread,
       eval_thres,
       keep_prev_selfplay,
-      expected_num_clients);
+      expected_num_clients,
+      eval_cache_size);
 };
@@ -24,6 +24,7 @@ void registerPy(pybind11::module& m) {
       .def("ctx", &GameContext::ctx, ref)
       .def("getParams", &GameContext::getParams)
       .def("getGame", &GameContext::getGame, ref)
+      .def("getEvalCacheStats", &GameContext::getEvalCacheStats)
       .def("setRequest", &GameContext::setRequest);
 
   // Also register other objects.
@@ -50,13 +50,15 @@ class GameContext {
     // Register all functions.
     goFeature_.registerExtractor(batchsize, context_->getExtractor());
 
+    if (options.eval_cache_size > 0) {
+      evalCache_.reset(new EvalCache(options.eval_cache_size));
+    }
+
     for (int i = 0; i < numGames; ++i) {
-      games_.emplace_back(new GoGameSelfPlay(
-          i,
-          context_->getClient(),
-          contextOptions,
-          options,
-          dispatcher_.get()));
+      auto* game = new GoGameSelfPlay(
+          i, context_->getClient(), contextOptions, options, dispatcher_.get());
+      game->setEvalCache(evalCache_.get());
+      games_.emplace_back(game);
     }
 
     context_->setStartCallback(numGames, [this](int i, elf::GameClient*) {
@@ -99,6 +101,14 @@ class GameContext {
     return context_.get();
   }
 
+  // Per model version counters of the evaluation cache (empty if disabled).
+  std::vector<elf::ai::tree_search::EvalCacheStats> getEvalCacheStats() const {
+    if (evalCache_ == nullptr) {
+      return {};
+    }
+    return evalCache_->getStats();
+  }
+
   ~GameContext() {
     context_.reset(nullptr);
   }
@@ -110,6 +120,8 @@ class GameContext {
 
  private:
   std::unique_ptr<elf::Context> context_;
+  // Used by the games, so it is destroyed after them.
+  std::unique_ptr<EvalCache> evalCache_;
   std::vector<std::unique_ptr<GoGameBase>> games_;
 
   std::unique_ptr<ThreadedDispatcher> dispatcher_;
@@ -41,12 +41,34 @@ struct StateTrait<GoState, Coord> {
     return s1.getHashCode() == s2.getHashCode();
   }
 
+  // getHashCode() only covers the stones. Mix in what else changes the
+  // evaluation: the ply (side to move, pass rules), a pending simple ko and
+  // a previous pass. Terminal states are cheap to evaluate and may depend on
+  // the path (superko), so they are not shared.
+  static uint64_t hash(const GoState& s) {
+    if (s.terminated()) {
+      return 0;
+    }
+    uint64_t h = s.getHashCode();
+    h ^= (uint64_t(s.getPly()) + 1) * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t(getSimpleKoLocation(&s.board(), nullptr)) + 1) *
+        0xc2b2ae3d27d4eb4fULL;
+    if (s.lastMove() == M_PASS) {
+      h = ~h;
+    }
+    return h == 0 ? 1 : h;
+  }
+
   static bool moves_since(
       const GoState& s,
       size_t* next_move_number,
       std::vector<Coord>* moves) {
     return s.moves_since(next_move_number, moves);
   }
+
+  static size_t bytes(const GoState& s) {
+    return s.getMemoryBytes();
+  }
 };
 
 } // namespace tree_search
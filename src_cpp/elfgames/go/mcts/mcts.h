@@ -8,10 +8,15 @@
 
 #pragma once
 
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 #include "elf/ai/tree_search/mcts.h"
+#include "elf/ai/tree_search/tree_search_eval_cache.h"
 #include "elf/logging/IndexedLoggerFactory.h"
+#include "elf/utils/rng.h"
 #include "elfgames/go/mcts/ai.h"
 
 struct MCTSActorParams {
@@ -36,6 +41,8 @@ struct MCTSActorParams {
   }
 };
 
+using EvalCache = elf::ai::tree_search::EvalCacheT<Coord>;
+
 class MCTSActor {
  public:
   using Action = Coord;
@@ -44,8 +51,13 @@ class MCTSActor {
 
   enum PreEvalResult { EVAL_DONE, EVAL_NEED_NN };
 
-  MCTSActor(elf::GameClient* client, const MCTSActorParams& params)
+  // eval_cache, if not nullptr, is shared with the actors of other games.
+  MCTSActor(
+      elf::GameClient* client,
+      const MCTSActorParams& params,
+      EvalCache* eval_cache = nullptr)
       : params_(params),
+        evalCache_(eval_cache),
         rng_(params.seed),
         logger_(elf::logging::getIndexedLogger(
             "elfgames::go::mcts::MCTSActor-",
@@ -65,7 +77,7 @@ class MCTSActor {
     params_.required_version = ver;
   }
 
-  std::mt19937* rng() {
+  elf_utils::CounterRng* rng() {
     return &rng_;
   }
 
@@ -73,51 +85,31 @@ class MCTSActor {
   void evaluate(
       const std::vector<const GoState*>& states,
       std::vector<NodeResponse>* p_resps) {
-    if (states.empty())
-      return;
-
-    if (oo_ != nullptr)
-      *oo_ << "Evaluating batch state. #states: " << states.size() << std::endl;
-
-    auto& resps = *p_resps;
-
-    resps.resize(states.size());
-    std::vector<BoardFeature> sel_bfs;
-    std::vector<size_t> sel_indices;
-
-    for (size_t i = 0; i < states.size(); i++) {
-      assert(states[i] != nullptr);
-      PreEvalResult res = pre_evaluate(*states[i], &resps[i]);
-      if (res == EVAL_NEED_NN) {
-        sel_bfs.push_back(get_extractor(*states[i]));
-        sel_indices.push_back(i);
-      }
-    }
-
-    if (sel_bfs.empty())
+    Batch* batch = prepare_batch(states, p_resps);
+    if (batch == nullptr)
       return;
 
-    std::vector<GoReply> replies;
-    for (size_t i = 0; i < sel_bfs.size(); ++i) {
-      replies.emplace_back(sel_bfs[i]);
-    }
-
-    // Get all pointers.
-    std::vector<GoReply*> p_replies;
-    std::vector<const BoardFeature*> p_bfs;
-
-    for (size_t i = 0; i < sel_bfs.size(); ++i) {
-      p_bfs.push_back(&sel_bfs[i]);
-      p_replies.push_back(&replies[i]);
-    }
+    finish_batch(ai_->act_batch(batch->p_bfs, batch->p_replies), *batch);
+    release_batch(batch);
+  }
 
-    if (!ai_->act_batch(p_bfs, p_replies)) {
-      logger_->info("act unsuccessful! ");
-    } else {
-      for (size_t i = 0; i < sel_indices.size(); i++) {
-        post_nn_result(replies[i], &resps[sel_indices[i]]);
-      }
-    }
+  // Same as evaluate(), but return once the batch is sent to the network.
+  // p_resps is filled when the returned future is waited on, in the waiting
+  // thread. states and p_resps must stay alive until then.
+  std::future<void> evaluate_async(
+      const std::vector<const GoState*>& states,
+      std::vector<NodeResponse>* p_resps) {
+    Batch* batch = prepare_batch(states, p_resps);
+    if (batch == nullptr)
+      return std::async(std::launch::deferred, []() {});
+
+    std::future<bool> sent =
+        ai_->act_batch_async(batch->p_bfs, batch->p_replies);
+    return std::async(
+        std::launch::deferred, [this, batch, sent = std::move(sent)]() mutable {
+          finish_batch(sent.get(), *batch);
+          release_batch(batch);
+        });
   }
 
   void evaluate(const GoState& s, NodeResponse* resp) {
@@ -127,8 +119,12 @@ class MCTSActor {
     // if terminated(), get results, res = done
     // else res = EVAL_NEED_NN
     PreEvalResult res = pre_evaluate(s, resp);
+    uint64_t key = 0;
+    NodeResponse raw;
 
-    if (res == EVAL_NEED_NN) {
+    if (res == EVAL_NEED_NN && lookup_cache(s, &raw, &key)) {
+      post_cached_result(s, raw, resp);
+    } else if (res == EVAL_NEED_NN) {
       BoardFeature bf = get_extractor(s);
       // GoReply struct initialization
       // members containing:
@@ -143,6 +139,7 @@ class MCTSActor {
         // call pi2response()
         // action will be inv-transformed
         post_nn_result(reply, resp);
+        insert_cache(key, reply);
       }
     }
 
@@ -165,13 +162,121 @@ class MCTSActor {
 
  protected:
   MCTSActorParams params_;
+  EvalCache* evalCache_;
   std::unique_ptr<AI> ai_;
   std::ostream* oo_ = nullptr;
-  std::mt19937 rng_;
+  elf_utils::CounterRng rng_;
 
  private:
   std::shared_ptr<spdlog::logger> logger_;
 
+  // States of a batch that go to the network. Batches are recycled, so
+  // that the features and replies of the next one are at the same addresses
+  // and the AI reuses its bindings.
+  struct Batch {
+    std::vector<NodeResponse>* resps;
+    std::vector<BoardFeature> bfs;
+    std::vector<GoReply> replies;
+    std::vector<size_t> indices;
+    std::vector<uint64_t> keys;
+
+    std::vector<const BoardFeature*> p_bfs;
+    std::vector<GoReply*> p_replies;
+
+    void clear() {
+      replies.clear();
+      bfs.clear();
+      indices.clear();
+      keys.clear();
+      p_bfs.clear();
+      p_replies.clear();
+    }
+  };
+
+  std::mutex batchMutex_;
+  std::vector<std::unique_ptr<Batch>> batches_;
+  std::vector<Batch*> freeBatches_;
+
+  Batch* acquire_batch() {
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    if (freeBatches_.empty()) {
+      batches_.emplace_back(new Batch());
+      return batches_.back().get();
+    }
+    Batch* batch = freeBatches_.back();
+    freeBatches_.pop_back();
+    return batch;
+  }
+
+  void release_batch(Batch* batch) {
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    freeBatches_.push_back(batch);
+  }
+
+  // Fill in the responses that need no network, and return the rest
+  // (nullptr if there is none), to release once done.
+  Batch* prepare_batch(
+      const std::vector<const GoState*>& states,
+      std::vector<NodeResponse>* p_resps) {
+    if (states.empty())
+      return nullptr;
+
+    if (oo_ != nullptr)
+      *oo_ << "Evaluating batch state. #states: " << states.size() << std::endl;
+
+    auto& resps = *p_resps;
+    resps.resize(states.size());
+
+    Batch* batch = acquire_batch();
+    batch->clear();
+    batch->resps = p_resps;
+
+    NodeResponse raw;
+    for (size_t i = 0; i < states.size(); i++) {
+      assert(states[i] != nullptr);
+      PreEvalResult res = pre_evaluate(*states[i], &resps[i]);
+      uint64_t key = 0;
+      if (res != EVAL_NEED_NN) {
+        continue;
+      }
+      if (lookup_cache(*states[i], &raw, &key)) {
+        post_cached_result(*states[i], raw, &resps[i]);
+      } else {
+        batch->bfs.push_back(get_extractor(*states[i]));
+        batch->indices.push_back(i);
+        batch->keys.push_back(key);
+      }
+    }
+
+    if (batch->bfs.empty()) {
+      release_batch(batch);
+      return nullptr;
+    }
+
+    for (size_t i = 0; i < batch->bfs.size(); ++i) {
+      batch->replies.emplace_back(batch->bfs[i]);
+    }
+
+    // Get all pointers.
+    for (size_t i = 0; i < batch->bfs.size(); ++i) {
+      batch->p_bfs.push_back(&batch->bfs[i]);
+      batch->p_replies.push_back(&batch->replies[i]);
+    }
+    return batch;
+  }
+
+  void finish_batch(bool success, const Batch& batch) {
+    if (!success) {
+      logger_->info("act unsuccessful! ");
+      return;
+    }
+    auto& resps = *batch.resps;
+    for (size_t i = 0; i < batch.indices.size(); i++) {
+      post_nn_result(batch.replies[i], &resps[batch.indices[i]]);
+      insert_cache(batch.keys[i], batch.replies[i]);
+    }
+  }
+
   BoardFeature get_extractor(const GoState& s) {
     // RandomShuffle: static
     // All extractor will go through a
@@ -182,6 +287,39 @@ class MCTSActor {
       return BoardFeature(s);
   }
 
+  // Key of s in the evaluation cache, or 0 if it should not be cached.
+  uint64_t cache_key(const GoState& s) const {
+    if (evalCache_ == nullptr) {
+      return 0;
+    }
+    return elf::ai::tree_search::StateTrait<GoState, Coord>::hash(s);
+  }
+
+  // The cache is shared by actors with different komi and pass settings, so
+  // it holds the raw network output: value, and the policy of every action
+  // mapped back to board coordinates. post_cached_result() applies this
+  // actor's settings to it.
+  bool lookup_cache(const GoState& s, NodeResponse* raw, uint64_t* key) {
+    *key = cache_key(s);
+    if (*key == 0) {
+      return false;
+    }
+    return evalCache_->lookup(*key, params_.required_version, raw);
+  }
+
+  void insert_cache(uint64_t key, const GoReply& reply) {
+    if (key == 0) {
+      return;
+    }
+    NodeResponse raw;
+    raw.value = reply.value;
+    raw.pi.reserve(reply.pi.size());
+    for (size_t i = 0; i < reply.pi.size(); ++i) {
+      raw.pi.emplace_back(reply.bf.action2Coord(i), reply.pi[i]);
+    }
+    evalCache_->insert(key, reply.version, raw);
+  }
+
   PreEvalResult pre_evaluate(const GoState& s, NodeResponse* resp) {
     resp->q_flip = s.nextPlayer() == S_WHITE;
 
@@ -221,12 +359,40 @@ class MCTSActor {
     resp->value = reply.value;
 
     const GoState& s = reply.bf.state();
+    pi2response(
+        s,
+        reply.pi.size(),
+        [&reply](size_t i) {
+          // Inv random transform will be applied
+          return std::make_pair(reply.bf.action2Coord(i), reply.pi[i]);
+        },
+        is_pass_enabled(s),
+        &resp->pi,
+        oo_);
+  }
+
+  void post_cached_result(
+      const GoState& s,
+      const NodeResponse& raw,
+      NodeResponse* resp) {
+    if (oo_ != nullptr)
+      *oo_ << "Got information from evaluation cache" << std::endl;
+    resp->value = raw.value;
+    pi2response(
+        s,
+        raw.pi.size(),
+        [&raw](size_t i) { return raw.pi[i]; },
+        is_pass_enabled(s),
+        &resp->pi,
+        oo_);
+  }
 
+  bool is_pass_enabled(const GoState& s) {
     bool pass_enabled = s.getPly() >= params_.ply_pass_enabled;
     if (params_.remove_pass_if_dangerous) {
       remove_pass_if_dangerous(s, &pass_enabled);
     }
-    pi2response(reply.bf, reply.pi, pass_enabled, &resp->pi, oo_);
+    return pass_enabled;
   }
 
   void remove_pass_if_dangerous(const GoState& s, bool* pass_enabled) {
@@ -241,28 +407,18 @@ class MCTSActor {
     }
   }
 
-  static void normalize(std::vector<std::pair<Coord, float>>* output_pi) {
-    assert(output_pi != nullptr);
-    float total_prob = 1e-10;
-    for (const auto& p : *output_pi) {
-      total_prob += p.second;
-    }
-
-    for (auto& p : *output_pi) {
-      p.second /= total_prob;
-    }
-  }
-
+  // move_prob(i) returns the coordinate and the probability of the i-th of
+  // the num_moves moves.
+  template <typename MoveProb>
   static void pi2response(
-      const BoardFeature& bf,
-      const std::vector<float>& pi,
+      const GoState& s,
+      size_t num_moves,
+      MoveProb move_prob,
       bool pass_enabled,
       std::vector<std::pair<Coord, float>>* output_pi,
       std::ostream* oo = nullptr) {
-    const GoState& s = bf.state();
-
     if (oo != nullptr) {
-      *oo << "In get_last_pi, #move returned " << pi.size() << std::endl;
+      *oo << "In get_last_pi, #move returned " << num_moves << std::endl;
       *oo << s.showBoard() << std::endl << std::endl;
     }
 
@@ -275,58 +431,48 @@ class MCTSActor {
       return;
     }
 
-    for (size_t i = 0; i < pi.size(); ++i) {
-      // Inv random transform will be applied
-      Coord m = bf.action2Coord(i);
-      if (oo != nullptr)
-        *oo << "  Action " << i << " to Coord "
-            << elf::ai::tree_search::ActionTrait<Coord>::to_string(m)
-            << std::endl;
-      output_pi->push_back(std::make_pair(m, pi[i]));
-    }
-    // sorting..
-    using data_type = std::pair<Coord, float>;
+    // Legality of all moves at once, instead of one TryPlay2 per move.
+    MoveMask legal;
+    s.getLegalMoves(&legal);
 
-    if (oo != nullptr)
-      *oo << "Before sorting" << std::endl;
-    std::sort(
-        output_pi->begin(),
-        output_pi->end(),
-        [](const data_type& d1, const data_type& d2) {
-          return d1.second > d2.second;
-        });
-    if (oo != nullptr)
-      *oo << "After sorting" << std::endl;
-
-    std::vector<data_type> tmp;
-    int i = 0;
-    while (true) {
-      if (i >= (int)output_pi->size())
-        break;
-      const data_type& v = output_pi->at(i);
-      // Check whether this move is right.
-      bool valid = (v.first == M_PASS && pass_enabled) ||
-          (v.first != M_PASS && s.checkMove(v.first));
+    // Mask and accumulate in one pass; only the legal moves get sorted.
+    output_pi->reserve(num_moves);
+    float total_prob = 1e-10;
+    for (size_t i = 0; i < num_moves; ++i) {
+      const std::pair<Coord, float> mp = move_prob(i);
+      const Coord m = mp.first;
+      bool valid = m == M_PASS ? pass_enabled : MOVE_MASK_HAS(&legal, m);
       if (valid) {
-        tmp.push_back(v);
+        output_pi->push_back(mp);
+        total_prob += mp.second;
       }
 
       if (oo != nullptr) {
-        *oo << "Predict [" << i << "][" << coord2str(v.first) << "]["
-            << coord2str2(v.first) << "][" << v.first << "] " << v.second;
+        *oo << "Predict [" << i << "][" << coord2str(m) << "]["
+            << coord2str2(m) << "][" << m << "] " << mp.second;
         if (valid)
           *oo << " added" << std::endl;
         else
           *oo << " invalid" << std::endl;
       }
-      i++;
     }
-    if (tmp.empty() && !pass_enabled) {
+
+    if (output_pi->empty() && !pass_enabled) {
       // Add pass if there is no valid move.
-      tmp.push_back(std::make_pair(M_PASS, 1.0));
+      output_pi->push_back(std::make_pair(M_PASS, 1.0));
+      total_prob += 1.0;
+    }
+
+    using data_type = std::pair<Coord, float>;
+    std::sort(
+        output_pi->begin(),
+        output_pi->end(),
+        [](const data_type& d1, const data_type& d2) {
+          return d1.second > d2.second;
+        });
+    for (auto& p : *output_pi) {
+      p.second /= total_prob;
     }
-    *output_pi = tmp;
-    normalize(output_pi);
     if (oo != nullptr)
       *oo << "#Valid move: " << output_pi->size() << std::endl;
   }
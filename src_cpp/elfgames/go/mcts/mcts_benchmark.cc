@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) 2018-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Throughput of TreeSearchT on Go positions, without Python or a network.
+// The actor is synthetic: each batch costs a fixed eval_us (slept, like
+// waiting for an accelerator), and the policy and value are hashes of the
+// position, spread over its legal moves. So the numbers only depend on the
+// search itself: tree walks, expansion, GoState copies and contention.
+//
+// A game is played from the empty board with a fresh tree per move, for each
+// number of threads and rollouts per batch ("auto" is the adaptive batch
+// size, which starts at 8). Reported per configuration:
+// rollouts and tree nodes per second, time spent waiting for leaves other
+// threads evaluate, collisions, and the tree memory at the end of a move.
+// The board size is fixed at build time: bench_mcts is 19x19, bench_mcts9
+// 9x9.
+//
+// Usage: bench_mcts [num_moves] [rollouts_per_move] [eval_us]
+// num_moves and rollouts_per_move must be positive, eval_us non-negative.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "elf/ai/tree_search/tree_search.h"
+#include "elfgames/go/base/go_state.h"
+#include "elfgames/go/mcts/ai.h"
+
+namespace {
+
+using elf::ai::tree_search::MCTSResultT;
+using elf::ai::tree_search::NodeResponseT;
+using elf::ai::tree_search::TSOptions;
+
+uint64_t mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+class SyntheticActor {
+ public:
+  using State = GoState;
+  using Action = Coord;
+  using NodeResponse = NodeResponseT<Coord>;
+
+  explicit SyntheticActor(int eval_us) : evalUs_(eval_us) {}
+
+  std::mt19937* rng() {
+    return &rng_;
+  }
+
+  std::string info() const {
+    return "";
+  }
+
+  void evaluate(
+      const std::vector<const GoState*>& states,
+      std::vector<NodeResponse>* resps) {
+    if (evalUs_ > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(evalUs_));
+    }
+    resps->resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+      evaluate(*states[i], &(*resps)[i]);
+    }
+  }
+
+  void evaluate(const GoState& s, NodeResponse* resp) {
+    const uint64_t h = mix(s.getHashCode() + s.getPly());
+    resp->q_flip = s.nextPlayer() == S_WHITE;
+    resp->pi.clear();
+
+    if (s.terminated()) {
+      resp->value = s.evaluate(7.5) > 0 ? 1.0 : -1.0;
+      return;
+    }
+    resp->value = (h >> 40) * (2.0f / (1 << 24)) - 1.0f;
+
+    MoveMask legal;
+    s.getLegalMoves(&legal);
+    float total = 0;
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      for (int x = 0; x < BOARD_SIZE; ++x) {
+        const Coord c = OFFSETXY(x, y);
+        if (MOVE_MASK_HAS(&legal, c)) {
+          const float p = 1 + (mix(h + c) & 15);
+          resp->pi.emplace_back(c, p);
+          total += p;
+        }
+      }
+    }
+    resp->pi.emplace_back(M_PASS, 1.0f);
+    total += 1.0f;
+    for (auto& p : resp->pi) {
+      p.second /= total;
+    }
+  }
+
+  bool forward(GoState& s, Coord a) {
+    return s.forward(a);
+  }
+
+ private:
+  int evalUs_;
+  std::mt19937 rng_;
+};
+
+using Search =
+    elf::ai::tree_search::TreeSearchT<GoState, Coord, SyntheticActor>;
+
+struct Totals {
+  int64_t rollouts = 0;
+  int64_t nodes = 0;
+  int64_t waits = 0;
+  double wait_ms = 0;
+  int64_t collisions = 0;
+  int64_t bytes = 0;
+  double time_ms = 0;
+  int moves = 0;
+};
+
+void bench(
+    int num_threads,
+    int rollouts_per_batch,
+    int num_moves,
+    int rollouts_per_move,
+    int eval_us) {
+  TSOptions options;
+  options.num_threads = num_threads;
+  options.num_rollouts_per_thread =
+      std::max(rollouts_per_move / num_threads, 1);
+  // 0 means adaptive.
+  options.num_rollouts_per_batch =
+      rollouts_per_batch > 0 ? rollouts_per_batch : 8;
+  options.adaptive_batch = rollouts_per_batch == 0;
+  options.virtual_loss = 1;
+
+  Search search(options, [&](int) { return new SyntheticActor(eval_us); });
+
+  Totals t;
+  GoState s;
+  for (; t.moves < num_moves && !s.terminated(); ++t.moves) {
+    MCTSResultT<Coord> result = search.run(s);
+    t.rollouts += result.stats.num_rollouts;
+    t.nodes += result.memory.tree_nodes;
+    t.waits += result.stats.num_waits;
+    t.wait_ms += result.stats.wait_time_us / 1000.0;
+    t.collisions += result.stats.num_collisions;
+    t.bytes += result.memory.tree_bytes;
+    t.time_ms += result.search_time_ms;
+
+    s.forward(result.best_action);
+    search.clear();
+  }
+
+  // A run too short for the clock reports no rate rather than inf.
+  const double sec = t.time_ms / 1000;
+  const int n = std::max(t.moves, 1);
+  std::cout << std::setw(7) << num_threads << std::setw(7)
+            << (rollouts_per_batch > 0 ? std::to_string(rollouts_per_batch)
+                                       : "auto")
+            << std::setw(12) << (sec > 0 ? int64_t(t.rollouts / sec) : 0)
+            << std::setw(12) << (sec > 0 ? int64_t(t.nodes / sec) : 0)
+            << std::setw(12)
+            << t.wait_ms / n << std::setw(10) << t.waits / n << std::setw(12)
+            << t.collisions / n << std::setw(12) << t.bytes / n / 1024
+            << std::endl;
+}
+
+// Parses argv[i] as an int of at least min_value, or keeps *value if there
+// is no such argument.
+bool parseArg(int argc, char** argv, int i, int min_value, int* value) {
+  if (argc <= i) {
+    return true;
+  }
+  char* end = nullptr;
+  errno = 0;
+  const long v = std::strtol(argv[i], &end, 10);
+  if (end == argv[i] || *end != '\0' || errno != 0 || v < min_value ||
+      v > INT_MAX) {
+    return false;
+  }
+  *value = static_cast<int>(v);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int num_moves = 10;
+  int rollouts_per_move = 1600;
+  int eval_us = 100;
+  if (argc > 4 || !parseArg(argc, argv, 1, 1, &num_moves) ||
+      !parseArg(argc, argv, 2, 1, &rollouts_per_move) ||
+      !parseArg(argc, argv, 3, 0, &eval_us)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [num_moves] [rollouts_per_move] [eval_us]" << std::endl
+              << "  num_moves, rollouts_per_move > 0 (default 10, 1600)"
+              << std::endl
+              << "  eval_us >= 0 (default 100)" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Board size: " << BOARD_SIZE << ", " << num_moves
+            << " moves, " << rollouts_per_move << " rollouts/move, "
+            << eval_us << " us/batch" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "threads  batch  rollouts/s     nodes/s  wait_ms/mv"
+            << "  waits/mv   colls/mv    KB/move" << std::endl;
+  for (int num_threads : {1, 2, 4, 8}) {
+    for (int batch : {1, 4, 8, 16, 0}) {
+      bench(num_threads, batch, num_moves, rollouts_per_move, eval_us);
+    }
+  }
+  return 0;
+}
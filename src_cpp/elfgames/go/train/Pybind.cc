@@ -24,6 +24,7 @@ void registerPy(pybind11::module& m) {
       .def("ctx", &GameContext::ctx, ref)
       .def("getParams", &GameContext::getParams)
       .def("getGame", &GameContext::getGame, ref)
+      .def("getEvalCacheStats", &GameContext::getEvalCacheStats)
       .def("getClient", &GameContext::getClient, ref)
       .def("getServer", &GameContext::getServer, ref);
 
@@ -47,9 +48,11 @@ void registerPy(pybind11::module& m) {
       .def("info", &GameOptions::info);
 
   PYCLASS_WITH_FIELDS(m, WinRateStats).def(py::init<>());
+  PYCLASS_WITH_FIELDS(m, SearchTreeStats).def(py::init<>());
 
   py::class_<GameStats>(m, "GameStats")
       .def("getWinRateStats", &GameStats::getWinRateStats)
+      .def("getSearchTreeStats", &GameStats::getSearchTreeStats)
       //.def("AllGamesFinished", &GameStats::AllGamesFinished)
       //.def("restartAllGames", &GameStats::restartAllGames)
       .def("getPlayedGames", &GameStats::getPlayedGames);
@@ -250,6 +250,12 @@ class GameNotifier : public GameNotifierBase {
     auto move_rank =
         result.getRank(c, elf::ai::tree_search::MCTSResultT<Coord>::PRIOR);
     game_stats_.feedMoveRanking(move_rank.first);
+    game_stats_.feedTreeMemory(
+        result.memory.tree_nodes,
+        result.memory.tree_bytes,
+        result.memory.total_nodes,
+        result.memory.total_bytes,
+        result.memory.num_pruned_nodes);
   }
 
   GameStats& getGameStats() {
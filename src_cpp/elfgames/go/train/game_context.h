@@ -49,6 +49,10 @@ class GameContext {
     elf::GameClient* gc = context_->getClient();
     ThreadedDispatcher* dispatcher = nullptr;
 
+    if (options.eval_cache_size > 0) {
+      evalCache_.reset(new EvalCache(options.eval_cache_size));
+    }
+
     if (options.mode == "train" || options.mode == "offline_train") {
       server_.reset(new Server(contextOptions, options, gc));
 
@@ -60,13 +64,15 @@ class GameContext {
       client_.reset(new Client(contextOptions, options, gc));
       dispatcher = client_->getDispatcher();
       for (int i = 0; i < numGames; ++i) {
-        games_.emplace_back(new GoGameSelfPlay(
+        auto* game = new GoGameSelfPlay(
             i,
             gc,
             contextOptions,
             options,
             dispatcher,
-            client_->getNotifier()));
+            client_->getNotifier());
+        game->setEvalCache(evalCache_.get());
+        games_.emplace_back(game);
       }
     }
 
@@ -108,10 +114,19 @@ class GameContext {
     return client_.get();
   }
 
+  // Per model version counters of the evaluation cache (empty if disabled).
+  std::vector<elf::ai::tree_search::EvalCacheStats> getEvalCacheStats() const {
+    if (evalCache_ == nullptr) {
+      return {};
+    }
+    return evalCache_->getStats();
+  }
+
   ~GameContext() {
     server_.reset(nullptr);
     client_.reset(nullptr);
     games_.clear();
+    evalCache_.reset(nullptr);
     context_.reset(nullptr);
   }
 
@@ -126,6 +141,7 @@ class GameContext {
 
   std::unique_ptr<Server> server_;
   std::unique_ptr<Client> client_;
+  std::unique_ptr<EvalCache> evalCache_;
 
   GoFeature goFeature_;
 
@@ -31,6 +31,19 @@ class ContextArgs(object):
             'mcts_rollout_per_batch',
             'Batch size for mcts rollout',
             1)
+        spec.addBoolOption(
+            'mcts_adaptive_batch',
+            'adapt the mcts rollout batch size to the collisions and '
+            'the evaluation latency',
+            False)
+        spec.addIntOption(
+            'mcts_min_rollout_per_batch',
+            'smallest adaptive batch size for mcts rollout',
+            1)
+        spec.addIntOption(
+            'mcts_max_rollout_per_batch',
+            'largest adaptive batch size for mcts rollout',
+            64)
         spec.addIntOption(
             'mcts_rollout_per_thread',
             'number of rollotus per MCTS thread',
@@ -47,6 +60,60 @@ class ContextArgs(object):
             'mcts_persistent_tree',
             'use persistent tree in MCTS',
             False)
+        spec.addIntOption(
+            'mcts_max_tree_nodes',
+            'node budget of each MCTS tree (0 = unlimited)',
+            0)
+        spec.addIntOption(
+            'mcts_max_total_tree_nodes',
+            'node budget of all MCTS trees of the process (0 = unlimited)',
+            0)
+        spec.addBoolOption(
+            'mcts_ponder',
+            'keep searching while the opponent thinks (needs '
+            '--mcts_persistent_tree)',
+            False)
+        spec.addIntOption(
+            'mcts_ponder_max_tree_nodes',
+            'stop pondering at this many tree nodes (0 = node budgets only)',
+            0)
+        spec.addFloatOption(
+            'mcts_ponder_cpu_share',
+            'fraction of the time the MCTS threads spend pondering',
+            1.0)
+        spec.addBoolOption(
+            'mcts_shared_pool',
+            'run MCTS rollouts of all games on one shared thread pool',
+            False)
+        spec.addIntOption(
+            'mcts_shared_pool_threads',
+            'number of threads in the shared MCTS pool '
+            '(0 = #cores, but at least batchsize)',
+            0)
+        spec.addBoolOption(
+            'mcts_batched_driver',
+            'step the MCTS of all games in lockstep on a few worker threads',
+            False)
+        spec.addIntOption(
+            'mcts_batched_driver_workers',
+            'number of worker threads of the batched MCTS driver',
+            1)
+        spec.addBoolOption(
+            'mcts_transposition_table',
+            'share evaluations between transposed positions in MCTS',
+            False)
+        spec.addIntOption(
+            'mcts_pipeline_depth',
+            'number of rollout batches each MCTS thread keeps in flight',
+            1)
+        spec.addIntOption(
+            'mcts_time_budget_ms',
+            'wall-clock budget of an MCTS move in ms (0 = no limit)',
+            0)
+        spec.addBoolOption(
+            'mcts_early_stop',
+            'stop MCTS once the most visited move cannot change',
+            False)
         spec.addBoolOption(
             'mcts_use_prior',
             'use prior in MCTS',
@@ -97,11 +164,28 @@ class ContextArgs(object):
         mcts.num_threads = options.mcts_threads
         mcts.num_rollouts_per_thread = options.mcts_rollout_per_thread
         mcts.num_rollouts_per_batch = options.mcts_rollout_per_batch
+        mcts.adaptive_batch = options.mcts_adaptive_batch
+        mcts.min_rollouts_per_batch = options.mcts_min_rollout_per_batch
+        mcts.max_rollouts_per_batch = options.mcts_max_rollout_per_batch
         mcts.verbose = options.mcts_verbose
         mcts.verbose_time = options.mcts_verbose_time
         mcts.virtual_loss = options.mcts_virtual_loss
         mcts.pick_method = options.mcts_pick_method
         mcts.persistent_tree = options.mcts_persistent_tree
+        mcts.max_tree_nodes = options.mcts_max_tree_nodes
+        mcts.max_total_tree_nodes = options.mcts_max_total_tree_nodes
+        mcts.ponder = options.mcts_ponder
+        mcts.ponder_max_tree_nodes = options.mcts_ponder_max_tree_nodes
+        mcts.ponder_cpu_share = options.mcts_ponder_cpu_share
+        mcts.use_shared_pool = options.mcts_shared_pool
+        mcts.shared_pool_threads = options.mcts_shared_pool_threads
+        mcts.eval_batchsize = options.batchsize
+        mcts.use_batched_driver = options.mcts_batched_driver
+        mcts.batched_driver_workers = options.mcts_batched_driver_workers
+        mcts.use_transposition_table = options.mcts_transposition_table
+        mcts.pipeline_depth = options.mcts_pipeline_depth
+        mcts.time_budget_ms = options.mcts_time_budget_ms
+        mcts.early_stop = options.mcts_early_stop
         mcts.root_epsilon = options.mcts_epsilon
         mcts.root_alpha = options.mcts_alpha
 
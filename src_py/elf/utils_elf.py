@@ -78,6 +78,10 @@ class Allocator(object):
 
             smem_opts = ctx.createSharedMemOptions(name, this_batchsize)
             smem_opts.setTimeout(v.get("timeout_usec", 0))
+            if "min_batchsize" in v:
+                smem_opts.setMinBatchSize(v["min_batchsize"])
+            if v.get("transfer") == "direct":
+                smem_opts.setTransferType(smem_opts.DIRECT)
 
             for _ in range(num_recv):
                 smem = ctx.allocateSharedMem(smem_opts, keys)
@@ -79,6 +79,10 @@ class Loader(object):
             'ply_pass_enabled',
             'TODO: fill this help message in',
             0)
+        spec.addIntOption(
+            'eval_cache_size',
+            'number of network evaluations cached across games (0 = off)',
+            0)
         spec.addBoolOption(
             'use_mcts',
             'TODO: fill this help message in',
@@ -152,6 +156,7 @@ class Loader(object):
             self.options.black_use_policy_network_only
         opt.data_aug = self.options.data_aug
         opt.ply_pass_enabled = self.options.ply_pass_enabled
+        opt.eval_cache_size = self.options.eval_cache_size
         opt.num_reset_ranking = self.options.num_reset_ranking
         opt.move_cutoff = self.options.move_cutoff
         opt.num_games_per_thread = self.options.num_games_per_thread